@@ -9,16 +9,42 @@
 #undef OK  // macro de péssimo nome definido como `(0)` que quebra o gRPC
 #include <grpcpp/grpcpp.h>
 
+#include <algorithm>
+#include <atomic>
+#include <cctype>
 #include <chrono>
 #include <condition_variable>
+#include <cstdlib>
+#include <deque>
 #include <iostream>
 #include <optional>
 #include <string>
+#include <string_view>
 #include <thread>
 #include <unordered_map>
 #include <vector>
 
+#include "./aggregates.hpp"
+#include "./batch_snapshot.hpp"
+#include "./chunked_array.hpp"
+#include "./conversions.hpp"
+#include "./delta.hpp"
+#include "./enrichment.hpp"
 #include "./external.hpp"
+#include "./file_ingest.hpp"
+#include "./history_log.hpp"
+#include "./ingest.hpp"
+#include "./motion.hpp"
+#include "./navigation.hpp"
+#include "./pipeline.hpp"
+#include "./query.hpp"
+#include "./registry.hpp"
+#include "./ring_buffer.hpp"
+#include "./rules.hpp"
+#include "./shm_ingest.hpp"
+#include "./snapshot.hpp"
+#include "./spatial_index.hpp"
+#include "./thread_pool.hpp"
 #include "proto/simulation.grpc.pb.h"
 
 namespace sim = simulation;
@@ -32,108 +58,312 @@ struct std::hash<sim::Highway> {
 
 class ETL {
     static const int default_map_size = 4096;
+    // Número de veículos em cada tarefa submetida ao pool de threads
+    static const int chunk_size = 1024;
+    // Número aproximado de bytes de cada tarefa que interpreta os ciclos lidos de arquivos
+    static const int text_chunk_size = 1 << 16;
+    static const int default_history_depth = 16;
+    static const int default_cycle_queue_size = 8;
+    static const int default_eviction_ttl = 100;
+    // Número mínimo de ids verificados por lote na remoção de veículos inativos
+    static const int min_sweep_size = 4096;
+    // Parâmetros do cliente do serviço externo
+    static const int max_enrichment_requests = 4;
+    static const int enrichment_batch_size = 64;
+    static const int enrichment_queue_size = 1 << 16;
+    static const int enrichment_cache_size = 1 << 20;
+    // Número de mutexes que protegem as informações do serviço externo, escolhidos pelo id
+    static const int info_stripes = 64;
+    // Lotes que podem esperar entre as etapas do pipeline. Enquanto a fila de lotes está cheia,
+    // os ciclos esperam na fila da sua rodovia, sem perdas; só quando ela também enche a
+    // `OverloadPolicy` decide entre descartar um ciclo e esperar o Extract/Transform
+    static const int pending_batches = 1;
+    static const int pending_enrichment_batches = 4;
+    static const int default_dashboard_fps = 20;
+    // Tempo que as chamadas em andamento têm para terminar quando o servidor é encerrado
+    static constexpr double shutdown_deadline = 1.0;
 
     struct Position {
         uint32_t lane;
         uint32_t distance;
+        // Ciclo da rodovia em que a posição foi registrada
+        uint32_t cycle;
     };
 
-    // Armazena os dados instantâneos mais recentes de um veículo para o cálculo do risco
-    struct Vehicle {
+    // Armazena os dados instantâneos mais recentes dos veículos para o cálculo do risco. Cada campo
+    // fica em um vetor próprio indexado pelo id do veículo (estrutura de arrays), então o transform
+    // percorre apenas a memória dos campos que usa
+    struct VehicleState {
+        ChunkedArray<int> highway_index;
+        ChunkedArray<Position> last_pos;
+        // Velocidade do veículo em unidades deconhecidas de distância (talvez carro) por segundo
+        ChunkedArray<float> speed;
+        ChunkedArray<float> acceleration;
+        // Domínio: [0, 1]
+        ChunkedArray<float> risk;
+        // Distância e tempo até a colisão com os veículos à frente no último ciclo indexado da
+        // rodovia, e a posição do veículo no índice (veja spatial_index.hpp)
+        ChunkedArray<float> gap;
+        ChunkedArray<float> ttc;
+        ChunkedArray<float> side_ttc;
+        ChunkedArray<uint32_t> index_slot;
+        // Um bit para cada filtro do dashboard: o de todos os veículos e um por regra ativa
+        ChunkedArray<uint8_t> flags;
+        // Último ciclo da rodovia em que o veículo apareceu, usado para removê-lo quando inativo
+        ChunkedArray<uint32_t> last_seen;
+        // Último lote em que o veículo apareceu e quantas posições ele recebeu nesse lote
+        ChunkedArray<uint32_t> batch;
+        ChunkedArray<uint32_t> new_positions;
+        // Armazena as posições mais recentes de um veículo, incluindo deslocamento e sua faixa
+        ChunkedArray<RingBuffer<Position>> positions;
+
+        void ensure(uint32_t id) {
+            highway_index.ensure(id);
+            last_pos.ensure(id);
+            speed.ensure(id);
+            acceleration.ensure(id);
+            risk.ensure(id);
+            gap.ensure(id);
+            ttc.ensure(id);
+            side_ttc.ensure(id);
+            index_slot.ensure(id);
+            flags.ensure(id);
+            last_seen.ensure(id);
+            batch.ensure(id);
+            new_positions.ensure(id);
+            positions.ensure(id);
+        }
+    };
+
+    // Dados obtidos pelo serviço externo, que só são lidos pelo dashboard e ficam separados do
+    // estado usado no cálculo do risco. Os textos só são acessados com o mutex do id
+    struct VehicleInfo {
+        Plate plate;
         std::string name;
         std::string model;
-        int year = -1;
+        std::atomic<int> year{-1};
+    };
 
-        int highway_index;
-        Position last_pos;
-        // Velocidade do veículo em unidades deconhecidas de distância (talvez carro) por segundo
-        float speed;
-        float acceleration;
-        // Domínio: [0, 1]
-        float risk;
-        bool flags[3];
+    // Registros gravados no log de histórico quando saem dos buffers circulares
+    struct PositionRecord {
+        Plate plate;
+        Position position;
+    };
+
+    struct CycleRecord {
+        uint32_t highway_index;
+        uint32_t cycle;
+        double time;
     };
 
-    // Armazena as posições de um veículo em diferentes instantes, incluindo deslocamento e sua faixa
-    struct VehicleData {
-        std::vector<Position> positions;
-        Vehicle vehicle;
+    // Ciclos recebidos junto do índice da sua rodovia, processados juntos em um lote. Os ciclos
+    // de uma mesma rodovia ficam em ordem e são intercalados com os das outras em rodadas
+    struct CycleBatch {
+        std::vector<std::pair<IngestedCycle, int>> cycles;
+        // Conexões delta encerradas, cujos dicionários são liberados depois deste lote
+        std::vector<uint32_t> closed_streams;
+    };
+
+    // Veículo sem informações do serviço externo, copiado no Transform para que a etapa de
+    // enriquecimento não leia os dados que o próximo lote está escrevendo
+    struct EnrichmentRequest {
+        uint32_t id;
+        Plate plate;
+        uint8_t flags;
+        float score;
     };
 
     struct HighwayData {
         sim::Highway highway;
-        std::vector<uint32_t> cycles;
+        // Armazena os ciclos mais recentes recebidos da simulação
+        RingBuffer<uint32_t> cycles;
         // Armazena o instante de tempo de realização de cada ciclo da simulação
-        std::vector<double> times;
+        RingBuffer<double> times;
         // Armazena o tempo decorrido desde o início da simulação até a chegada no dashboard
         double time_elapsed;
+        // Veículos do último ciclo da rodovia extraído, por faixa e distância, e o número do ciclo
+        spatial::LaneIndex index;
+        int64_t indexed_cycle = -1;
     };
 
+ public:
+    using SnapshotReader = snapshot::Publisher<BatchSnapshot>::Reader;
+
+ private:
+    // Dados de cada worker do pool, que só escreve na própria posição do vetor
     struct ThreadData {
-        std::thread thread;
-        // Armazena as placas de veículos que tiveram informações modificadas e ainda não foram processadas
-        std::vector<std::string> modified;
-        // Armazena os veículos com dados computados antes que sejam exibidos no terminal
-        std::vector<std::pair<std::string, Vehicle>> vehicles_processing;
-        // Recebe os dados do vetor anterior e é atualizado dinamicamente enquanto é usado pelo dashboard
-        std::vector<std::pair<std::string, Vehicle>> vehicles_processed;
+        // Armazena os ids de veículos que tiveram informações modificadas e ainda não foram processadas
+        std::vector<uint32_t> modified;
+        // Veículos computados no lote e a posição entre eles dos que satisfazem cada filtro,
+        // trocados no fim do lote pelos de um lote que nenhum leitor usa mais
+        std::vector<VehicleView> views;
+        std::vector<uint32_t> filtered[rules::max_filters];
+        // Veículos de maior risco computados por este worker no lote
+        navigation::TopK riskiest;
+        // Veículos do lote atual que ainda precisam de informações do serviço externo
+        std::vector<EnrichmentRequest> enrichment_requests;
+        // Códigos das placas do trecho de um ciclo de memória compartilhada, convertidas juntas
+        std::vector<uint64_t> plate_codes;
+        // Veículos do bloco atual do Transform, calculados juntos pelo kernel
+        motion::MotionBatch motion_batch;
+        // Parte de cada ciclo do lote vista por este worker nos agregados de tráfego
+        std::vector<traffic::CycleBucket> traffic;
+        // Veículos removidos do registro por este worker no fim do lote
+        std::vector<uint32_t> evicted;
     };
 
-    class SimulationServiceImpl final : public sim::SimulationService::Service {
-        grpc::Status ReportCycle(grpc::ServerContext* context, const sim::SimulationCycle* cycle,
-                                 sim::Empty* response) override {
-            std::lock_guard<std::mutex> lock(mutex);
-            queue.push(std::move(*cycle));
-            cv.notify_one();
-            return grpc::Status::OK;
-        }
-
-     public:
-        std::queue<sim::SimulationCycle> queue;
-        std::condition_variable cv;
-        std::mutex mutex;
-
-        SimulationServiceImpl() {}
-
-        /// Retorna um valor que pode ou não conter um ciclo de simulação. Caso a fila
-        /// esteja vazia, espera pelo número fornecido de milissegundos ou até que os
-        /// dados sejam recebidos.
-        std::optional<sim::SimulationCycle> get_data(int64_t timeout = 500) {
-            std::unique_lock<std::mutex> lock(mutex);
-            // Se a fila estiver vazia, espera até que não esteja
-            if (queue.empty()) {
-                cv.wait_for(lock, std::chrono::milliseconds(timeout),
-                    [this] { return !queue.empty(); });
-                if (queue.empty())
-                    return {};
-            }
-            auto cycle = std::move(queue.front());
-            queue.pop();
-            return cycle;
-        }
+ public:
+    /// O que acontece quando chega um ciclo para uma rodovia que já tem a fila cheia.
+    enum class OverloadPolicy {
+        DROP_OLDEST,  // Descarta o ciclo mais antigo da fila
+        COALESCE,     // Substitui o ciclo mais recente da fila pelo novo
+        // Espera o Extract/Transform, deixando os ciclos na fila de recebimento. Quando ela enche
+        // (veja IngestService), os transportes param de ler e os simuladores esperam
+        BLOCK,
     };
 
- public:
-    ETL(int num_threads, int external_queue_size) : num_threads(num_threads), service(external_queue_size) {
+    ETL(int num_threads, int external_queue_size) :
+            vehicles(default_map_size), service(external_queue_size),
+            enrichment(service, std::min(external_queue_size, max_enrichment_requests), enrichment_batch_size,
+                       enrichment_queue_size, enrichment_cache_size,
+                       [this](std::vector<EnrichmentClient::Result>& results) { apply_enrichment(results); }),
+            query_service(snapshots, {
+                [this](const BatchSnapshot& snapshot, const Plate& plate) { return find_plate(snapshot, plate); },
+                [this](const VehicleView& view) { return owner_of(view); }}),
+            num_threads(num_threads) {
         // O serviço deve ser inicializado junto da classe atual, pois ele não possui construtor padrão
-        vehicles.reserve(default_map_size);
         highways.reserve(100);
     }
 
     ~ETL() {
+        // As respostas do serviço externo escrevem nos dados abaixo, então param antes de tudo
+        enrichment.stop();
         if (timeout_thread.joinable())
             timeout_thread.join();
     }
 
+    /// Pode ser chamada durante a execução: o pool é redimensionado no início do próximo lote.
     void set_thread_count(int num_threads) {
+        if (num_threads < 4)
+            throw std::runtime_error("Número de threads deve ser maior que ou igual a 4.");
         this->num_threads = num_threads;
     }
 
+    /// Define quantas posições de cada veículo e quantos ciclos de cada rodovia ficam em memória.
+    /// Deve ser chamada antes de `run`. O mínimo é 2, que são as posições usadas na velocidade.
+    void set_history_depth(int depth) {
+        if (depth < 2)
+            throw std::runtime_error("O histórico deve guardar pelo menos 2 posições.");
+        history_depth = depth;
+    }
+
+    /// Grava o histórico que sai da memória nos arquivos `positions.bin` e `cycles.bin` da pasta.
+    void set_history_log(const std::string& folder) {
+        position_log.open(folder + "/positions.bin");
+        cycle_log.open(folder + "/cycles.bin");
+        cycle_log.prepare(1);
+    }
+
+    /// Define quantos ciclos de cada rodovia podem esperar pelo Extract/Transform e o que fazer
+    /// quando essa fila enche. Deve ser chamada antes de `run`.
+    void set_overload_policy(OverloadPolicy policy, int cycle_queue_size = default_cycle_queue_size) {
+        if (cycle_queue_size < 1)
+            throw std::runtime_error("A fila de cada rodovia deve guardar pelo menos 1 ciclo.");
+        overload_policy = policy;
+        this->cycle_queue_size = cycle_queue_size;
+    }
+
+    /// Número de ciclos descartados pela política de sobrecarga desde o início da execução.
+    uint64_t dropped_cycles() const {
+        return dropped_cycles_;
+    }
+
+    /// Também recebe ciclos de simuladores na mesma máquina pelos anéis de memória compartilhada
+    /// com o prefixo, além do gRPC. Deve ser chamada antes de `run`.
+    void enable_shm_transport(const std::string& prefix = ShmRing::default_prefix) {
+        shm_ingest = std::make_unique<ShmIngest>(server_service, prefix);
+    }
+
+    /// Também recebe os ciclos escritos pelos simuladores em arquivos nas pastas, que são removidos
+    /// depois de lidos. Deve ser chamada antes de `run`.
+    void watch_folders(const std::vector<std::string>& folders) {
+        file_ingest = std::make_unique<FileIngest>(server_service, folders);
+    }
+
+    /// Define por quantos ciclos da sua rodovia um veículo pode ficar sem aparecer antes de ser
+    /// removido do registro. Com 0, os veículos nunca são removidos.
+    void set_eviction_ttl(int cycles) {
+        eviction_ttl = cycles;
+    }
+
+    /// Executa sem o dashboard: `run` não inicializa o terminal e os lotes não pedem desenhos. Deve
+    /// ser chamada antes de `run`.
+    void set_headless(bool headless = true) {
+        this->headless = headless;
+    }
+
+    /// Limita os desenhos do dashboard a `fps` por segundo; os pedidos feitos entre dois quadros
+    /// são atendidos juntos. Deve ser chamada antes de `run`.
+    void set_dashboard_fps(int fps) {
+        if (fps < 1)
+            throw std::runtime_error("O dashboard deve desenhar pelo menos 1 quadro por segundo.");
+        dashboard_fps = fps;
+    }
+
+    /// Encerra a execução como a tecla 'q'. `run` retorna depois que os lotes já entregues ao
+    /// pipeline terminam. Pode ser chamada de qualquer thread.
+    void stop() {
+        quit();
+    }
+
+    /// Custo dos desenhos do dashboard desde o início, medido à parte da latência do ETL de
+    /// `summary`.
+    struct RenderStats {
+        // Pedidos de desenho e quadros de fato desenhados
+        uint64_t requests = 0;
+        uint64_t frames = 0;
+        double mean_seconds = 0.0;
+        double max_seconds = 0.0;
+    };
+
+    RenderStats render_stats() {
+        std::lock_guard<std::mutex> lock(load_mutex);
+        return info.render;
+    }
+
+    /// Escolhe o conjunto de regras de alerta e seus parâmetros pelo arquivo de configuração (veja
+    /// rules.hpp). Sem o arquivo, fica o conjunto padrão. Deve ser chamada antes de `run`.
+    void load_rules(const std::string& path) {
+        rule_set = rules::make_rules(rules::RuleConfig::load(path));
+        filters = std::visit([](const auto& rule_set) { return rule_set.filters(); }, rule_set);
+    }
+
+    /// Agregados de tráfego da rodovia na `w`-ésima janela de `traffic::windows`, ou nada se a
+    /// rodovia ainda não recebeu ciclos. Pode ser chamada durante a execução.
+    std::optional<traffic::TrafficStats> traffic_stats(const std::string& highway, int w) {
+        std::lock_guard<std::mutex> lock(traffic_mutex);
+        auto it = traffic_index.find(highway);
+        if (it == traffic_index.end() || w < 0 || w >= traffic::num_windows)
+            return std::nullopt;
+        return traffic_windows[it->second].stats(w);
+    }
+
+    /// Último lote publicado, ou um leitor vazio antes do primeiro. Não bloqueia o pipeline: o lote
+    /// lido continua válido enquanto o leitor existir, mesmo que outros sejam publicados.
+    SnapshotReader read_snapshot() {
+        return snapshots.read();
+    }
+
+    /// Dados do veículo no lote lido, ou nullptr se ele não foi computado nesse lote.
+    const VehicleView* find_view(const BatchSnapshot& snapshot, uint32_t id) {
+        return snapshot.find(id);
+    }
+
     double summary(bool reset_counter = true) {
-        double result = info.num_runs ? (info.total_time / info.num_runs) : 0.0;
+        double result = num_runs ? (total_time / num_runs) : 0.0;
         if (reset_counter) {
-            info.num_runs = 0;
-            info.total_time = 0.0;
+            num_runs = 0;
+            total_time = 0.0;
         }
         return result;
     }
@@ -150,153 +380,421 @@ class ETL {
          *  2 threads para executar Load: uma para receber requisições de atualização
          *  do dashboard e uma para verificação de input do usuário.
          *  Esse número não leva em consideração threads que ficarão em espera na maioria
-         *  do tempo, como a thread de timeout, que apenas acorda para encerrar o programa.
+         *  do tempo, como a thread de timeout, que apenas acorda para encerrar o programa,
+         *  as threads que conduzem as etapas do pipeline, que só esperam o pool ou as filas
+         *  entre as etapas, e as threads do cliente do serviço externo. A thread que lê a
+         *  memória compartilhada, quando habilitada, faz o papel das threads do gRPC.
         */
         if (num_threads < 4)
             throw std::runtime_error("Número de threads deve ser maior que ou igual a 4.");
 
-        // Subtrai do número de threads para manter apenas a quantidade que é flexível
-        num_threads -= 3;
-        // Inicializa o dashboard
-        {
+        // O pool fica apenas com a quantidade de threads que é flexível
+        pool.resize(num_workers());
+        // Inicializa o dashboard, exceto no modo sem terminal
+        std::thread dashboard;
+        if (!headless) {
             setlocale(LC_ALL, "");
             initscr();
             noecho();
             keypad(stdscr, true);
-            std::thread dashboard(&ETL::load, this);
-            dashboard.detach();
+            dashboard = std::thread(&ETL::load, this);
         }
+        // Cada etapa do pipeline consome a fila da anterior, então o lote seguinte é extraído
+        // e transformado enquanto o atual ainda está sendo enriquecido
+        std::thread transform_thread(&ETL::transform_stage, this);
+        std::thread enrichment_thread(&ETL::enrichment_stage, this);
         std::thread orchestrator_thread(&ETL::orchestrator, this);
+        if (shm_ingest)
+            shm_ingest->start();
+        if (file_ingest)
+            file_ingest->start();
 
         this->listen(timeout);
+        if (shm_ingest)
+            shm_ingest->stop();
+        if (file_ingest)
+            file_ingest->stop();
         orchestrator_thread.join();
-        num_threads += 3;
+        transform_thread.join();
+        enrichment_thread.join();
+        // O terminal é restaurado antes de `run` retornar
+        if (dashboard.joinable())
+            dashboard.join();
     }
 
  private:
     // Mapeia os nomes de rodovias para suas filas de dados a processar
     std::unordered_map<std::string, int> highway_idx;
+    // Mapeia os ids de rodovias registradas no serviço de recebimento para os mesmos índices
+    std::vector<int> registered_highways;
     std::vector<HighwayData> highways;
-    // Mapeia a placa para os dados do veículo
-    std::unordered_map<std::string, VehicleData> vehicles;
-    // Armazena threads e seus respectivos dados em processamento
+    // Mapeia a placa para o id do veículo, permitindo buscas e inserções concorrentes
+    VehicleRegistry vehicles;
+    // Impede que a busca de placas do dashboard rode junto da remoção de placas e da liberação das
+    // tabelas antigas do registro
+    std::mutex registry_mutex;
+    // Dados dos veículos indexados pelo id
+    VehicleState state;
+    ChunkedArray<VehicleInfo> vehicle_info;
+    std::mutex info_mutexes[info_stripes];
+    // Workers persistentes que executam as etapas de Extract e Transform
+    ThreadPool pool;
+    // Armazena os dados em processamento de cada worker do pool
     std::vector<ThreadData> thread_data;
-    // Armazena os índices de ciclos que serão e que estão sendo processados
-    std::vector<std::pair<sim::SimulationCycle, int>> cycles_to_process;
-    std::vector<std::pair<sim::SimulationCycle, int>> cycles_processing;
-
-    // Mutex "principal" que vai impedir concorrência entre as threads em E e T
+    // Lotes publicados para o dashboard e as consultas
+    snapshot::Publisher<BatchSnapshot> snapshots;
+    // Ciclos de cada rodovia que esperam o Extract/Transform, do mais antigo para o mais recente
+    std::vector<std::deque<IngestedCycle>> pending_cycles;
+    int num_pending_cycles = 0;
+    std::vector<uint32_t> closed_streams;
+    // Armazena os ciclos que estão sendo processados
+    CycleBatch cycles_processing;
+    // Dicionário de cada conexão delta e veículos já com id de cada ciclo delta ou de arquivo do lote
+    std::unordered_map<uint32_t, DeltaDecoder> delta_streams;
+    std::vector<std::vector<DeltaVehicle>> decoded;
+    // Ids dos veículos do último ciclo de cada rodovia no lote, na ordem do ciclo, para o índice
+    // espacial. Os outros ciclos ficam com o vetor vazio
+    std::vector<std::vector<uint32_t>> cycle_ids;
+    // Número e posição no lote dos ciclos de cada rodovia no lote atual, em ordem
+    std::vector<std::vector<std::pair<uint32_t, int>>> batch_cycles;
+    // Janelas de agregados de cada rodovia, indexadas como `highways`. O mutex as protege das
+    // consultas feitas por outras threads
+    std::mutex traffic_mutex;
+    std::vector<traffic::HighwayWindows> traffic_windows;
+    std::unordered_map<std::string, int> traffic_index;
+    // Filas entre o orquestrador, o Extract/Transform e o enriquecimento
+    BoundedQueue<CycleBatch> batch_queue{pending_batches};
+    BoundedQueue<std::vector<EnrichmentRequest>> enrichment_queue{pending_enrichment_batches};
+
+    // Mutex que protege os contadores compartilhados pelas threads em T
     std::mutex mutex;
     // Serviço externo que ainda está me assombrando
     SlowService service;
+    // Envia as consultas ao serviço externo sem bloquear o ETL
+    EnrichmentClient enrichment;
 
     // Servidor gRPC
     std::unique_ptr<grpc::Server> server;
     // Serviço que implementa a interface do gRPC e gerencia o recebimento de dados
-    SimulationServiceImpl server_service;
+    IngestService server_service;
+    // Consultas e assinaturas dos dashboards externos, respondidas com os lotes publicados
+    QueryService query_service;
+    // Transporte por memória compartilhada, que entrega os ciclos ao mesmo serviço
+    std::unique_ptr<ShmIngest> shm_ingest;
+    // Pastas observadas em busca de arquivos de ciclo
+    std::unique_ptr<FileIngest> file_ingest;
     // Thread usada para encerrar o servidor após um tempo
     std::thread timeout_thread;
     bool is_server_running = false;
 
-    int num_threads;
-    bool etl_running = false;
+    std::atomic<int> num_threads;
+    OverloadPolicy overload_policy = OverloadPolicy::BLOCK;
+    bool headless = false;
+    int dashboard_fps = default_dashboard_fps;
+    int cycle_queue_size = default_cycle_queue_size;
+    std::atomic<uint64_t> dropped_cycles_{0};
+    // Número do lote atual, usado para saber se um veículo já apareceu nele
+    uint32_t batch_number = 0;
+    // Soma e número dos tempos entre a simulação e a análise, usados por `summary`
+    double total_time = 0.0;
+    int num_runs = 0;
+    int history_depth = default_history_depth;
+    int eviction_ttl = default_eviction_ttl;
+    // Próximo id a ser verificado na remoção de veículos inativos
+    uint32_t sweep_cursor = 0;
+    // Logs opcionais com o histórico que não cabe mais nos buffers circulares
+    HistoryLog<PositionRecord> position_log;
+    HistoryLog<CycleRecord> cycle_log;
+    // Regras de alerta avaliadas no Transform e os filtros do dashboard que elas definem
+    rules::ActiveRules rule_set;
+    std::vector<rules::FilterInfo> filters = rules::DefaultRules::filters();
+    static_assert(rules::max_filters <= EnrichmentClient::max_categories);
+
+    int num_workers() const {
+        return num_threads - 3;
+    }
+
+    /// Retorna o índice da rodovia do ciclo, identificada pelo id registrado no serviço ou, nos
+    /// clientes antigos, pela rodovia enviada junto do ciclo. Adiciona a rodovia se for nova.
+    int get_highway_index(const IngestedCycle& cycle) {
+        uint32_t id = cycle.highway_id();
+        if (id != 0 && id < registered_highways.size() && registered_highways[id] >= 0)
+            return registered_highways[id];
+
+        sim::Highway registered;
+        if (id != 0)
+            registered = server_service.highway(id);
+        // A rodovia enviada junto do ciclo está na arena dele, e só é copiada se for nova
+        const sim::Highway& highway = id != 0 ? registered : cycle.cycle->highway();
+        auto it = highway_idx.find(highway.name());
+        int highway_index;
 
-    int get_cycle_index(int highway_index) const {
-        int i;
-        for (i = 0; i < cycles_to_process.size(); i++) {
-            if (cycles_to_process[i].second == highway_index)
-                return i;
+        // Se a rodovia ainda não está registrada, adiciona ao vetor
+        if (it == highway_idx.end()) {
+            highway_index = highways.size();
+            highways.emplace_back(highway);
+            highways.back().cycles.reset(history_depth);
+            highways.back().times.reset(history_depth);
+            highway_idx.emplace(highways.back().highway.name(), highway_index);
+            pending_cycles.emplace_back();
+        } else {
+            highway_index = it->second;
+        }
+        if (id != 0) {
+            if (registered_highways.size() <= id)
+                registered_highways.resize(id + 1, -1);
+            registered_highways[id] = highway_index;
         }
-        return -1;
+        return highway_index;
     }
 
-    void expand_map() {
-        int max_size = vehicles.size();
-        for (const auto& [cycle, highway_index] : cycles_to_process) {
-            // Adiciona os dados da simulação aos vetores da rodovia correspondente
-            highways[highway_index].cycles.push_back(cycle.cycle());
-            highways[highway_index].times.push_back(cycle.timestamp());
+    /// Retira todos os ciclos à espera, formando um lote em rodadas: a k-ésima rodada tem o
+    /// k-ésimo ciclo de cada rodovia, então os ciclos de uma rodovia ficam em ordem.
+    CycleBatch take_pending_cycles() {
+        CycleBatch batch;
+        batch.cycles.reserve(num_pending_cycles);
+        while (num_pending_cycles > 0) {
+            for (int i = 0; i < pending_cycles.size(); i++) {
+                if (pending_cycles[i].empty())
+                    continue;
+                batch.cycles.emplace_back(std::move(pending_cycles[i].front()), i);
+                pending_cycles[i].pop_front();
+                num_pending_cycles--;
+            }
+        }
+        // Os ciclos anteriores de uma conexão encerrada já foram entregues ou estão neste lote
+        batch.closed_streams = std::move(closed_streams);
+        closed_streams.clear();
+        return batch;
+    }
 
-            // Computa o número máximo de veículos que podem ser adicionados
-            max_size += cycle.vehicles_size();
+    /// Adiciona o ciclo à fila da rodovia, aplicando a política de sobrecarga se ela estiver cheia.
+    void enqueue_cycle(IngestedCycle&& cycle, int highway_index) {
+        std::deque<IngestedCycle>& queue = pending_cycles[highway_index];
+        if (queue.size() >= cycle_queue_size) {
+            // Um ciclo delta depende de todos os anteriores da conexão, então nunca é descartado
+            bool lossless = cycle.is_delta() || queue.front().is_delta();
+            switch (lossless ? OverloadPolicy::BLOCK : overload_policy) {
+                case OverloadPolicy::DROP_OLDEST:
+                    queue.pop_front();
+                    num_pending_cycles--;
+                    dropped_cycles_++;
+                    break;
+                case OverloadPolicy::COALESCE:
+                    queue.pop_back();
+                    num_pending_cycles--;
+                    dropped_cycles_++;
+                    break;
+                case OverloadPolicy::BLOCK:
+                    batch_queue.push(take_pending_cycles());
+                    break;
+            }
         }
-        int capacity = vehicles.bucket_count();
-        // Duplica a capacidade atual até que possa acomodar todos esses veículos
-        while (capacity < max_size)
-            capacity *= 2;
-        // Se a capacidade atual for menor que a necessária, realoca o unordered_map
-        if (capacity > vehicles.bucket_count())
-            vehicles.reserve(capacity);
+        queue.push_back(std::move(cycle));
+        num_pending_cycles++;
     }
 
-    void force_redraw(bool reset = false) {
-        std::lock_guard<std::mutex> lock(load_mutex);
-        // Se força um reset, atualiza as informações gerais do dashboard além
-        // das informações individuais dos carros
-        if (reset) {
-            for (int i = 0; i < 3; i++)
-                info.num_vehicles[i] = vehicle_counts[i];
-            update_filter(info.vehicle_filter, true);
+    void register_cycles() {
+        // Adiciona os dados da simulação aos vetores da rodovia correspondente. O registro de
+        // veículos cresce sozinho, shard por shard, então não precisa ser realocado aqui
+        for (const auto& [cycle, highway_index] : cycles_processing.cycles) {
+            HighwayData& data = highways[highway_index];
+            if (data.cycles.full() && cycle_log.is_open())
+                cycle_log.append(0, {static_cast<uint32_t>(highway_index), data.cycles.front(), data.times.front()});
+            data.cycles.push(cycle.number());
+            data.times.push(cycle.timestamp());
         }
+    }
+
+    /// Pede um novo desenho do dashboard. O mutex só protege o pedido, pois o desenho lê o último
+    /// lote publicado sem ele. Sem o dashboard, não faz nada.
+    void force_redraw() {
+        if (headless)
+            return;
+        std::lock_guard<std::mutex> lock(load_mutex);
         should_draw = true;
+        info.render.requests++;
         load_cv.notify_one();
     }
 
-    void join_all_threads() {
-        for (int i = 0; i < thread_data.size(); i++)
-            thread_data[i].thread.join();
+    /// Etapa de Extract e Transform: processa os lotes entregues pelo orquestrador até que a
+    /// fila seja fechada, e então fecha a fila da etapa seguinte.
+    void transform_stage() {
+        while (batch_queue.pop(cycles_processing)) {
+            // Abriu espaço na fila: o orquestrador pode entregar os ciclos que acumulou
+            server_service.wake();
+            etl();
+            for (uint32_t stream : cycles_processing.closed_streams)
+                delta_streams.erase(stream);
+            // Libera de uma vez as arenas dos ciclos do lote, em vez de esperar o próximo
+            cycles_processing.cycles.clear();
+        }
+        enrichment_queue.close();
+    }
+
+    /// Etapa de enriquecimento: repassa ao cliente do serviço externo os veículos de cada lote.
+    void enrichment_stage() {
+        std::vector<EnrichmentRequest> requests;
+        while (enrichment_queue.pop(requests)) {
+            // Placas já consultadas vêm do cache na hora; as outras são respondidas por
+            // `apply_enrichment` quando o serviço externo terminar, com as mais perigosas primeiro
+            bool changed = false;
+            for (const EnrichmentRequest& request : requests) {
+                OwnerInfo cached;
+                auto status = enrichment.submit(request.id, request.plate, request.flags, request.score, cached);
+                if (status == EnrichmentClient::Status::CACHED) {
+                    set_owner(request.id, request.plate, std::move(cached));
+                    changed = true;
+                }
+            }
+            if (changed)
+                force_redraw();
+        }
     }
 
     void etl() {
-        thread_data.resize(num_threads);
-        // Armazena o último índice de cada ciclo processado
+        register_cycles();
+        // Aplica mudanças feitas por `set_thread_count` entre um lote e outro
+        int workers = num_workers();
+        if (pool.size() != workers)
+            pool.resize(workers);
+        // O vetor nunca diminui, pois o dashboard pode estar lendo as posições antigas
+        if (thread_data.size() < workers)
+            thread_data.resize(workers);
+        for (ThreadData& data : thread_data) {
+            data.modified.resize(0);
+            data.views.resize(0);
+            for (std::vector<uint32_t>& positions : data.filtered)
+                positions.resize(0);
+            data.riskiest.clear();
+            data.enrichment_requests.resize(0);
+            // Os buckets só são zerados quando o worker conta o primeiro veículo do ciclo
+            if (data.traffic.size() < cycles_processing.cycles.size())
+                data.traffic.resize(cycles_processing.cycles.size());
+            for (traffic::CycleBucket& bucket : data.traffic)
+                bucket.used = false;
+        }
+        if (position_log.is_open())
+            position_log.prepare(thread_data.size());
+        batch_number++;
+        // Armazena o último índice de cada ciclo processado e o primeiro índice de cada rodada.
+        // Uma rodada tem no máximo um ciclo por rodovia, então um veículo aparece no máximo uma
+        // vez nela e as rodadas podem ser extraídas em paralelo, uma depois da outra
         std::vector<int> indices;
-        indices.reserve(cycles_processing.size());
+        std::vector<int> rounds{0};
+        std::vector<int> highway_rounds(highways.size(), 0);
+        const auto& cycles = cycles_processing.cycles;
+        indices.reserve(cycles.size());
+        if (decoded.size() < cycles.size())
+            decoded.resize(cycles.size());
+        decode_texts();
         int last_index = 0;
-        for (int i = 0; i < cycles_processing.size(); i++) {
-            last_index += cycles_processing[i].first.vehicles_size();
+        for (int i = 0; i < cycles.size(); i++) {
+            int round = highway_rounds[cycles[i].second]++;
+            if (round == rounds.size())
+                rounds.push_back(last_index);
+            // Os ciclos delta são aplicados aos dicionários aqui, em ordem, e o Extract recebe
+            // os veículos já com id e posição
+            const IngestedCycle& cycle = cycles[i].first;
+            if (cycle.is_delta()) {
+                decode_delta(i);
+                last_index += decoded[i].size();
+            } else if (cycle.is_text()) {
+                last_index += decoded[i].size();
+            } else if (cycle.is_record()) {
+                last_index += cycle.record->num_vehicles;
+            } else {
+                last_index += cycle.cycle->vehicles_size();
+            }
             indices.push_back(last_index);
         }
+        rounds.push_back(last_index);
+
+        if (batch_cycles.size() < highways.size())
+            batch_cycles.resize(highways.size());
+        for (int i = 0; i < cycles.size(); i++)
+            batch_cycles[cycles[i].second].clear();
+        for (int i = 0; i < cycles.size(); i++)
+            batch_cycles[cycles[i].second].emplace_back(cycles[i].first.number(), i);
+
+        // Só o último ciclo de cada rodovia entra no índice espacial
+        std::vector<int> indexed;
+        if (cycle_ids.size() < cycles.size())
+            cycle_ids.resize(cycles.size());
+        for (int i = 0; i < cycles.size(); i++) {
+            if (highway_rounds[cycles[i].second]-- == 1) {
+                indexed.push_back(i);
+                cycle_ids[i].resize(indices[i] - (i > 0 ? indices[i - 1] : 0));
+            } else {
+                cycle_ids[i].clear();
+            }
+        }
 
-        int chunk_size = last_index / num_threads;
-        for (int i = 0; i < num_threads; i++) {
-            thread_data[i].modified.resize(0);
-            thread_data[i].thread = std::thread(&ETL::extract,
-                this, i, i * chunk_size, (i + 1) * chunk_size, indices);
+        for (int r = 0; r + 1 < rounds.size(); r++) {
+            pool.parallel_for(rounds[r], rounds[r + 1], chunk_size, [this, &indices](int start, int end, int worker) {
+                extract(worker, start, end, indices);
+            });
         }
-        join_all_threads();
 
-        // Zera os contadores de veículos em cada categoria de filtro
-        vehicle_counts[VehicleFilter::ALL] = last_index;
-        vehicle_counts[VehicleFilter::COLLISION_RISK] = 0;
-        vehicle_counts[VehicleFilter::ABOVE_SPEED_LIMIT] = 0;
+        // Cada rodovia atualiza o próprio índice, então elas são divididas entre os workers
+        pool.parallel_for(0, indexed.size(), 1, [this, &indexed](int start, int end, int worker) {
+            for (int k = start; k < end; k++)
+                update_neighbours(indexed[k]);
+        });
+
+        // Divide as placas modificadas por cada worker em blocos para a transformação
+        std::vector<std::pair<int, int>> chunks;
+        for (int i = 0; i < thread_data.size(); i++) {
+            int size = thread_data[i].modified.size();
+            for (int start = 0; start < size; start += chunk_size)
+                chunks.emplace_back(i, start);
+        }
 
         // Faz a transformação prioritária dos dados
-        for (int i = 0; i < num_threads; i++)
-            thread_data[i].thread = std::thread(&ETL::transform, this, i);
-        join_all_threads();
-
-        for (int i = 0; i < num_threads; i++)
-            thread_data[i].vehicles_processed = std::move(thread_data[i].vehicles_processing);
+        pool.parallel_for(0, chunks.size(), 1, [this, &chunks](int start, int end, int worker) {
+            for (int i = start; i < end; i++)
+                transform(worker, chunks[i].first, chunks[i].second, chunks[i].second + chunk_size);
+        });
+
+        merge_traffic();
+
+        std::vector<EnrichmentRequest> requests;
+        for (ThreadData& data : thread_data)
+            requests.insert(requests.end(), data.enrichment_requests.begin(), data.enrichment_requests.end());
+        // Nenhum worker está buscando placas agora, e o dashboard espera o mutex para buscar,
+        // então as tabelas antigas podem ser liberadas
+        {
+            std::lock_guard<std::mutex> lock(registry_mutex);
+            vehicles.collect();
+        }
+        if (position_log.is_open()) {
+            position_log.flush();
+            cycle_log.flush();
+        }
 
+        // Os ciclos de cada rodovia estão em ordem, então o último define o tempo exibido
         double now_ = now();
-        for (int i = 0; i < cycles_processing.size(); i++) {
-            int highway_index = cycles_processing[i].second;
-            highways[highway_index].time_elapsed = now_ - highways[highway_index].times.back();
-            info.total_time += highways[highway_index].time_elapsed;
-            info.num_runs++;
+        for (int i = 0; i < cycles.size(); i++) {
+            int highway_index = cycles[i].second;
+            highways[highway_index].time_elapsed = now_ - cycles[i].first.timestamp();
+            total_time += highways[highway_index].time_elapsed;
+            num_runs++;
         }
 
-        // Força a atualização do dashboard
-        force_redraw(true);
+        // Remove parte dos veículos inativos antes de liberar o dashboard para este lote
+        {
+            std::lock_guard<std::mutex> lock(registry_mutex);
+            sweep();
+        }
 
-        // Obtém os dados do serviço externo opcionalmente
-        for (int i = 0; i < num_threads; i++)
-            thread_data[i].thread = std::thread(&ETL::transform_continued, this, i);
-        join_all_threads();
+        // Publica o lote, avisa as assinaturas e força a atualização do dashboard
+        publish_batch();
+        query_service.notify();
         force_redraw();
 
-        etl_running = false;
+        // Só espera se a etapa de enriquecimento estiver vários lotes atrasada
+        if (!requests.empty())
+            enrichment_queue.push(std::move(requests));
     }
 
     void listen(double timeout = 0.0) {
@@ -305,9 +803,21 @@ class ETL {
         grpc::ServerBuilder builder;
         builder.AddListeningPort(server_address, grpc::InsecureServerCredentials());
         builder.RegisterService(&server_service);
+        query_service.set_filters(filters);
+        builder.RegisterService(&query_service);
 
         server = builder.BuildAndStart();
-        is_server_running = true;
+        if (!server)
+            throw std::runtime_error("Não foi possível iniciar o servidor em " + server_address + ".");
+        bool stopped;
+        {
+            std::lock_guard<std::mutex> lock(load_mutex);
+            // `stop` pode ter sido chamada antes de o servidor existir
+            stopped = should_exit;
+            is_server_running = !stopped;
+        }
+        if (stopped)
+            server->Shutdown();
         if (timeout != 0.0) {
             timeout_thread = std::thread([this, timeout] {
                 std::this_thread::sleep_for(std::chrono::duration<double>(timeout));
@@ -319,48 +829,43 @@ class ETL {
     }
 
     void orchestrator() {
+        IngestedCycle cycle;
         while (true) {
+            // O bilhete vem antes de todas as condições verificadas abaixo, então um ciclo novo,
+            // um espaço na fila de lotes ou o encerramento acordam a espera que vier depois delas
+            uint32_t ticket = server_service.ticket();
             if (should_exit)
                 break;
-            if (cycles_to_process.size() && !etl_running) {
-                expand_map();
-                cycles_processing = std::move(cycles_to_process);
-                std::thread runner(&ETL::etl, this);
-                runner.detach();
-                etl_running = true;
+            // Entrega os ciclos acumulados assim que o Extract/Transform tiver espaço para eles
+            if ((num_pending_cycles > 0 || !closed_streams.empty()) && !batch_queue.full())
+                batch_queue.push(take_pending_cycles());
+            if (!server_service.pop(cycle)) {
+                server_service.wait(ticket);
+                continue;
             }
-            std::optional<sim::SimulationCycle> answer = server_service.get_data();
-            // Se não houve resposta após 0.5 segundo, tenta novamente
-            if (!answer.has_value())
+            if (cycle.closed) {
+                closed_streams.push_back(cycle.stream);
                 continue;
-            sim::SimulationCycle& cycle = answer.value();
-            auto it = highway_idx.find(cycle.highway().name());
-            int highway_index;
-
-            // Se a rodovia ainda não está registrada, adiciona ao vetor
-            if (it == highway_idx.end()) {
-                highway_index = highways.size();
-                highways.emplace_back(std::move(cycle.highway()));
-                highway_idx.emplace(highways.back().highway.name(), highway_index);
-            } else {
-                highway_index = it->second;
             }
-            int cycle_index = get_cycle_index(highway_index);
-            // Se a rodovia não está na fila de processamento, ela é adicionada
-            if (cycle_index < 0)
-                cycles_to_process.emplace_back(std::move(cycle), highway_index);
-            // Se ela está na fila, substitui o ciclo antigo pelo mais recente
-            else
-                cycles_to_process[cycle_index].first = std::move(cycle);
+            int highway_index = get_highway_index(cycle);
+            enqueue_cycle(std::move(cycle), highway_index);
         }
+        // Encerra as etapas seguintes depois que elas terminarem os lotes já entregues
+        batch_queue.close();
+    }
+
+    /// Número somado à faixa dos veículos da direção 1, que ficam depois das faixas da direção 0
+    /// no estado dos veículos, no índice espacial e nos agregados. `Highway.lanes` conta as faixas
+    /// de uma direção só, como o simulador as envia, então o deslocamento é o número inteiro de
+    /// faixas: com metade dele, as faixas mais altas de uma direção coincidiam com as mais baixas da
+    /// outra, e veículos em sentidos opostos pareciam estar na mesma faixa.
+    static uint32_t direction_offset(const sim::Highway& highway) {
+        return highway.lanes();
     }
 
     void extract(int thread_id, int start, int end, const std::vector<int>& indices) {
         ThreadData& data = thread_data[thread_id];
         // Obtém o índice do ciclo que contém o primeiro veículo a ser processado
-        // Corrige a divisão imprecisa e garante que todos os veículos serão processados
-        if (thread_id == num_threads - 1)
-            end = indices.back();
         int cycle_index = 0;
         for (int i = 0; i < indices.size(); i++) {
             if (indices[i] > start) {
@@ -369,135 +874,489 @@ class ETL {
             }
         }
 
-        auto none = vehicles.end();
         int offset = cycle_index == 0 ? 0 : indices[cycle_index - 1];
         // i é o índice usado para acessar o vetor de dados do ciclo, então é um
         // índice local, diferente dos índices usados para dividir a carga do ETL
         int i = start - offset;
         do {
-            sim::SimulationCycle& cycle = cycles_processing[cycle_index].first;
-            int highway_index = cycles_processing[cycle_index].second;
-            int factor = highways[highway_index].highway.lanes() / 2;
+            const IngestedCycle& cycle = cycles_processing.cycles[cycle_index].first;
+            int highway_index = cycles_processing.cycles[cycle_index].second;
+            int factor = direction_offset(highways[highway_index].highway);
+            uint32_t number = cycle.number();
 
             // Variável que armazena o índice do último veículo no vetor local do ciclo
             int local_end = std::min(end, indices[cycle_index]) - offset;
+            // As placas dos registros têm tamanho fixo, então o trecho todo é convertido de uma vez
+            const uint64_t* plate_codes = nullptr;
+            if (cycle.is_record() && i < local_end) {
+                data.plate_codes.resize(local_end - i);
+                plate_code::encode_batch(cycle.record->vehicles()[i].plate, sizeof(ShmVehicle), local_end - i,
+                                         data.plate_codes.data());
+                plate_codes = data.plate_codes.data() - i;
+            }
+            std::vector<uint32_t>& ids = cycle_ids[cycle_index];
             while (i < local_end) {
-                const sim::RawVehicle& vehicle = cycle.vehicles(i++);
-                // No código abaixo, como não podemos ter mais de uma thread tentando acessar a
-                // mesma placa, o único problema que pode ocorrer é a placa não estar registrada e
-                // ser inserida no mesmo espaço de memória em que outra placa que está sendo inserida
-                VehicleData* current;
-                auto it = vehicles.find(vehicle.plate());
-                // Se a placa ainda não está registrada, cria seu registro sem condição de corrida
-                if (it == none) {
-                    std::lock_guard<std::mutex> lock(mutex);
-                    current = &vehicles[vehicle.plate()];
-                // Se a placa já está registrada, obtém um ponteiro para seus dados e os atualiza
+                uint32_t id;
+                Position position;
+                int local = i;
+                if (cycle.is_delta() || cycle.is_text()) {
+                    const DeltaVehicle& vehicle = decoded[cycle_index][i++];
+                    id = vehicle.id;
+                    position = {vehicle.lane, vehicle.distance, number};
+                } else if (cycle.is_record()) {
+                    id = register_vehicle(plate_codes[i]);
+                    const ShmVehicle& vehicle = cycle.record->vehicles()[i++];
+                    uint32_t lane = vehicle.lane + vehicle.direction * factor;
+                    position = {lane, vehicle.distance, number};
                 } else {
-                    current = &it->second;
+                    const sim::RawVehicle& vehicle = cycle.cycle->vehicles(i++);
+                    // Como não podemos ter mais de uma thread acessando a mesma placa, só o registro
+                    // em si precisa ser concorrente; os dados do veículo são escritos sem locks
+                    id = register_vehicle(vehicle.plate());
+                    // Transforma os dois índices da faixa em um só para facilitar acesso ao array
+                    uint32_t lane = vehicle.lane() + vehicle.direction() * factor;
+                    position = {lane, vehicle.distance(), number};
                 }
 
-                // Transforma os dois índices da faixa em um só para facilitar acesso ao array
-                uint32_t lane = vehicle.lane() + vehicle.direction() * factor;
-                current->vehicle.highway_index = highway_index;
-                current->vehicle.last_pos = {lane, vehicle.distance()};
-                current->positions.push_back(current->vehicle.last_pos);
-                data.modified.push_back(vehicle.plate());
+                if (!ids.empty())
+                    ids[local] = id;
+                state.highway_index[id] = highway_index;
+                state.last_pos[id] = position;
+                state.last_seen[id] = number;
+                RingBuffer<Position>& positions = state.positions[id];
+                if (positions.capacity() == 0)
+                    positions.reset(history_depth);
+                else if (positions.full() && position_log.is_open())
+                    position_log.append(thread_id, {vehicle_info[id].plate, positions.front()});
+                positions.push(state.last_pos[id]);
+                // O veículo entra uma única vez no Transform, que percorre todas as suas posições
+                // novas. Rodadas anteriores do lote podem tê-lo visto em outro worker
+                if (state.batch[id] != batch_number) {
+                    state.batch[id] = batch_number;
+                    state.new_positions[id] = 0;
+                    data.modified.push_back(id);
+                }
+                state.new_positions[id]++;
             }
             i = 0;
             offset = indices[cycle_index];
-        } while (++cycle_index < indices.size());
+        } while (++cycle_index < indices.size() && offset < end);
+    }
+
+    /// Conta a posição de um veículo, com a velocidade calculada nela, no bucket do seu ciclo nos
+    /// dados do worker. Velocidades negativas são contadas só na densidade.
+    void count_traffic(ThreadData& data, int highway_index, const Position& position, float speed) {
+        // Quase sempre o ciclo é o último da rodovia no lote
+        const auto& numbers = batch_cycles[highway_index];
+        auto it = std::find_if(numbers.rbegin(), numbers.rend(), [&position](const auto& entry) {
+            return entry.first == position.cycle;
+        });
+        if (it == numbers.rend())
+            return;
+        traffic::CycleBucket& bucket = data.traffic[it->second];
+        if (!bucket.used) {
+            const sim::Highway& highway = highways[highway_index].highway;
+            bucket.reset(2 * highway.lanes(), highway.size());
+        }
+        bucket.add(position.lane, position.distance, speed);
+    }
 
-        // Garante que o vetor que recebe os dados do transform está preparado
-        data.vehicles_processing.resize(0);
-        data.vehicles_processing.reserve(data.modified.size());
+    /// Junta as partes de cada ciclo do lote contadas pelos workers e as entrega às janelas da
+    /// rodovia, na ordem dos ciclos. O custo depende do número de ciclos, não de veículos.
+    void merge_traffic() {
+        const auto& cycles = cycles_processing.cycles;
+        traffic::CycleBucket total;
+        std::lock_guard<std::mutex> lock(traffic_mutex);
+        for (int i = 0; i < cycles.size(); i++) {
+            int highway_index = cycles[i].second;
+            const sim::Highway& highway = highways[highway_index].highway;
+            if (traffic_windows.size() <= highway_index)
+                traffic_windows.resize(highway_index + 1);
+            if (traffic_index.emplace(highway.name(), highway_index).second)
+                traffic_windows[highway_index].reset(2 * highway.lanes(), highway.size());
+            total.reset(2 * highway.lanes(), highway.size());
+            for (const ThreadData& data : thread_data) {
+                if (data.traffic[i].used)
+                    total.merge(data.traffic[i]);
+            }
+            traffic_windows[highway_index].push(total);
+        }
     }
 
-    void transform(int thread_id) {
-        int risk_count = 0;
-        int speed_count = 0;
+    /// Atualiza o índice espacial da rodovia do i-ésimo ciclo do lote, que é o último dela, e
+    /// calcula a distância e o tempo até a colisão de cada veículo do ciclo com os da frente.
+    void update_neighbours(int i) {
+        const auto& [cycle, highway_index] = cycles_processing.cycles[i];
+        HighwayData& data = highways[highway_index];
+        const std::vector<uint32_t>& ids = cycle_ids[i];
+        data.index.update(ids.data(), ids.size(), [this](uint32_t id) {
+            const Position& position = state.last_pos[id];
+            return spatial::key(position.lane, position.distance);
+        }, [this](uint32_t id) {
+            // Velocidade da posição atual, a mesma que o Transform vai calcular
+            const RingBuffer<Position>& positions = state.positions[id];
+            if (positions.size() < 2)
+                return 0.0f;
+            const Position& current = positions.back();
+            const Position& previous = positions.back(1);
+            return static_cast<float>(current.distance - previous.distance) /
+                   static_cast<float>(current.cycle - previous.cycle);
+        }, state.index_slot);
+        data.index.neighbours(data.highway.lanes(), [this](uint32_t id, const spatial::Neighbours& neighbours) {
+            state.gap[id] = neighbours.gap;
+            state.ttc[id] = neighbours.ttc;
+            state.side_ttc[id] = neighbours.side_ttc;
+        });
+        data.indexed_cycle = cycle.number();
+    }
+
+    /// Vizinhos do veículo no último ciclo indexado da sua rodovia, ou nenhum se ele não estava
+    /// nesse ciclo.
+    spatial::Neighbours neighbours_of(uint32_t id) const {
+        const HighwayData& data = highways[state.highway_index[id]];
+        if (data.indexed_cycle != state.last_seen[id])
+            return {};
+        return {state.gap[id], state.ttc[id], state.side_ttc[id]};
+    }
+
+    /// Retorna o id da placa com o código dado, registrando-a se for nova. Pode ser chamada por
+    /// vários workers.
+    uint32_t register_vehicle(uint64_t code) {
+        auto [id, inserted] = vehicles.find_or_insert(code, [this](uint32_t id) {
+            state.ensure(id);
+            vehicle_info.ensure(id);
+        });
+        if (inserted) {
+            std::lock_guard<std::mutex> lock(info_mutex(id));
+            vehicle_info[id].plate = Plate(code);
+        }
+        return id;
+    }
+
+    uint32_t register_vehicle(std::string_view plate) {
+        return register_vehicle(VehicleRegistry::key_of(plate));
+    }
+
+    /// Aplica o i-ésimo ciclo do lote, que é delta, ao dicionário da sua conexão. As placas que
+    /// entraram são registradas aqui; as demais já têm id e não passam pelo registro.
+    void decode_delta(int i) {
+        const auto& [cycle, highway_index] = cycles_processing.cycles[i];
+        uint32_t factor = direction_offset(highways[highway_index].highway);
+        delta_streams[cycle.stream].apply(*cycle.delta, factor, [this](std::string_view plate) {
+            return register_vehicle(plate);
+        }, decoded[i]);
+    }
+
+    /// Interpreta em paralelo os veículos dos ciclos de arquivos do lote, em blocos de linhas de
+    /// todos os arquivos. Cada bloco primeiro conta suas linhas, o que define onde os veículos dele
+    /// ficam em `decoded`, e depois interpreta as linhas e registra as placas. Assim o Extract
+    /// recebe esses veículos já com id, como os dos ciclos delta.
+    void decode_texts() {
+        struct Chunk {
+            int cycle;
+            const char* begin;
+            const char* end;
+            size_t offset;
+            size_t count;
+        };
+        const auto& cycles = cycles_processing.cycles;
+        std::vector<Chunk> chunks;
+        for (int i = 0; i < cycles.size(); i++) {
+            if (!cycles[i].first.is_text())
+                continue;
+            const TextCycle& text = *cycles[i].first.text;
+            for (auto [begin, end] : delimiters::split_lines(text.begin, text.end, text_chunk_size))
+                chunks.push_back({i, begin, end, 0, 0});
+            decoded[i].clear();
+        }
+        if (chunks.empty())
+            return;
+
+        pool.parallel_for(0, chunks.size(), 1, [&chunks](int start, int end, int worker) {
+            for (int k = start; k < end; k++)
+                chunks[k].count = delimiters::count_lines(chunks[k].begin, chunks[k].end);
+        });
+        for (Chunk& chunk : chunks) {
+            chunk.offset = decoded[chunk.cycle].size();
+            decoded[chunk.cycle].resize(chunk.offset + chunk.count);
+        }
+        pool.parallel_for(0, chunks.size(), 1, [this, &chunks, &cycles](int start, int end, int worker) {
+            for (int k = start; k < end; k++) {
+                Chunk& chunk = chunks[k];
+                uint32_t factor = direction_offset(highways[cycles[chunk.cycle].second].highway);
+                DeltaVehicle* out = decoded[chunk.cycle].data() + chunk.offset;
+                chunk.count = parse_vehicles(chunk.begin, chunk.end, [this, &out, factor](
+                        std::string_view plate, uint32_t direction, uint32_t lane, uint32_t distance) {
+                    *out++ = {register_vehicle(plate), lane + (direction != 0) * factor, distance};
+                });
+            }
+        });
+
+        // Linhas inválidas deixam posições vazias no fim do seu bloco, removidas aqui
+        size_t size = 0;
+        for (int k = 0; k < chunks.size(); k++) {
+            std::vector<DeltaVehicle>& vehicles = decoded[chunks[k].cycle];
+            if (k > 0 && chunks[k].cycle != chunks[k - 1].cycle)
+                size = 0;
+            if (size != chunks[k].offset)
+                std::copy_n(vehicles.begin() + chunks[k].offset, chunks[k].count, vehicles.begin() + size);
+            size += chunks[k].count;
+            if (k + 1 == chunks.size() || chunks[k + 1].cycle != chunks[k].cycle)
+                vehicles.resize(size);
+        }
+    }
+
+    /// Transforma as placas [start, end) extraídas pelo worker `source`, guardando o resultado
+    /// nos dados do worker `thread_id`, que é o que está executando a tarefa.
+    void transform(int thread_id, int source, int start, int end) {
         ThreadData& data = thread_data[thread_id];
-        for (const std::string& plate : data.modified) {
-            VehicleData* current = &vehicles[plate];
-            Vehicle* car = &current->vehicle;
-            int highway_index = car->highway_index;
-
-            std::vector<Position>& positions = current->positions;
-            std::vector<uint32_t>& cycles = highways[highway_index].cycles;
-            float speed_limit = highways[highway_index].highway.speed_limit();
-
-            // Efetua o cálculo da velocidade e aceleração apenas se houver mais de uma posição
-            if (positions.size() > 1) {
-                float prev_speed = car->speed;
-                int last = positions.size() - 1;
-                int last_cycle = cycles.size() - 1;
-
-                // Calcula velocidade como deslocamento dividido por tempo decorrido
-                car->speed = static_cast<float>(positions[last].distance - positions[last - 1].distance)
-                    / (cycles[last_cycle] - cycles[last_cycle - 1]);
-                if (car->speed == -0.0f)
-                    car->speed = 0.0f;
-
-                if (positions.size() > 2) {
-                    // Calcula aceleração como variação de velocidade dividida por tempo decorrido
-                    car->acceleration = (car->speed - prev_speed)
-                        / (cycles[last_cycle] - cycles[last_cycle - 1]);
-                    if (car->acceleration == -0.0f)
-                        car->acceleration = 0.0f;
-
-                    if (positions.size() > 3) {
-                        float x = 3.0f * (car->speed + car->speed * std::abs(car->acceleration)) / speed_limit - 5.0f;
-                        // Cálculo do risco de colisão usando a função sigmoide
-                        car->risk = 1.0f / (1.0f + std::exp(-x));
-                    } else {
-                        car->risk = -1.0f;
-                    }
-                } else {
-                    car->acceleration = 0.0f;
-                    car->risk = -1.0f;
-                }
-            // Se não há dados suficientes, define como valores negativos para que possam ser
-            // descartados facilmente na análise posterior
-            } else {
-                car->speed = -1.0f;
-                car->acceleration = 0.0f;
-                car->risk = -1.0f;
+        const std::vector<uint32_t>& modified = thread_data[source].modified;
+        end = std::min(end, static_cast<int>(modified.size()));
+        if (start >= end)
+            return;
+
+        // Junta a posição mais recente de cada veículo em um lote contíguo para o kernel
+        motion::MotionBatch& batch = data.motion_batch;
+        batch.resize(end - start);
+        for (int k = start; k < end; k++) {
+            uint32_t id = modified[k];
+            size_t lane = k - start;
+            float speed = state.speed[id];
+            float acceleration = state.acceleration[id];
+            float risk = state.risk[id];
+
+            const RingBuffer<Position>& positions = state.positions[id];
+            float speed_limit = highways[state.highway_index[id]].highway.speed_limit();
+
+            // Percorre as posições recebidas neste lote da mais antiga para a mais recente, então
+            // a aceleração usa a velocidade da posição anterior mesmo com vários ciclos no lote. As
+            // posições que já saíram do buffer não têm a anterior e são ignoradas. Só a mais
+            // recente vai para o kernel
+            uint32_t fresh = std::min(state.new_positions[id], positions.size());
+            if (fresh == positions.size() && positions.total() > fresh)
+                fresh--;
+            auto delta = [&positions](uint32_t k) {
+                // Ciclos entre as duas posições do veículo, que podem não ser consecutivos
+                const Position& current = positions.back(k);
+                const Position& previous = positions.back(k + 1);
+                return std::make_pair(static_cast<float>(current.distance - previous.distance),
+                                      static_cast<float>(current.cycle - previous.cycle));
+            };
+            for (uint32_t k = fresh; k-- > 1;) {
+                // Número de posições já registradas até a atual, incluindo ela
+                uint64_t seen = positions.total() - k;
+                auto [displacement, elapsed] = seen > 1 ? delta(k) : std::make_pair(0.0f, 1.0f);
+                motion::step(seen, displacement, elapsed, speed_limit, speed, acceleration, risk);
+                count_traffic(data, state.highway_index[id], positions.back(k), speed);
             }
+            uint32_t seen = fresh > 0 ? positions.total() : 0;
+            auto [displacement, elapsed] = seen > 1 ? delta(0) : std::make_pair(0.0f, 1.0f);
+            batch.displacement[lane] = displacement;
+            batch.elapsed[lane] = elapsed;
+            batch.speed_limit[lane] = speed_limit;
+            batch.proximity[lane] = spatial::proximity(neighbours_of(id));
+            batch.seen[lane] = seen;
+            batch.speed[lane] = speed;
+            batch.acceleration[lane] = acceleration;
+            batch.risk[lane] = risk;
+        }
+
+        motion::compute(batch);
+        // A escolha do conjunto de regras é feita uma vez por bloco, e o laço é especializado
+        std::visit([&](const auto& rule_set) { write_back(rule_set, thread_id, modified, start, end); }, rule_set);
+    }
 
-            car->flags[ALL] = true;
-            car->flags[COLLISION_RISK] = car->risk >= 0.5f;
-            car->flags[ABOVE_SPEED_LIMIT] = car->speed > speed_limit;
-            risk_count += car->flags[COLLISION_RISK];  // booleano é igual a 1 ou 0
-            speed_count += car->flags[ABOVE_SPEED_LIMIT];
-            data.vehicles_processing.emplace_back(plate, *car);
+    /// Escreve o resultado do kernel no estado dos veículos [start, end) de `modified` e avalia as
+    /// regras no mesmo laço, que copia os veículos para o lote publicado, monta as listas de cada
+    /// filtro e o heap dos maiores riscos e pede ao serviço externo os veículos que ainda não têm
+    /// informações.
+    template<typename RuleSet>
+    void write_back(const RuleSet& rule_set, int thread_id, const std::vector<uint32_t>& modified,
+                    int start, int end) {
+        ThreadData& data = thread_data[thread_id];
+        const motion::MotionBatch& batch = data.motion_batch;
+        // Variação do número de veículos registrados em cada filtro
+        int registered_delta[rules::max_filters] = {};
+        for (int k = start; k < end; k++) {
+            uint32_t id = modified[k];
+            size_t lane = k - start;
+            state.speed[id] = batch.speed[lane];
+            state.acceleration[id] = batch.acceleration[lane];
+            state.risk[id] = batch.risk[lane];
+
+            float weight = 0.0f;
+            spatial::Neighbours neighbours = neighbours_of(id);
+            uint8_t flags = rule_set(rules::VehicleSample<RingBuffer<Position>>{batch.speed[lane],
+                batch.acceleration[lane], batch.risk[lane], batch.speed_limit[lane], batch.flags[lane],
+                neighbours.gap, std::min(neighbours.ttc, neighbours.side_ttc), state.positions[id]}, weight);
+            uint8_t old_flags = state.flags[id];
+            state.flags[id] = flags;
+            uint32_t position = data.views.size();
+            data.views.push_back(make_view(id, neighbours));
+            for (int f = 0; f <= RuleSet::size; f++) {
+                if (flags >> f & 1)
+                    data.filtered[f].push_back(position);
+                registered_delta[f] += (flags >> f & 1) - (old_flags >> f & 1);
+            }
+            if (batch.risk[lane] >= 0.0f)
+                data.riskiest.offer(batch.risk[lane], id);
+            if (batch.seen[lane] > 0)
+                count_traffic(data, state.highway_index[id], state.positions[id].back(), batch.speed[lane]);
+
+            // Veículos sem informações do serviço externo são consultados na etapa seguinte
+            const VehicleInfo& car = vehicle_info[id];
+            if (car.year < 0) {
+                float score = weight + std::max(batch.risk[lane], 0.0f);
+                data.enrichment_requests.push_back({id, car.plate, flags, score});
+            }
         }
 
-        // Incrementa os contadores de veículos em risco e acima da velocidade máxima
         std::unique_lock<std::mutex> lock(mutex);
-        vehicle_counts[COLLISION_RISK] += risk_count;
-        vehicle_counts[ABOVE_SPEED_LIMIT] += speed_count;
-    }
-
-    // Obtém informações do serviço externo para os veículos que não as possuem
-    void transform_continued(int thread_id) {
-        // Passa a usar dados movidos para outro vetor, deixando vehicles_processing para os próximos
-        // ciclos e atualizando os dados atualmente no dashboard conforme o serviço externo responde
-        for (auto& [plate, vehicle] : thread_data[thread_id].vehicles_processed) {
-            // Tentamos obter as informações do veículo pelo serviço externo lento e atualizamos
-            // tanto no dashboard quanto no registro geral de veículos
-            if (vehicle.year < 0 && service.query_vehicle(plate)) {
-                // Atualiza no dashboard
-                vehicle.name = service.get_name();
-                vehicle.model = service.get_model();
-                vehicle.year = service.get_year();
-
-                // Atualiza no registro geral
-                Vehicle* car = &vehicles[plate].vehicle;
-                car->name = vehicle.name;
-                car->model = vehicle.model;
-                car->year = vehicle.year;
+        for (int f = 0; f <= RuleSet::size; f++)
+            registered_counts[f] += registered_delta[f];
+    }
+
+    /// Cópia do estado atual do veículo para os lotes publicados.
+    VehicleView make_view(uint32_t id, const spatial::Neighbours& neighbours) {
+        const Position& position = state.last_pos[id];
+        return {id, vehicle_info[id].plate, state.highway_index[id], position.lane, position.distance, state.speed[id],
+                state.acceleration[id], state.risk[id], neighbours.gap, std::min(neighbours.ttc, neighbours.side_ttc),
+                state.flags[id]};
+    }
+
+    /// Publica o lote: as listas dos workers são trocadas pelas de um lote que nenhum leitor usa
+    /// mais, então nada é copiado nem alocado depois dos primeiros lotes.
+    void publish_batch() {
+        std::unique_ptr<BatchSnapshot> next = snapshots.reuse();
+        if (!next)
+            next = std::make_unique<BatchSnapshot>();
+        next->batch = batch_number;
+        next->evicted.clear();
+        navigation::TopK top;
+        for (size_t t = 0; t < thread_data.size(); t++) {
+            ThreadData& data = thread_data[t];
+            std::swap(next->vehicles.part(t), data.views);
+            for (int f = 0; f < rules::max_filters; f++)
+                std::swap(next->filtered[f].part(t), data.filtered[f]);
+            top.merge(data.riskiest);
+            next->evicted.insert(next->evicted.end(), data.evicted.begin(), data.evicted.end());
+            data.evicted.clear();
+        }
+        next->vehicles.update();
+        for (int f = 0; f < rules::max_filters; f++)
+            next->filtered[f].update();
+        // A posição de cada veículo fica no próprio lote, e não no estado do veículo, que o
+        // Transform do lote seguinte sobrescreve antes de o lote seguinte ser publicado
+        if (next->slots.size() < vehicles.id_limit())
+            next->slots.resize(vehicles.id_limit());
+        BatchSnapshot& batch = *next;
+        pool.parallel_for(0, thread_data.size(), 1, [&batch](int start, int end, int worker) {
+            for (int t = start; t < end; t++)
+                batch.index_part(t);
+        });
+        next->riskiest.clear();
+        for (const navigation::Ranked& entry : top.sorted())
+            next->riskiest.push_back(make_view(entry.id, neighbours_of(entry.id)));
+        next->highways.resize(highways.size());
+        for (int h = 0; h < highways.size(); h++)
+            next->highways[h] = {highways[h].highway.name(), highways[h].time_elapsed};
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            std::copy(registered_counts, registered_counts + rules::max_filters, next->registered);
+        }
+        next->dropped_cycles = dropped_cycles_;
+        snapshots.publish(std::move(next));
+    }
+
+    /// Remove os veículos que não aparecem há mais de `eviction_ttl` ciclos da sua rodovia. A cada
+    /// lote só uma fatia dos ids é verificada, de modo que todos sejam vistos a cada `eviction_ttl`
+    /// lotes sem que um lote pague pela varredura completa. Roda entre o Transform e o Extract do
+    /// próximo lote, com `registry_mutex`, então nenhuma outra thread busca as placas removidas.
+    void sweep() {
+        uint32_t limit = vehicles.id_limit();
+        if (eviction_ttl <= 0 || limit == 0)
+            return;
+        uint32_t budget = std::min(limit, std::max<uint32_t>(min_sweep_size, limit / eviction_ttl));
+        uint32_t first = sweep_cursor % limit;
+
+        pool.parallel_for(0, budget, chunk_size, [this, limit, first](int start, int end, int worker) {
+            std::vector<uint32_t>& evicted_ids = thread_data[worker].evicted;
+            int evicted[rules::max_filters] = {};
+            for (int k = start; k < end; k++) {
+                uint32_t id = (first + k) % limit;
+                int highway_index = state.highway_index[id];
+                // Ids livres, à espera de serem reaproveitados
+                if (highway_index < 0)
+                    continue;
+                uint32_t idle = highways[highway_index].cycles.back() - state.last_seen[id];
+                if (idle <= static_cast<uint32_t>(eviction_ttl))
+                    continue;
+
+                VehicleInfo& car = vehicle_info[id];
+                uint8_t flags = state.flags[id];
+                for (int f = 0; f < rules::max_filters; f++)
+                    evicted[f] += flags >> f & 1;
+                // Libera o histórico e as informações do serviço externo antes de liberar o id
+                state.flags[id] = 0;
+                state.highway_index[id] = -1;
+                state.positions[id].reset(0);
+                std::lock_guard<std::mutex> lock(info_mutex(id));
+                std::string().swap(car.name);
+                std::string().swap(car.model);
+                car.year = -1;
+                vehicles.erase(car.plate.code());
+                evicted_ids.push_back(id);
             }
+            std::lock_guard<std::mutex> lock(mutex);
+            for (int f = 0; f < rules::max_filters; f++)
+                registered_counts[f] -= evicted[f];
+        });
+        sweep_cursor = first + budget;
+    }
+
+    std::mutex& info_mutex(uint32_t id) {
+        return info_mutexes[id % info_stripes];
+    }
+
+    /// Escreve as informações do serviço externo no veículo, se o id ainda pertencer à placa
+    /// consultada (ele pode ter sido removido e reaproveitado enquanto a consulta era feita).
+    void set_owner(uint32_t id, const Plate& plate, OwnerInfo&& owner) {
+        std::lock_guard<std::mutex> lock(info_mutex(id));
+        VehicleInfo& car = vehicle_info[id];
+        if (car.plate != plate)
+            return;
+        car.name = std::move(owner.name);
+        car.model = std::move(owner.model);
+        car.year = owner.year;
+    }
+
+    /// Informações do serviço externo do veículo, se o id ainda pertencer à mesma placa: elas são
+    /// aplicadas depois do lote.
+    OwnerInfo owner_of(const VehicleView& view) {
+        std::lock_guard<std::mutex> lock(info_mutex(view.id));
+        const VehicleInfo& car = vehicle_info[view.id];
+        if (car.plate != view.plate)
+            return {};
+        return {car.name, car.model, car.year};
+    }
+
+    /// Dados do veículo da placa no lote lido, ou nullptr se ela não está no registro ou no lote.
+    const VehicleView* find_plate(const BatchSnapshot& snapshot, const Plate& plate) {
+        uint32_t id;
+        {
+            std::lock_guard<std::mutex> lock(registry_mutex);
+            id = vehicles.find(plate.code());
         }
+        if (id == VehicleRegistry::no_id)
+            return nullptr;
+        const VehicleView* view = find_view(snapshot, id);
+        return view && view->plate == plate ? view : nullptr;
+    }
+
+    void apply_enrichment(std::vector<EnrichmentClient::Result>& results) {
+        for (EnrichmentClient::Result& result : results)
+            set_owner(result.id, result.plate, std::move(result.info));
+        force_redraw();
     }
 
     void load() {
@@ -505,30 +1364,57 @@ class ETL {
             std::thread input_thread(&ETL::handle_input, this);
             input_thread.detach();
         }
+        using Clock = std::chrono::steady_clock;
+        const auto frame_interval = std::chrono::duration_cast<Clock::duration>(
+            std::chrono::duration<double>(1.0 / dashboard_fps));
+        Clock::time_point next_frame = Clock::now();
+        std::unique_lock<std::mutex> load_lock(load_mutex);
         while (true) {
-            std::unique_lock<std::mutex> load_lock(load_mutex);
             // Se não tem um "pedido de desenho", espera até que ele chegue
-            if (!should_draw)
-                load_cv.wait(load_lock, [this] { return should_draw; });
+            load_cv.wait(load_lock, [this] { return should_draw; });
+            // Os pedidos que chegam antes do próximo quadro são atendidos juntos por ele
+            load_cv.wait_until(load_lock, next_frame, [this] { return should_exit; });
             if (should_exit)
                 break;
             should_draw = false;
-            draw();
+            // Só a navegação é copiada com o mutex; o lote é lido pelo ponteiro publicado, então o
+            // ETL pode publicar outro enquanto o terminal é desenhado
+            DashboardInfo shown = info;
+            load_lock.unlock();
+            Clock::time_point start = Clock::now();
+            draw(shown);
+            double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+            next_frame = start + frame_interval;
+            load_lock.lock();
+            RenderStats& render = info.render;
+            render.mean_seconds += (seconds - render.mean_seconds) / ++render.frames;
+            render.max_seconds = std::max(render.max_seconds, seconds);
         }
         endwin();
     }
 
     void quit() {
-        load_mutex.lock();
-        if (is_server_running) {
+        bool shutdown;
+        {
+            std::lock_guard<std::mutex> lock(load_mutex);
+            shutdown = is_server_running;
             is_server_running = false;
-            server->Shutdown();
+            // Necessário para que a thread de desenho pare de esperar
+            should_draw = true;
+            should_exit = true;
         }
-        // Necessário para que a thread de desenho pare de esperar
-        should_draw = true;
-        should_exit = true;
-        load_mutex.unlock();
         load_cv.notify_one();
+        server_service.wake();
+        // As chamadas que esperam espaço na fila de recebimento terminam em vez de esperar o prazo
+        server_service.close();
+        // As assinaturas nunca terminam sozinhas, então são encerradas antes do servidor
+        query_service.shutdown();
+        // Fora do mutex, pois espera as chamadas em andamento, que são canceladas após o prazo
+        if (shutdown) {
+            auto deadline = std::chrono::system_clock::now() + std::chrono::duration_cast<
+                std::chrono::system_clock::duration>(std::chrono::duration<double>(shutdown_deadline));
+            server->Shutdown(deadline);
+        }
     }
 
     /*
@@ -537,29 +1423,37 @@ class ETL {
      *
     */
 
-    enum VehicleFilter : int {
-        ALL,
-        COLLISION_RISK,
-        ABOVE_SPEED_LIMIT,
-    };
-
     struct DashboardInfo {
-        double total_time;
-        int num_runs;
-        // Índices de acesso dos veículo atual nos vetores analisados
-        int vehicle_i;
-        int vehicle_j;
+        // Posição do veículo atual na lista do filtro, começando em 1. É limitada ao tamanho da
+        // lista no lote exibido, então se mantém entre lotes quando ainda existe
         int absolute_value;
         int vehicle_filter;
         int highway_filter;
-        // Armazena o número de veículos para cada categoria de filtro
-        int num_vehicles[3];
+        // Comando sendo digitado ('g' para saltar a uma posição, '/' para buscar uma placa, 0 se
+        // nenhum) e o texto digitado
+        int input_mode;
+        std::string input;
+        // Veículo encontrado pela busca, exibido no lugar do selecionado pelo filtro. O código da
+        // placa confirma que o id não foi reaproveitado por outro veículo
+        bool pinned;
+        uint32_t pinned_id;
+        uint64_t pinned_code;
+        // Resultado do último comando, exibido até o próximo
+        std::string message;
+        // Exibe a lista dos veículos de maior risco do último lote
+        bool show_riskiest;
+        // Custo dos desenhos, atualizado depois de cada quadro
+        RenderStats render;
     };
 
+    // Tamanho máximo do texto dos comandos do dashboard
+    static const int max_input = 16;
+
     std::condition_variable load_cv;
     std::mutex load_mutex;
     DashboardInfo info{};
-    int vehicle_counts[3];
+    // Número de veículos no registro em cada filtro, atualizado incrementalmente
+    int registered_counts[rules::max_filters] = {};
     // Indica se o programa deve ser encerrado (ao receber 'q' como input)
     bool should_exit = false;
     bool should_draw = false;
@@ -571,158 +1465,287 @@ class ETL {
         return static_cast<double>(nanoseconds) / 1e9;
     }
 
+    /// Número de veículos do filtro no último lote publicado.
+    long filter_size(int filter) {
+        SnapshotReader current = snapshots.read();
+        return current ? static_cast<long>(current->size(filter)) : 0;
+    }
+
+    /// Posição escolhida limitada a uma lista com `size` veículos, ou 0 se ela estiver vazia.
+    static int clamp_position(long position, long size) {
+        return static_cast<int>(std::clamp(position, std::min(1L, size), size));
+    }
+
+    /// Retorna true se havia um veículo fixado pela busca.
+    bool unpin() {
+        bool was_pinned = info.pinned;
+        info.pinned = false;
+        return was_pinned;
+    }
+
+    /// Seleciona o veículo na posição dada do filtro atual, limitada ao tamanho da lista. Retorna
+    /// true se houve mudança no valor do veículo atual.
+    bool jump_to(long position, long size) {
+        int value = clamp_position(position, size);
+        if (value == info.absolute_value)
+            return false;
+        info.absolute_value = value;
+        return true;
+    }
+
     /// Retorna true se houve mudança no valor do veículo atual.
     bool find_previous() {
-        for (int i = info.vehicle_i; i >= 0; i--) {
-            int j = i == info.vehicle_i ? info.vehicle_j - 1 : get_processed(i).size() - 1;
-            for (j; j >= 0; j--) {
-                if (get_processed(i)[j].second.flags[info.vehicle_filter]) {
-                    info.vehicle_i = i;
-                    info.vehicle_j = j;
-                    info.absolute_value--;
-                    return true;
-                }
-            }
+        long size = filter_size(info.vehicle_filter);
+        return jump_to(clamp_position(info.absolute_value, size) - 1, size);
+    }
+
+    /// Retorna true se houve mudança no valor do veículo atual.
+    bool find_next() {
+        long size = filter_size(info.vehicle_filter);
+        return jump_to(clamp_position(info.absolute_value, size) + 1, size);
+    }
+
+    /// Retorna true se o filtro foi atualizado. Define o veículo selecionado como o primeiro do
+    /// filtro.
+    bool update_filter(int new_value) {
+        if (new_value != info.vehicle_filter) {
+            info.vehicle_filter = new_value;
+            info.absolute_value = 1;
+            return true;
         }
         return false;
     }
 
-    const std::vector<std::pair<std::string, Vehicle>>& get_processed(int i) {
-        return thread_data[i].vehicles_processed;
+    /// Busca a placa no registro e fixa o veículo encontrado no dashboard.
+    void search_plate(const std::string& text) {
+        std::string symbols = text;
+        for (char& symbol : symbols)
+            symbol = static_cast<char>(std::toupper(static_cast<unsigned char>(symbol)));
+        Plate plate(symbols.c_str(), symbols.size());
+        uint32_t id;
+        {
+            std::lock_guard<std::mutex> lock(registry_mutex);
+            id = vehicles.find(plate.code());
+        }
+        if (id == VehicleRegistry::no_id) {
+            info.message = "Placa não encontrada: " + symbols;
+            return;
+        }
+        info.pinned = true;
+        info.pinned_id = id;
+        info.pinned_code = plate.code();
+        info.message.clear();
     }
 
-    /// Retorna true se houve mudança no valor do veículo atual.
-    bool find_next() {
-        for (int i = info.vehicle_i; i < thread_data.size(); i++) {
-            int j = i == info.vehicle_i ? info.vehicle_j + 1 : 0;
-            for (j; j < get_processed(i).size(); j++) {
-                if (get_processed(i)[j].second.flags[info.vehicle_filter]) {
-                    info.vehicle_i = i;
-                    info.vehicle_j = j;
-                    info.absolute_value++;
-                    return true;
-                }
+    /// Executa o comando digitado.
+    void run_command() {
+        if (info.input_mode == 'g') {
+            char* end;
+            long position = std::strtol(info.input.c_str(), &end, 10);
+            if (info.input.empty() || *end != '\0') {
+                info.message = "Posição inválida: " + info.input;
+                return;
             }
+            unpin();
+            jump_to(position, filter_size(info.vehicle_filter));
+            info.message.clear();
+        } else {
+            search_plate(info.input);
         }
-        return false;
     }
 
-    /// Retorna true se o filtro foi atualizado. Define o veículo selecionado como
-    /// o primeiro que se adequa ao filtro especificado.
-    bool update_filter(int new_value, bool force = false) {
-        if (new_value != info.vehicle_filter || force) {
-            info.vehicle_filter = new_value;
-            info.vehicle_i = 0;
-            info.vehicle_j = 0;
-            if (info.num_vehicles[info.vehicle_filter] > 0) {
-                if (get_processed(0).size() == 0 || !get_processed(0)[0].second.flags[info.vehicle_filter])
-                    find_next();
-                info.absolute_value = 1;
-            } else {
-                info.absolute_value = 0;
-            }
-            return true;
+    /// Tecla recebida enquanto um comando é digitado. Retorna true se o dashboard mudou.
+    bool handle_command_key(int key) {
+        if (key == '\n' || key == '\r' || key == KEY_ENTER) {
+            run_command();
+            info.input_mode = 0;
+        } else if (key == 27) {  // Esc cancela o comando
+            info.input_mode = 0;
+        } else if (key == KEY_BACKSPACE || key == 127 || key == '\b') {
+            if (info.input.empty())
+                return false;
+            info.input.pop_back();
+        } else if (key >= ' ' && key < 127 && info.input.size() < max_input) {
+            info.input.push_back(static_cast<char>(key));
+        } else {
+            return false;
+        }
+        return true;
+    }
+
+    /// Tecla recebida fora dos comandos. Retorna true se o dashboard mudou.
+    bool handle_key(int key) {
+        switch (key) {
+            case KEY_LEFT:
+                return unpin() | find_previous();
+            case KEY_RIGHT:
+                return unpin() | find_next();
+            case 'g':
+            case '/':
+                info.input_mode = key;
+                info.input.clear();
+                return true;
+            case 'k':
+                info.show_riskiest = !info.show_riskiest;
+                return true;
+            default:
+                // As teclas dos filtros vêm das regras ativas
+                for (int f = 0; f < filters.size(); f++) {
+                    if (key == filters[f].key)
+                        return unpin() | update_filter(f);
+                }
+                return false;
         }
-        return false;
     }
 
     void handle_input() {
         while (true) {
-            bool changed = false;
-            switch (getch()) {
-                case KEY_LEFT:
-                    changed = find_previous();
-                    break;
-                case KEY_RIGHT:
-                    changed = find_next();
-                    break;
-                case 'q':
-                    quit();
-                    return;
-                case 't':
-                    changed = update_filter(VehicleFilter::ALL);
-                    break;
-                case 'r':
-                    changed = update_filter(VehicleFilter::COLLISION_RISK);
-                    break;
-                case 'v':
-                    changed = update_filter(VehicleFilter::ABOVE_SPEED_LIMIT);
-                    break;
-                default:
-                    break;
+            int key = getch();
+            // A navegação é lida pelo desenho, então só é alterada com o mutex
+            std::unique_lock<std::mutex> lock(load_mutex);
+            if (key == 'q' && info.input_mode == 0) {
+                lock.unlock();
+                quit();
+                return;
             }
+            bool changed = info.input_mode != 0 ? handle_command_key(key) : handle_key(key);
             if (changed) {
-                load_mutex.lock();
                 should_draw = true;
-                load_mutex.unlock();
+                lock.unlock();
                 load_cv.notify_one();
             }
         }
     }
 
-    void draw() {
-        static const std::pair<std::string, Vehicle> default_car = std::make_pair(
-            std::string("-------"), Vehicle{"", "", -1, -1, {0, 0}, -1, 0, -1});
-        clear();
+    void draw(const DashboardInfo& shown) {
+        static const BatchSnapshot no_batch;
+        SnapshotReader snapshot = snapshots.read();
+        const BatchSnapshot& batch = snapshot ? *snapshot : no_batch;
+        // Apaga só a tela virtual: o refresh envia ao terminal apenas os caracteres que mudaram
+        // desde o quadro anterior, enquanto o clear redesenharia a tela inteira
+        erase();
         printw("Dashboard\n\n");
 
-        printw("Número de rodovias: %d\n", static_cast<int>(highways.size()));
-        printw("Número de veículos: %d\n", info.num_vehicles[ALL]);
-        printw("Número de veículos acima do limite de velocidade: %d\n\n",
-            info.num_vehicles[ABOVE_SPEED_LIMIT]);
+        printw("Número de rodovias: %d\n", static_cast<int>(batch.highways.size()));
+        printw("Número de veículos: %d\n", static_cast<int>(batch.size(rules::all_filter)));
+        printw("Ciclos descartados por sobrecarga: %lu\n", static_cast<unsigned long>(dropped_cycles_));
+        printw("Desenho: %.3f ms por quadro (máximo %.3f ms), %lu quadros para %lu pedidos\n\n",
+            shown.render.mean_seconds * 1e3, shown.render.max_seconds * 1e3,
+            static_cast<unsigned long>(shown.render.frames), static_cast<unsigned long>(shown.render.requests));
+
+        // Veículos do último lote e do registro em cada filtro das regras ativas
+        printw("Filtros (último lote, registrados):\n");
+        for (int f = 0; f < filters.size(); f++)
+            printw("\t%s: %d, %d\n", filters[f].name, static_cast<int>(batch.size(f)), batch.registered[f]);
+        printw("\n");
+
+        const char* vehicle_filter_name = filters[shown.vehicle_filter].name;
+
+        // Fração das placas pedidas ao serviço externo que já foram respondidas, por filtro
+        printw("Serviço externo (cobertura, latência média):\n");
+        for (int f = 0; f < filters.size(); f++) {
+            EnrichmentClient::Metrics metrics = enrichment.metrics(f);
+            printw("\t%s: %.1f%%, %.3f segundos\n", filters[f].name, 100.0 * metrics.coverage(),
+                metrics.mean_latency());
+        }
+        printw("\n");
+
+        auto highway_name = [&batch](int highway_index) {
+            return highway_index >= 0 && highway_index < batch.highways.size() ?
+                batch.highways[highway_index].name.c_str() : "-";
+        };
+
+        if (shown.show_riskiest) {
+            printw("Veículos com maior risco no último lote:\n");
+            for (const VehicleView& view : batch.riskiest)
+                printw("\t%s: %.2f (%s)\n", view.plate.plate, view.risk, highway_name(view.highway_index));
+            printw("\n");
+        }
 
-        const char* vehicle_filter_name;
-        switch (info.vehicle_filter) {
-            case VehicleFilter::ALL:
-                vehicle_filter_name = "Todos os veículos";
-                break;
-            case VehicleFilter::COLLISION_RISK:
-                vehicle_filter_name = "Veículos com risco de colisão";
-                break;
-            case VehicleFilter::ABOVE_SPEED_LIMIT:
-                vehicle_filter_name = "Veículos acima do limite de velocidade";
-                break;
+        // Veículo fixado pela busca ou selecionado no filtro, ou nenhum se ele não foi computado no
+        // lote exibido ou o filtro está vazio
+        long size = batch.size(shown.vehicle_filter);
+        int position = clamp_position(shown.absolute_value, size);
+        const VehicleView* view = nullptr;
+        if (shown.pinned) {
+            view = find_view(batch, shown.pinned_id);
+            if (view && view->plate.code() != shown.pinned_code)
+                view = nullptr;
+        } else if (position > 0) {
+            view = &batch.at(shown.vehicle_filter, position - 1);
         }
+        OwnerInfo owner;
+        if (view)
+            owner = owner_of(*view);
 
-        const std::pair<std::string, Vehicle>* data;
-        if (info.num_vehicles[info.vehicle_filter] == 0)
-            data = &default_car;
+        if (shown.pinned)
+            printw("Busca (setas ou filtros voltam ao filtro %s)\n\n", vehicle_filter_name);
         else
-            data = &get_processed(info.vehicle_i)[info.vehicle_j];
-        const Vehicle& v = data->second;
-
-        printw("< %s (%d/%d) >\n\n", vehicle_filter_name, info.absolute_value,
-            info.num_vehicles[info.vehicle_filter]);
+            printw("< %s (%d/%d) >\n\n", vehicle_filter_name, position, static_cast<int>(size));
 
-        printw("Placa: %s\n", data->first.c_str());
+        if (view)
+            printw("Placa: %s\n", view->plate.plate);
+        else if (shown.pinned)
+            printw("Placa: %s (fora do último lote)\n", Plate(shown.pinned_code).plate);
+        else
+            printw("Placa: -------\n");
 
-        if (v.highway_index >= 0) {
-            printw("Rodovia: %s\n", highways[v.highway_index].highway.name().c_str());
+        int highway_index = view ? view->highway_index : -1;
+        if (highway_index >= 0 && highway_index < batch.highways.size()) {
+            printw("Rodovia: %s\n", highway_name(highway_index));
             printw("\tTempo entre simulação e análise: %.6f segundos\n",
-                highways[v.highway_index].time_elapsed);
+                batch.highways[highway_index].time_elapsed);
+            // Agregados das janelas da rodovia, sem percorrer os veículos
+            std::lock_guard<std::mutex> lock(traffic_mutex);
+            if (highway_index < traffic_windows.size()) {
+                printw("\tTráfego (fluxo, densidade, velocidade média, p95 da velocidade):\n");
+                for (int w = 0; w < traffic::num_windows; w++) {
+                    traffic::TrafficStats stats = traffic_windows[highway_index].stats(w);
+                    printw("\t\t%d ciclos: %.2f, %.4f, %.2f, %.2f\n", stats.window, stats.flow, stats.density,
+                        stats.mean_speed, stats.p95_speed);
+                }
+            }
         } else {
             printw("Rodovia: -\n");
             printw("\tTempo entre simulação e análise: -\n");
         }
 
-        printw("\tPosição: (%d, %d)\n", data->second.last_pos.lane, data->second.last_pos.distance);
+        uint32_t lane = view ? view->lane : 0;
+        uint32_t distance = view ? view->distance : 0;
+        float speed = view ? view->speed : -1.0f;
+        float acceleration = view ? view->acceleration : 0.0f;
+        float risk = view ? view->risk : -1.0f;
+        float gap = view ? view->gap : spatial::no_collision;
+        float ttc = view ? view->ttc : spatial::no_collision;
 
-        if (v.speed >= 0)
-            printw("\tVelocidade: %.2f\n", v.speed);
+        printw("\tPosição: (%d, %d)\n", lane, distance);
+
+        if (speed >= 0)
+            printw("\tVelocidade: %.2f\n", speed);
         else
             printw("\tVelocidade: -\n");
 
-        printw("\tAceleração: %.2f\n", v.acceleration);
+        printw("\tAceleração: %.2f\n", acceleration);
 
-        if (v.risk >= 0)
-            printw("\tRisco de colisão: %.2f\n", v.risk);
+        if (risk >= 0)
+            printw("\tRisco de colisão: %.2f\n", risk);
         else
             printw("\tRisco de colisão: -\n");
 
-        if (v.year >= 0) {
-            printw("\tProprietário: %s\n", v.name.c_str());
-            printw("\tModelo: %s\n", v.model.c_str());
-            printw("\tAno de fabricação: %d\n\n", v.year);
+        if (gap != spatial::no_collision)
+            printw("\tDistância ao veículo à frente: %.0f\n", gap);
+        else
+            printw("\tDistância ao veículo à frente: -\n");
+
+        if (ttc != spatial::no_collision)
+            printw("\tTempo até a colisão: %.2f ciclos\n", ttc);
+        else
+            printw("\tTempo até a colisão: -\n");
+
+        if (owner.year >= 0) {
+            printw("\tProprietário: %s\n", owner.name.c_str());
+            printw("\tModelo: %s\n", owner.model.c_str());
+            printw("\tAno de fabricação: %d\n\n", owner.year);
         } else {
             printw("\tProprietário: -\n");
             printw("\tModelo: -\n");
@@ -732,10 +1755,19 @@ class ETL {
         printw("Comandos:\n");
         printw("\t<: anterior\n");
         printw("\t>: próximo\n");
+        printw("\tg: ir para a posição\n");
+        printw("\t/: buscar placa\n");
+        printw("\tk: veículos com maior risco\n");
         printw("\tq: sair\n");
-        printw("\tt: todos os veículos\n");
-        printw("\tr: veículos com risco de colisão\n");
-        printw("\tv: veículos acima do limite de velocidade\n");
+        for (const rules::FilterInfo& filter : filters)
+            printw("\t%c: %s\n", filter.key, filter.name);
+
+        if (shown.input_mode == 'g')
+            printw("\nIr para a posição: %s", shown.input.c_str());
+        else if (shown.input_mode == '/')
+            printw("\nBuscar placa: %s", shown.input.c_str());
+        else if (!shown.message.empty())
+            printw("\n%s", shown.message.c_str());
 
         refresh();
     }
@@ -0,0 +1,228 @@
+#ifndef AGGREGATES_HPP_
+#define AGGREGATES_HPP_
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+/*
+ *  Agregados de tráfego por rodovia em janelas deslizantes de ciclos. Cada ciclo vira um bucket
+ *  com o número de veículos, a soma das velocidades, um histograma de velocidades e a contagem de
+ *  veículos em cada trecho de cada faixa. Os buckets são montados pelo Transform, veículo por
+ *  veículo, em O(1) por atualização; cada janela guarda a soma dos seus buckets, que recebe o
+ *  bucket novo e perde o que saiu dela, então nenhuma consulta percorre os veículos.
+ */
+namespace traffic {
+
+// Janelas, em ciclos recebidos da rodovia
+static const int windows[] = {1, 5, 60};
+static const int num_windows = sizeof(windows) / sizeof(windows[0]);
+static const int max_window = 60;
+// Trechos em que cada faixa é dividida na densidade
+static const int segments = 10;
+
+/// Histograma log-linear de velocidades: 16 faixas por potência de 2, então cada quantil tem erro
+/// relativo de no máximo 1/32. Histogramas podem ser somados e subtraídos, o que permite tirar um
+/// ciclo de uma janela sem guardar as velocidades.
+class SpeedSketch {
+    static const int sub_bits = 4;
+    static const int min_exponent = -4;
+    static const int max_exponent = 16;
+    // Um bin para zero (e valores menores que 2^min_exponent), os de [2^min, 2^max) e um para
+    // os valores acima
+    static const int num_bins = 2 + ((max_exponent - min_exponent) << sub_bits);
+
+    std::array<uint32_t, num_bins> counts{};
+    uint64_t total_ = 0;
+
+    static int bin_of(float value) {
+        if (!(value >= std::ldexp(1.0f, min_exponent)))
+            return 0;
+        uint32_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        int exponent = static_cast<int>(bits >> 23) - 127;
+        if (exponent >= max_exponent)
+            return num_bins - 1;
+        int sub = (bits >> (23 - sub_bits)) & ((1 << sub_bits) - 1);
+        return 1 + ((exponent - min_exponent) << sub_bits) + sub;
+    }
+
+    /// Ponto médio do bin.
+    static float value_of(int bin) {
+        if (bin == 0)
+            return 0.0f;
+        int exponent = ((bin - 1) >> sub_bits) + min_exponent;
+        int sub = (bin - 1) & ((1 << sub_bits) - 1);
+        return std::ldexp(1.0f + (sub + 0.5f) / (1 << sub_bits), exponent);
+    }
+
+ public:
+    void add(float value) {
+        counts[bin_of(value)]++;
+        total_++;
+    }
+
+    /// Soma (sign = 1) ou subtrai (sign = -1) outro histograma.
+    void merge(const SpeedSketch& other, int sign = 1) {
+        for (int b = 0; b < num_bins; b++)
+            counts[b] += sign * other.counts[b];
+        total_ += sign * static_cast<int64_t>(other.total_);
+    }
+
+    void clear() {
+        counts.fill(0);
+        total_ = 0;
+    }
+
+    uint64_t total() const {
+        return total_;
+    }
+
+    /// Quantil q em [0, 1], ou -1 sem nenhum valor.
+    float quantile(double q) const {
+        if (total_ == 0)
+            return -1.0f;
+        uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(q * total_)));
+        uint64_t seen = 0;
+        for (int b = 0; b < num_bins; b++) {
+            seen += counts[b];
+            if (seen >= rank)
+                return value_of(b);
+        }
+        return value_of(num_bins - 1);
+    }
+};
+
+/// Dados de um ciclo de uma rodovia, ou a soma dos ciclos de uma janela.
+struct CycleBucket {
+    // Indica se o bucket já foi zerado no lote atual (usado pelos dados de cada worker)
+    bool used = false;
+    uint32_t vehicles = 0;
+    // Veículos com velocidade conhecida e a soma delas
+    uint32_t moving = 0;
+    double speed_sum = 0.0;
+    SpeedSketch speeds;
+    // Veículos em cada trecho de cada faixa, `segments` por faixa
+    std::vector<uint32_t> lane_segments;
+    uint32_t segment_size = 1;
+
+    /// Zera o bucket para uma rodovia com `lanes` faixas (somando as duas direções) e o tamanho dado.
+    void reset(uint32_t lanes, uint32_t size) {
+        used = true;
+        vehicles = 0;
+        moving = 0;
+        speed_sum = 0.0;
+        speeds.clear();
+        lane_segments.assign(lanes * segments, 0);
+        segment_size = std::max<uint32_t>(1, (size + segments - 1) / segments);
+    }
+
+    /// Conta um veículo na posição dada. Velocidades negativas indicam que ela ainda não é conhecida.
+    void add(uint32_t lane, uint32_t distance, float speed) {
+        vehicles++;
+        uint32_t segment = std::min<uint32_t>(distance / segment_size, segments - 1);
+        size_t index = size_t(lane) * segments + segment;
+        if (index < lane_segments.size())
+            lane_segments[index]++;
+        if (speed >= 0.0f) {
+            moving++;
+            speed_sum += speed;
+            speeds.add(speed);
+        }
+    }
+
+    void merge(const CycleBucket& other, int sign = 1) {
+        vehicles += sign * static_cast<int64_t>(other.vehicles);
+        moving += sign * static_cast<int64_t>(other.moving);
+        speed_sum += sign * other.speed_sum;
+        speeds.merge(other.speeds, sign);
+        if (lane_segments.size() < other.lane_segments.size())
+            lane_segments.resize(other.lane_segments.size(), 0);
+        for (size_t s = 0; s < other.lane_segments.size(); s++)
+            lane_segments[s] += sign * other.lane_segments[s];
+    }
+};
+
+/// Agregados de uma janela. Fluxo e densidade são médias por ciclo da janela.
+struct TrafficStats {
+    int window = 0;
+    // Ciclos de fato na janela, menos que `window` no início da rodovia
+    int cycles = 0;
+    // Veículos que passam por um ponto da rodovia por ciclo (densidade vezes velocidade média)
+    double flow = 0.0;
+    // Veículos por unidade de distância, somando as faixas
+    double density = 0.0;
+    double mean_speed = -1.0;
+    double p95_speed = -1.0;
+    // Veículos por unidade de distância em cada trecho de cada faixa, `segments` por faixa
+    std::vector<double> lane_density;
+};
+
+/// Janelas de uma rodovia.
+class HighwayWindows {
+    uint32_t lanes = 0;
+    uint32_t size = 1;
+    // Últimos `max_window` ciclos, o mais recente em (pushed - 1) % max_window
+    std::vector<CycleBucket> history;
+    CycleBucket totals[num_windows];
+    uint64_t pushed = 0;
+
+ public:
+    /// @param lanes Faixas da rodovia, somando as duas direções.
+    void reset(uint32_t lanes, uint32_t size) {
+        this->lanes = lanes;
+        this->size = std::max<uint32_t>(1, size);
+        history.assign(max_window, CycleBucket());
+        for (CycleBucket& bucket : history)
+            bucket.reset(lanes, size);
+        for (CycleBucket& total : totals)
+            total.reset(lanes, size);
+        pushed = 0;
+    }
+
+    /// Adiciona o próximo ciclo da rodovia, em O(bins + trechos), independentemente do número
+    /// de veículos.
+    void push(const CycleBucket& bucket) {
+        if (history.empty())
+            return;
+        for (int w = 0; w < num_windows; w++) {
+            // O ciclo que sai da janela ainda está no histórico, pois a maior janela é o histórico
+            if (pushed >= static_cast<uint64_t>(windows[w]))
+                totals[w].merge(history[(pushed - windows[w]) % max_window], -1);
+            totals[w].merge(bucket);
+        }
+        CycleBucket& slot = history[pushed % max_window];
+        slot.reset(lanes, size);
+        slot.merge(bucket);
+        pushed++;
+    }
+
+    /// Agregados da `w`-ésima janela de `windows`.
+    TrafficStats stats(int w) const {
+        TrafficStats result;
+        result.window = windows[w];
+        result.cycles = static_cast<int>(std::min<uint64_t>(pushed, windows[w]));
+        if (result.cycles == 0 || lanes == 0)
+            return result;
+        const CycleBucket& total = totals[w];
+        double cycles = result.cycles;
+        result.density = total.vehicles / (cycles * size);
+        if (total.moving > 0) {
+            result.mean_speed = total.speed_sum / total.moving;
+            result.p95_speed = total.speeds.quantile(0.95);
+            result.flow = result.density * result.mean_speed;
+        }
+        double segment_length = static_cast<double>(total.segment_size);
+        result.lane_density.resize(total.lane_segments.size());
+        for (size_t s = 0; s < total.lane_segments.size(); s++)
+            result.lane_density[s] = total.lane_segments[s] / (cycles * segment_length);
+        return result;
+    }
+};
+
+}  // namespace traffic
+
+#endif  // AGGREGATES_HPP_
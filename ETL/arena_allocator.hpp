@@ -0,0 +1,72 @@
+#ifndef ARENA_ALLOCATOR_HPP_
+#define ARENA_ALLOCATOR_HPP_
+
+#include <google/protobuf/arena.h>
+#include <grpcpp/support/message_allocator.h>
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+
+/// Cria arenas do protobuf dimensionadas pela mensagem anterior. Com o tamanho do primeiro
+/// bloco próximo do tamanho da mensagem, ela é lida com uma ou duas alocações, em vez de uma
+/// por campo, e liberada de uma vez quando a arena é destruída.
+class ArenaFactory {
+    static const size_t min_block_size = 4096;
+    static const size_t max_block_size = 1 << 20;
+
+    std::atomic<size_t> block_hint{min_block_size};
+
+ public:
+    std::shared_ptr<google::protobuf::Arena> create() {
+        google::protobuf::ArenaOptions options;
+        options.start_block_size = block_hint.load(std::memory_order_relaxed);
+        options.max_block_size = max_block_size;
+        return std::make_shared<google::protobuf::Arena>(options);
+    }
+
+    /// Usa o espaço ocupado por uma arena já preenchida como tamanho do primeiro bloco das próximas.
+    void learn(const google::protobuf::Arena& arena) {
+        size_t used = arena.SpaceUsed();
+        block_hint.store(std::clamp<size_t>(used, min_block_size, max_block_size), std::memory_order_relaxed);
+    }
+};
+
+/// Alocador das mensagens de um método unário da API de callbacks do gRPC. Cada chamada tem a
+/// própria arena, e o handler pode obter uma referência a ela com `retain` para continuar usando
+/// a requisição depois que a chamada terminar, sem copiá-la.
+template<typename Request, typename Response>
+class ArenaAllocator final : public grpc::MessageAllocator<Request, Response> {
+    class Holder final : public grpc::MessageHolder<Request, Response> {
+        ArenaFactory& factory;
+
+     public:
+        std::shared_ptr<google::protobuf::Arena> arena;
+
+        Holder(ArenaFactory& factory, std::shared_ptr<google::protobuf::Arena> arena) :
+                factory(factory), arena(std::move(arena)) {
+            this->set_request(google::protobuf::Arena::CreateMessage<Request>(this->arena.get()));
+            this->set_response(google::protobuf::Arena::CreateMessage<Response>(this->arena.get()));
+        }
+
+        /// Chamada pelo gRPC no fim da chamada. A arena só é destruída se ninguém a reteve.
+        void Release() override {
+            factory.learn(*arena);
+            delete this;
+        }
+    };
+
+    ArenaFactory factory;
+
+ public:
+    grpc::MessageHolder<Request, Response>* AllocateMessages() override {
+        return new Holder(factory, factory.create());
+    }
+
+    /// Retorna a arena das mensagens da chamada do contexto, que deve usar este alocador.
+    static std::shared_ptr<google::protobuf::Arena> retain(grpc::CallbackServerContext* context) {
+        return static_cast<Holder*>(context->GetRpcAllocatorState())->arena;
+    }
+};
+
+#endif  // ARENA_ALLOCATOR_HPP_
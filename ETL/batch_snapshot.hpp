@@ -0,0 +1,95 @@
+#ifndef BATCH_SNAPSHOT_HPP_
+#define BATCH_SNAPSHOT_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "./conversions.hpp"
+#include "./navigation.hpp"
+#include "./rules.hpp"
+
+/*
+ *  Dados de um lote publicados pelo ETL (veja snapshot.hpp), lidos pelo dashboard e pelo serviço
+ *  de consultas. Uma versão publicada nunca é modificada.
+ */
+
+/// Dados de um veículo computado em um lote, copiados pelo Transform.
+struct VehicleView {
+    uint32_t id;
+    Plate plate;
+    int highway_index;
+    uint32_t lane;
+    uint32_t distance;
+    float speed;
+    float acceleration;
+    float risk;
+    // Distância ao veículo à frente e menor tempo até a colisão, infinitos se não houver
+    float gap;
+    float ttc;
+    uint8_t flags;
+};
+
+/// Onde um veículo está em `BatchSnapshot::vehicles`.
+struct ViewSlot {
+    // Lote em que a posição foi escrita: as versões reaproveitadas guardam as de lotes antigos
+    uint32_t batch = 0;
+    uint32_t worker = 0;
+    uint32_t position = 0;
+};
+
+struct HighwayView {
+    std::string name;
+    double time_elapsed;
+};
+
+/// Resultado de um lote, publicado no fim dele e nunca modificado depois. As informações do
+/// serviço externo chegam depois do lote e ficam fora dele: são aplicadas veículo a veículo pelo
+/// ETL e lidas pelo id.
+struct BatchSnapshot {
+    uint32_t batch = 0;
+    // Veículos computados no lote, uma lista por worker
+    navigation::SegmentedIndex<VehicleView> vehicles;
+    // Posição em `vehicles.part(worker)` dos veículos de cada filtro, uma lista por worker
+    navigation::SegmentedIndex<uint32_t> filtered[rules::max_filters];
+    // Posição de cada veículo, indexada pelo id. Só valem as entradas com o número deste lote
+    std::vector<ViewSlot> slots;
+    std::vector<VehicleView> riskiest;
+    // Indexadas como os `highway_index` dos veículos
+    std::vector<HighwayView> highways;
+    // Veículos no registro em cada filtro
+    int registered[rules::max_filters] = {};
+    // Veículos removidos do registro no fim do lote, cujos ids podem ser reaproveitados no próximo
+    std::vector<uint32_t> evicted;
+    // Ciclos descartados pela política de sobrecarga até o fim do lote
+    uint64_t dropped_cycles = 0;
+
+    size_t size(int filter) const {
+        return filtered[filter].size();
+    }
+
+    /// Escreve em `slots` a posição dos veículos da lista do worker. As listas de workers
+    /// diferentes podem ser indexadas em paralelo, depois de `slots` cobrir todos os ids.
+    void index_part(size_t worker) {
+        const std::vector<VehicleView>& views = vehicles.part(worker);
+        for (uint32_t k = 0; k < views.size(); k++)
+            slots[views[k].id] = {batch, static_cast<uint32_t>(worker), k};
+    }
+
+    /// Dados do veículo com o id, ou nullptr se ele não foi computado no lote, em O(1).
+    const VehicleView* find(uint32_t id) const {
+        if (id >= slots.size() || slots[id].batch != batch)
+            return nullptr;
+        const ViewSlot& slot = slots[id];
+        return &vehicles.part(slot.worker)[slot.position];
+    }
+
+    /// N-ésimo veículo do filtro, começando em 0, em O(log workers).
+    const VehicleView& at(int filter, size_t n) const {
+        auto [worker, k] = filtered[filter].locate(n);
+        return vehicles.part(worker)[filtered[filter].part(worker)[k]];
+    }
+};
+
+#endif  // BATCH_SNAPSHOT_HPP_
@@ -0,0 +1,55 @@
+#ifndef CHUNKED_ARRAY_HPP_
+#define CHUNKED_ARRAY_HPP_
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+
+/// Vetor indexado por ids densos, alocado em blocos contíguos de tamanho fixo. Os blocos nunca
+/// são movidos, então as threads podem ler e escrever posições já alocadas enquanto outras
+/// alocam novos blocos, sem a realocação que um `std::vector` faria ao crescer.
+template<typename T, int chunk_bits = 12>
+class ChunkedArray {
+    static const uint32_t chunk_size = 1u << chunk_bits;
+    static const uint32_t chunk_mask = chunk_size - 1;
+    // Limita o vetor a 2^28 elementos, mantendo a tabela de blocos pequena
+    static const uint32_t max_chunks = 1u << (28 - chunk_bits);
+
+    std::unique_ptr<std::atomic<T*>[]> chunks;
+    std::mutex mutex;
+
+ public:
+    ChunkedArray() : chunks(new std::atomic<T*>[max_chunks]) {
+        for (uint32_t i = 0; i < max_chunks; i++)
+            chunks[i].store(nullptr, std::memory_order_relaxed);
+    }
+
+    ~ChunkedArray() {
+        for (uint32_t i = 0; i < max_chunks; i++)
+            delete[] chunks[i].load(std::memory_order_relaxed);
+    }
+
+    ChunkedArray(const ChunkedArray&) = delete;
+    ChunkedArray& operator=(const ChunkedArray&) = delete;
+
+    /// Garante que a posição `i` exista. Deve ser chamada antes de o id ser publicado.
+    void ensure(uint32_t i) {
+        std::atomic<T*>& chunk = chunks[i >> chunk_bits];
+        if (chunk.load(std::memory_order_acquire))
+            return;
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!chunk.load(std::memory_order_relaxed))
+            chunk.store(new T[chunk_size](), std::memory_order_release);
+    }
+
+    T& operator[](uint32_t i) {
+        return chunks[i >> chunk_bits].load(std::memory_order_relaxed)[i & chunk_mask];
+    }
+
+    const T& operator[](uint32_t i) const {
+        return chunks[i >> chunk_bits].load(std::memory_order_relaxed)[i & chunk_mask];
+    }
+};
+
+#endif  // CHUNKED_ARRAY_HPP_
@@ -1,6 +1,16 @@
 #ifndef CONVERSIONS_HPP_
 #define CONVERSIONS_HPP_
 
+#if defined(__AVX2__) || defined(__BMI2__)
+#include <immintrin.h>
+#elif defined(__SSE4_1__)
+#include <smmintrin.h>
+#endif
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
 #include <iostream>
 
 // Observação: sim, eu sei que existem funções que fazem isso e fiz o benchmark,
@@ -17,7 +27,7 @@
 inline int str_to_int(const char* str, int& index, char end) {
     int result = 0;
     bool negative = false;
-    if (str[0] == '-') {
+    if (str[index] == '-') {
         negative = true;
         index++;
     }
@@ -29,6 +39,12 @@ inline int str_to_int(const char* str, int& index, char end) {
     return negative ? -result : result;
 }
 
+// Potências de 10 representáveis exatamente em um double, para dividir a parte fracionária
+// uma única vez em vez de uma divisão por dígito
+inline constexpr double powers_of_ten[] = {1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,
+                                           1e8,  1e9,  1e10, 1e11, 1e12, 1e13, 1e14, 1e15,
+                                           1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+
 /**
  *  @brief Retorna a representação em float de uma string.
  *
@@ -38,9 +54,9 @@ inline int str_to_int(const char* str, int& index, char end) {
  *  @return O double representado pela string.
  */
 inline double str_to_double(const char* str, int& index, char end) {
-    int integer = 0;
+    uint64_t integer = 0;
     bool negative = false;
-    if (str[0] == '-') {
+    if (str[index] == '-') {
         negative = true;
         index++;
     }
@@ -49,22 +65,345 @@ inline double str_to_double(const char* str, int& index, char end) {
         integer += str[index] - '0';
     }
     double result = integer;
-    if (str[index] == end) {
-        index++;
-        return result;
+    if (str[index] == '.') {
+        // Só os 19 primeiros dígitos entram: 19 dígitos sempre cabem em 64 bits, e os seguintes já
+        // estão abaixo da precisão do double
+        uint64_t fraction = 0;
+        int digits = 0;
+        for (++index; str[index] != end; index++) {
+            if (digits < 19) {
+                fraction = fraction * 10 + (str[index] - '0');
+                digits++;
+            }
+        }
+        result += fraction / powers_of_ten[digits];
     }
+    index++;
+    return negative ? -result : result;
+}
+
+/// Conversão de campos numéricos de tamanho conhecido, 8 ou 16 dígitos por vez: SWAR (oito
+/// dígitos em um inteiro de 64 bits) e SSE4.1 quando o compilador permite. Campos com menos de
+/// 8 dígitos usam os mesmos kernels lendo os 8 bytes que terminam no campo, quando o chamador
+/// garante que eles existem, e um laço simples caso contrário.
+namespace digits {
 
-    int divisor = 1;
-    for (++index; str[index] != end; index++) {
-        divisor *= 10;
-        if (str[index] == '0')
+inline constexpr uint64_t small_powers[] = {1, 10, 100, 1000, 10000, 100000, 1000000, 10000000};
+
+/// Lê 8 bytes como um inteiro, com o primeiro byte nos bits menos significativos.
+inline uint64_t load_eight(const char* chars) {
+    uint64_t chunk;
+    std::memcpy(&chunk, chars, sizeof(chunk));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    chunk = __builtin_bswap64(chunk);
+#endif
+    return chunk;
+}
+
+/// Se os 8 bytes são todos dígitos ASCII.
+inline bool is_eight_digits(uint64_t chunk) {
+    return ((chunk & 0xF0F0F0F0F0F0F0F0) | (((chunk + 0x0606060606060606) & 0xF0F0F0F0F0F0F0F0) >> 4)) ==
+           0x3333333333333333;
+}
+
+/// Converte 8 dígitos ASCII com três multiplicações: junta pares de dígitos, depois pares de
+/// pares, e por fim as duas metades.
+inline uint32_t parse_eight(uint64_t chunk) {
+    const uint64_t mask = 0x000000FF000000FF;
+    const uint64_t mul1 = 100 + (1000000ULL << 32);
+    const uint64_t mul2 = 1 + (10000ULL << 32);
+    chunk -= 0x3030303030303030;
+    chunk = (chunk * 10) + (chunk >> 8);
+    chunk = (((chunk & mask) * mul1) + (((chunk >> 16) & mask) * mul2)) >> 32;
+    return static_cast<uint32_t>(chunk);
+}
+
+/// Converte 16 dígitos ASCII a partir de `chars`, sem verificar se são dígitos.
+inline uint64_t parse_sixteen(const char* chars) {
+#if defined(__SSE4_1__)
+    const __m128i ascii_zero = _mm_set1_epi8('0');
+    const __m128i mul_1_10 = _mm_setr_epi8(10, 1, 10, 1, 10, 1, 10, 1, 10, 1, 10, 1, 10, 1, 10, 1);
+    const __m128i mul_1_100 = _mm_setr_epi16(100, 1, 100, 1, 100, 1, 100, 1);
+    const __m128i mul_1_10000 = _mm_setr_epi16(10000, 1, 10000, 1, 10000, 1, 10000, 1);
+    __m128i input = _mm_sub_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(chars)), ascii_zero);
+    // Pares de dígitos em 16 bits, depois grupos de 4 em 32 bits e de 8 em 32 bits
+    __m128i pairs = _mm_maddubs_epi16(input, mul_1_10);
+    __m128i quads = _mm_madd_epi16(pairs, mul_1_100);
+    __m128i packed = _mm_packus_epi32(quads, quads);
+    __m128i eights = _mm_madd_epi16(packed, mul_1_10000);
+    uint64_t high = static_cast<uint32_t>(_mm_cvtsi128_si32(eights));
+    uint64_t low = static_cast<uint32_t>(_mm_extract_epi32(eights, 1));
+    return high * 100000000 + low;
+#else
+    return uint64_t(parse_eight(load_eight(chars))) * 100000000 + parse_eight(load_eight(chars + 8));
+#endif
+}
+
+/// Converte os dígitos de [begin, end) um por vez, retornando falso se algum não for um dígito.
+inline bool parse_scalar(const char* begin, const char* end, uint64_t& value) {
+    uint64_t result = 0;
+    bool valid = begin < end;
+    for (; begin < end; begin++) {
+        uint64_t digit = static_cast<unsigned char>(*begin) - '0';
+        valid &= digit <= 9;
+        result = result * 10 + digit;
+    }
+    value = result;
+    return valid;
+}
+
+/**
+ *  @brief Converte um campo de até 8 dígitos em [end - size, end), lendo os 8 bytes que
+ *         terminam em `end`. Os bytes antes do campo são trocados por '0' na própria máscara.
+ *
+ *  @param end Fim do campo. Os 8 bytes anteriores devem poder ser lidos.
+ *  @param size Tamanho do campo, de 1 a 8.
+ *  @return Falso se algum caractere do campo não for um dígito.
+ */
+inline bool parse_tail(const char* end, size_t size, uint32_t& value) {
+    uint64_t chunk = load_eight(end - 8);
+    uint64_t padding = (uint64_t(1) << (8 * (8 - size))) - 1;
+    chunk = (chunk & ~padding) | (0x3030303030303030 & padding);
+    value = parse_eight(chunk);
+    return is_eight_digits(chunk);
+}
+
+/**
+ *  @brief Converte os dígitos de [begin, end), de 16 em 16 e de 8 em 8. O restante de um campo
+ *         com 8 dígitos ou mais é lido com `parse_tail`, sobre dígitos já conferidos; campos
+ *         menores são convertidos um dígito por vez. Campos com mais de 19 dígitos transbordam.
+ *
+ *  @return Falso se o campo for vazio ou algum caractere não for um dígito.
+ */
+inline bool parse(const char* begin, const char* end, uint64_t& value) {
+    if (end - begin < 8)
+        return parse_scalar(begin, end, value);
+    uint64_t result = 0;
+    bool valid = true;
+    for (; end - begin >= 16; begin += 16) {
+        valid &= is_eight_digits(load_eight(begin)) & is_eight_digits(load_eight(begin + 8));
+        result = result * 10000000000000000 + parse_sixteen(begin);
+    }
+    if (end - begin >= 8) {
+        uint64_t chunk = load_eight(begin);
+        valid &= is_eight_digits(chunk);
+        result = result * 100000000 + parse_eight(chunk);
+        begin += 8;
+    }
+    if (begin < end) {
+        uint32_t rest;
+        valid &= parse_tail(end, end - begin, rest);
+        result = result * small_powers[end - begin] + rest;
+    }
+    value = result;
+    return valid;
+}
+
+/**
+ *  @brief Converte um número decimal em [begin, end), com sinal e parte fracionária opcionais,
+ *         usando `parse` para as duas partes. Só os primeiros 19 dígitos da fração são usados.
+ *
+ *  @return Falso se o campo não for um número.
+ */
+inline bool parse_decimal(const char* begin, const char* end, double& value) {
+    const char* start = begin;
+    bool negative = begin < end && *begin == '-';
+    begin += negative;
+    const char* point = begin;
+    while (point < end && *point != '.')
+        point++;
+    uint64_t integer, fraction = 0;
+    bool valid = parse(begin, point, integer);
+    double result = integer;
+    if (point + 1 < end) {
+        const char* fraction_end = end - point - 1 > 19 ? point + 20 : end;
+        // Uma fração curta depois de uma parte inteira longa também é lida de uma vez
+        if (fraction_end - point - 1 <= 8 && fraction_end - start >= 8) {
+            uint32_t short_fraction;
+            valid &= parse_tail(fraction_end, fraction_end - point - 1, short_fraction);
+            fraction = short_fraction;
+        } else {
+            valid &= parse(point + 1, fraction_end, fraction);
+        }
+        uint64_t ignored;
+        if (fraction_end < end)
+            valid &= parse(fraction_end, end, ignored);
+        result += fraction / powers_of_ten[fraction_end - point - 1];
+    }
+    value = negative ? -result : result;
+    return valid;
+}
+
+}  // namespace digits
+
+/// Código inteiro das placas: cada um dos 7 símbolos ocupa 6 bits, então a placa inteira cabe em
+/// 42 bits e pode ser usada como chave sem comparar strings. O alfabeto tem exatamente 64 símbolos:
+/// o '\0' das placas curtas, dígitos, letras maiúsculas e minúsculas e o '-' da placa vazia do
+/// dashboard. Placas com outros caracteres guardam os 7 bytes originais com o bit 63 ligado, então
+/// a conversão é sempre reversível e nunca confunde duas placas.
+namespace plate_code {
+
+static const int symbols = 7;
+static const int bits_per_symbol = 6;
+static const uint64_t raw_flag = uint64_t(1) << 63;
+
+inline constexpr char alphabet[65] =
+    "\0" "0123456789" "ABCDEFGHIJKLMNOPQRSTUVWXYZ" "abcdefghijklmnopqrstuvwxyz" "-";
+
+/// Converte os 7 primeiros bytes de `word` (o primeiro nos bits baixos) em um código, sem desvios
+/// por caractere: as classes de cada byte (dígito, maiúscula, minúscula, '-' e '\0') são
+/// calculadas nos 8 bytes ao mesmo tempo (SWAR). Um '\0' termina a placa, como em `Plate`.
+inline uint64_t encode_word(uint64_t word) {
+    const uint64_t ones = 0x0101010101010101;
+    const uint64_t high = 0x8080808080808080;
+    const uint64_t low = 0x7F7F7F7F7F7F7F7F;
+    const uint64_t plate_bytes = 0x0080808080808080;
+    auto zero_bytes = [=](uint64_t x) {
+        return ~(((x & low) + low) | x | low);
+    };
+    // Bytes de 7 bits entre `first` e `last`, com o bit alto de cada byte
+    auto in_range = [=](uint64_t x, uint8_t first, uint8_t last) {
+        return (x + ones * (0x80 - first)) & ~(x + ones * (0x7F - last)) & high;
+    };
+    auto expand = [](uint64_t bits) {
+        return (bits >> 7) * 0xFF;
+    };
+
+    word &= 0x00FFFFFFFFFFFFFF;
+    // Descarta tudo depois do primeiro '\0'
+    uint64_t zeros = zero_bytes(word) & plate_bytes;
+    if (zeros)
+        word &= ((zeros & -zeros) >> 7) - 1;
+    uint64_t ascii = word & low;
+    uint64_t ascii_bytes = ~word & high;
+    uint64_t digit = in_range(ascii, '0', '9') & ascii_bytes;
+    uint64_t upper = in_range(ascii, 'A', 'Z') & ascii_bytes;
+    uint64_t lower = in_range(ascii, 'a', 'z') & ascii_bytes;
+    uint64_t dash = zero_bytes(word ^ (ones * '-'));
+    uint64_t valid = (digit | upper | lower | dash | zero_bytes(word)) & plate_bytes;
+    if (valid != plate_bytes)
+        return word | raw_flag;
+
+    // Cada byte pertence a uma única classe e é maior que a distância subtraída, então não há
+    // empréstimo entre bytes
+    uint64_t symbol = word - (expand(digit) & ones * ('0' - 1)) - (expand(upper) & ones * ('A' - 11)) -
+                      (expand(lower) & ones * ('a' - 37)) + (expand(dash) & ones * (63 - '-'));
+#if defined(__BMI2__)
+    return _pext_u64(symbol, 0x003F3F3F3F3F3F3F);
+#else
+    symbol = (symbol & 0x00FF00FF00FF00FF) | ((symbol >> 8) & 0x00FF00FF00FF00FF) << 6;
+    symbol = (symbol & 0x0000FFFF0000FFFF) | ((symbol >> 16) & 0x0000FFFF0000FFFF) << 12;
+    return (symbol & 0xFFFFFFFF) | (symbol >> 32) << 24;
+#endif
+}
+
+/// Converte os primeiros `size` caracteres (no máximo 7) da placa em seu código.
+inline uint64_t encode(const char* plate, size_t size) {
+    uint64_t word = 0;
+    if (size >= 8) {
+        word = digits::load_eight(plate);
+    } else if (size == 7) {
+        // Duas leituras de 4 bytes sobrepostas, sem ler além da placa
+        uint32_t first, last;
+        std::memcpy(&first, plate, sizeof(first));
+        std::memcpy(&last, plate + 3, sizeof(last));
+        word = first | uint64_t(last) << 24;
+    } else {
+        std::memcpy(&word, plate, size);
+    }
+    return encode_word(word);
+}
+
+/// Escreve os 7 símbolos do código em `plate`, seguidos de '\0'.
+inline void decode(uint64_t code, char plate[8]) {
+    if (code & raw_flag) {
+        uint64_t raw = code & ~raw_flag;
+        std::memcpy(plate, &raw, symbols);
+    } else {
+        for (int i = 0; i < symbols; i++)
+            plate[i] = alphabet[(code >> (bits_per_symbol * i)) & 63];
+    }
+    plate[symbols] = '\0';
+}
+
+/// Finalizador do MurmurHash3 (fmix64): cada bit da entrada muda cada bit da saída com
+/// probabilidade próxima de 1/2, então os bits baixos podem escolher buckets e shards.
+inline uint64_t mix(uint64_t key) {
+    key ^= key >> 33;
+    key *= 0xFF51AFD7ED558CCD;
+    key ^= key >> 33;
+    key *= 0xC4CEB9FE1A85EC53;
+    key ^= key >> 33;
+    return key;
+}
+
+/// Hash dos códigos para tabelas da biblioteca padrão, cujo hash de inteiros é a identidade.
+struct Hash {
+    size_t operator()(uint64_t code) const noexcept {
+        return mix(code);
+    }
+};
+
+/**
+ *  @brief Converte `count` placas de 8 bytes, separadas por `stride` bytes, como as dos registros
+ *         de memória compartilhada. Com AVX2, converte 4 placas por vez; as que têm caracteres
+ *         fora do alfabeto, ou algo depois de um '\0', são convertidas por `encode`.
+ */
+inline void encode_batch(const char* plates, size_t stride, size_t count, uint64_t* codes) {
+    size_t i = 0;
+#if defined(__AVX2__)
+    const __m256i bytes_mask = _mm256_set1_epi64x(0x00FFFFFFFFFFFFFF);
+    auto in_range = [](__m256i c, char low, char high) {
+        return _mm256_and_si256(_mm256_cmpgt_epi8(c, _mm256_set1_epi8(low - 1)),
+                                _mm256_cmpgt_epi8(_mm256_set1_epi8(high + 1), c));
+    };
+    for (; i + 4 <= count; i += 4) {
+        // Montado a partir de quatro leituras de 64 bits; um vetor intermediário na pilha
+        // custaria uma falha de encaminhamento de store para load a cada lote
+        const char* base = plates + i * stride;
+        __m256i words = _mm256_set_epi64x(digits::load_eight(base + 3 * stride), digits::load_eight(base + 2 * stride),
+                                          digits::load_eight(base + stride), digits::load_eight(base));
+        __m256i c = _mm256_and_si256(words, bytes_mask);
+        __m256i digit = in_range(c, '0', '9');
+        __m256i upper = in_range(c, 'A', 'Z');
+        __m256i lower = in_range(c, 'a', 'z');
+        __m256i dash = _mm256_cmpeq_epi8(c, _mm256_set1_epi8('-'));
+        __m256i zero = _mm256_cmpeq_epi8(c, _mm256_setzero_si256());
+        // Subtrai de cada byte a distância entre o caractere e o seu símbolo
+        __m256i offset = _mm256_or_si256(
+            _mm256_or_si256(_mm256_and_si256(digit, _mm256_set1_epi8('0' - 1)),
+                            _mm256_and_si256(upper, _mm256_set1_epi8('A' - 11))),
+            _mm256_or_si256(_mm256_and_si256(lower, _mm256_set1_epi8('a' - 37)),
+                            _mm256_and_si256(dash, _mm256_set1_epi8('-' - 63))));
+        __m256i symbol = _mm256_sub_epi8(c, offset);
+        // Junta os símbolos em pares (12 bits), depois em grupos de 4 (24 bits) e por fim os 7
+        __m256i pairs = _mm256_maddubs_epi16(symbol, _mm256_set1_epi16(0x4001));
+        __m256i quads = _mm256_madd_epi16(pairs, _mm256_set1_epi32(0x10000001));
+        __m256i packed = _mm256_or_si256(_mm256_and_si256(quads, _mm256_set1_epi64x(0xFFFFFFFF)),
+                                         _mm256_slli_epi64(_mm256_srli_epi64(quads, 32), 24));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(codes + i), packed);
+
+        // Uma placa curta tem '\0' no fim, que também é um símbolo. Placas com caracteres fora do
+        // alfabeto ou com bytes depois do primeiro '\0' ficam com `encode`
+        __m256i valid = _mm256_or_si256(_mm256_or_si256(digit, upper), _mm256_or_si256(_mm256_or_si256(lower, dash), zero));
+        uint32_t valid_bytes = _mm256_movemask_epi8(valid);
+        uint32_t zero_bytes = _mm256_movemask_epi8(zero);
+        if ((valid_bytes | 0x80808080) == 0xFFFFFFFF && (zero_bytes & 0x7F7F7F7F) == 0)
             continue;
-        result += static_cast<double>(str[index] - '0') / divisor;
+        for (int k = 0; k < 4; k++) {
+            uint32_t valid_plate = (valid_bytes >> (8 * k)) & 0x7F;
+            uint32_t zeros = (zero_bytes >> (8 * k)) & 0x7F;
+            if (valid_plate != 0x7F || (zeros != 0 && zeros + (zeros & -zeros) != 0x80))
+                codes[i + k] = encode(plates + (i + k) * stride, symbols);
+        }
     }
-    index++;
-    return negative ? -result : result;
+#endif
+    for (; i < count; i++)
+        codes[i] = encode(plates + i * stride, symbols);
 }
 
+}  // namespace plate_code
+
 // Uma placa tem 7 caracteres, mas o compilador usaria 8 de qualquer jeito, então
 // é mais fácil alocar 8 bytes e usar o último para o '\0', assim o cout funciona
 struct Plate {
@@ -81,6 +420,21 @@ struct Plate {
         plate[7] = '\0';
     }
 
+    // Usado com strings que não têm tamanho garantido, como as recebidas por RPC
+    Plate(const char* const symbols, size_t size) {
+        for (size_t i = 0; i < 8; i++)
+            plate[i] = i < size && i < 7 ? symbols[i] : '\0';
+    }
+
+    explicit Plate(uint64_t code) {
+        plate_code::decode(code, plate);
+    }
+
+    /// Código de 42 bits da placa, usado como chave de registros e caches.
+    uint64_t code() const {
+        return plate_code::encode(plate, plate_code::symbols);
+    }
+
     bool operator==(const Plate& other) const {
         for (int i = 0; i < 7; i++) {
             if (plate[i] != other.plate[i])
@@ -106,11 +460,11 @@ struct Plate {
 template<>
 struct std::hash<Plate> {
     size_t operator()(const Plate& plate) const noexcept {
-        return *reinterpret_cast<const size_t*>(plate.plate);
+        return plate_code::mix(plate.code());
     }
 };
 
-std::ostream &operator<<(std::ostream &os, const Plate &plate) {
+inline std::ostream &operator<<(std::ostream &os, const Plate &plate) {
     os << plate.plate;
     return os;
 }
@@ -0,0 +1,275 @@
+#ifndef CYCLE_FILE_HPP_
+#define CYCLE_FILE_HPP_
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "./conversions.hpp"
+
+/*
+ *  Formato dos arquivos de ciclo escritos pelo simulador (opção -o), um ciclo por arquivo:
+ *
+ *      <nome da rodovia>
+ *      <faixas> <tamanho> <limite de velocidade> <ciclo> <timestamp>
+ *      <placa> <direção> <faixa> <distância>
+ *      ...
+ *
+ *  com um veículo por linha, campos separados por um espaço e todas as linhas terminadas em '\n'.
+ */
+
+/// Arquivo mapeado em memória apenas para leitura. O arquivo pode ser removido depois de
+/// mapeado: o conteúdo continua acessível até o objeto ser destruído.
+class MappedFile {
+    const char* data_ = nullptr;
+    size_t size_ = 0;
+
+ public:
+    explicit MappedFile(const std::string& path) {
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            throw std::runtime_error("Não foi possível abrir " + path + ": " + std::strerror(errno));
+        struct stat info;
+        if (fstat(fd, &info) != 0) {
+            close(fd);
+            throw std::runtime_error("Não foi possível ler o tamanho de " + path + ": " + std::strerror(errno));
+        }
+        size_ = info.st_size;
+        if (size_ > 0) {
+            void* memory = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (memory == MAP_FAILED) {
+                close(fd);
+                throw std::runtime_error("Não foi possível mapear " + path + ": " + std::strerror(errno));
+            }
+            // O arquivo é lido uma única vez, do início ao fim. Os conselhos são valores, não bits,
+            // então cada um vai em uma chamada
+            madvise(memory, size_, MADV_SEQUENTIAL);
+            madvise(memory, size_, MADV_WILLNEED);
+            data_ = static_cast<const char*>(memory);
+        }
+        close(fd);
+    }
+
+    ~MappedFile() {
+        if (data_)
+            munmap(const_cast<char*>(data_), size_);
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const char* data() const {
+        return data_;
+    }
+
+    size_t size() const {
+        return size_;
+    }
+};
+
+/// Ciclo lido de um arquivo. O cabeçalho já foi interpretado, e os veículos continuam em texto
+/// no arquivo mapeado até o Extract.
+struct TextCycle {
+    std::shared_ptr<MappedFile> file;
+    std::string highway;
+    uint32_t lanes;
+    uint32_t size;
+    uint32_t speed_limit;
+    uint32_t cycle;
+    double timestamp;
+    // Linhas dos veículos
+    const char* begin;
+    const char* end;
+
+    /// Interpreta o cabeçalho do arquivo, lançando uma exceção se ele estiver incompleto.
+    static TextCycle parse(std::shared_ptr<MappedFile> file) {
+        const char* data = file->data();
+        const char* end = data + file->size();
+        const char* name_end = data ? static_cast<const char*>(std::memchr(data, '\n', end - data)) : nullptr;
+        const char* header_end = name_end ? static_cast<const char*>(std::memchr(name_end + 1, '\n', end - name_end - 1)) : nullptr;
+        if (!header_end)
+            throw std::runtime_error("Arquivo de ciclo sem cabeçalho.");
+
+        TextCycle cycle;
+        cycle.highway.assign(data, name_end);
+        // Os campos são separados sem sair da linha, que pode ter menos campos que o esperado
+        const char* field = name_end + 1;
+        auto next_field = [&field, header_end]() {
+            const char* begin = field;
+            const char* stop = static_cast<const char*>(std::memchr(begin, ' ', header_end - begin));
+            field = stop ? stop + 1 : header_end;
+            return std::string_view(begin, (stop ? stop : header_end) - begin);
+        };
+        auto next_int = [&next_field]() {
+            std::string_view text = next_field();
+            uint64_t value;
+            if (text.size() > 9 || !digits::parse_scalar(text.data(), text.data() + text.size(), value))
+                throw std::runtime_error("Cabeçalho do arquivo de ciclo inválido.");
+            return static_cast<uint32_t>(value);
+        };
+        cycle.lanes = next_int();
+        cycle.size = next_int();
+        cycle.speed_limit = next_int();
+        cycle.cycle = next_int();
+        std::string_view timestamp = next_field();
+        if (timestamp.empty() || field != header_end ||
+            !digits::parse_decimal(timestamp.data(), timestamp.data() + timestamp.size(), cycle.timestamp))
+            throw std::runtime_error("Cabeçalho do arquivo de ciclo inválido.");
+        cycle.begin = header_end + 1;
+        cycle.end = end;
+        cycle.file = std::move(file);
+        return cycle;
+    }
+};
+
+/// Busca de delimitadores em blocos de 64 bytes com SIMD: cada bit da máscara retornada indica
+/// se o byte correspondente do bloco é `a` ou `b`. Usa AVX2 ou SSE2 quando o compilador permite,
+/// e um laço simples no fim do texto, onde o bloco pode estar incompleto.
+namespace delimiters {
+
+inline uint64_t scalar_mask(const char* block, size_t size, char a, char b) {
+    uint64_t mask = 0;
+    for (size_t i = 0; i < size; i++) {
+        if (block[i] == a || block[i] == b)
+            mask |= uint64_t(1) << i;
+    }
+    return mask;
+}
+
+inline uint64_t mask(const char* block, const char* end, char a, char b) {
+    if (end - block < 64)
+        return scalar_mask(block, end - block, a, b);
+#if defined(__AVX2__)
+    __m256i va = _mm256_set1_epi8(a);
+    __m256i vb = _mm256_set1_epi8(b);
+    __m256i lo = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(block));
+    __m256i hi = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(block + 32));
+    uint32_t lo_mask = _mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpeq_epi8(lo, va), _mm256_cmpeq_epi8(lo, vb)));
+    uint32_t hi_mask = _mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpeq_epi8(hi, va), _mm256_cmpeq_epi8(hi, vb)));
+    return uint64_t(lo_mask) | (uint64_t(hi_mask) << 32);
+#elif defined(__SSE2__)
+    __m128i va = _mm_set1_epi8(a);
+    __m128i vb = _mm_set1_epi8(b);
+    uint64_t result = 0;
+    for (int i = 0; i < 4; i++) {
+        __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(block + 16 * i));
+        uint32_t bits = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(bytes, va), _mm_cmpeq_epi8(bytes, vb)));
+        result |= uint64_t(bits) << (16 * i);
+    }
+    return result;
+#else
+    return scalar_mask(block, 64, a, b);
+#endif
+}
+
+/// Número de linhas que terminam em [begin, end), mais uma se o texto não termina em '\n'.
+inline size_t count_lines(const char* begin, const char* end) {
+    size_t count = 0;
+    for (const char* block = begin; block < end; block += 64)
+        count += __builtin_popcountll(mask(block, end, '\n', '\n'));
+    if (begin < end && end[-1] != '\n')
+        count++;
+    return count;
+}
+
+/// Divide [begin, end) em blocos de cerca de `chunk_size` bytes, terminados em quebras de linha.
+inline std::vector<std::pair<const char*, const char*>> split_lines(const char* begin, const char* end,
+                                                                    size_t chunk_size) {
+    std::vector<std::pair<const char*, const char*>> chunks;
+    while (begin < end) {
+        const char* stop = end;
+        if (static_cast<size_t>(end - begin) > chunk_size) {
+            const char* newline = static_cast<const char*>(std::memchr(begin + chunk_size, '\n', end - begin - chunk_size));
+            stop = newline ? newline + 1 : end;
+        }
+        chunks.emplace_back(begin, stop);
+        begin = stop;
+    }
+    return chunks;
+}
+
+}  // namespace delimiters
+
+/// Converte os dígitos de [begin, end) sem sinal, retornando falso se algum não for um dígito.
+/// Campos de até 8 dígitos com 8 bytes da mesma linha antes do fim, como são todos os campos
+/// numéricos depois de uma placa, usam o kernel SWAR sem laço por dígito.
+inline bool parse_field(const char* line, const char* begin, const char* end, uint32_t& value) {
+    size_t size = end - begin;
+    // Direção e faixa têm um dígito, e não compensam o kernel
+    if (size == 1) {
+        value = static_cast<unsigned char>(*begin) - '0';
+        return value <= 9;
+    }
+    // Tamanho de 2 a 8 (um campo vazio dá size - 1 enorme)
+    if (size - 1 < 8 && end - line >= 8)
+        return digits::parse_tail(end, size, value);
+    uint64_t result = 0;
+    bool valid = size <= 9 && digits::parse_scalar(begin, end, result);
+    value = result;
+    return valid;
+}
+
+/// @brief Interpreta as linhas de veículos de [begin, end), que deve começar no início de uma
+///        linha, chamando `on_vehicle(placa, direção, faixa, distância)` para cada uma.
+///
+/// Os delimitadores são encontrados 64 bytes por vez com `delimiters::mask`, e os bits da máscara
+/// são percorridos em ordem: uma linha válida tem exatamente três espaços antes da quebra de
+/// linha, então os campos saem das posições dos delimitadores sem comparar byte a byte.
+/// @return Número de veículos. Linhas inválidas são ignoradas.
+template<typename OnVehicle>
+size_t parse_vehicles(const char* begin, const char* end, OnVehicle&& on_vehicle) {
+    size_t count = 0;
+    const char* line = begin;
+    // Posições dos espaços da linha atual; um quarto espaço invalida a linha
+    const char* spaces[4];
+    int num_spaces = 0;
+
+    auto finish_line = [&](const char* line_end) {
+        uint32_t direction, lane, distance;
+        if (num_spaces == 3 && parse_field(line, spaces[0] + 1, spaces[1], direction) &
+                                   parse_field(line, spaces[1] + 1, spaces[2], lane) &
+                                   parse_field(line, spaces[2] + 1, line_end, distance)) {
+            on_vehicle(std::string_view(line, spaces[0] - line), direction, lane, distance);
+            count++;
+        }
+        line = line_end + 1;
+        num_spaces = 0;
+    };
+
+    for (const char* block = begin; block < end; block += 64) {
+        uint64_t mask = delimiters::mask(block, end, ' ', '\n');
+        while (mask) {
+            const char* position = block + __builtin_ctzll(mask);
+            mask &= mask - 1;
+            if (*position == ' ') {
+                spaces[num_spaces & 3] = position;
+                num_spaces++;
+            } else {
+                finish_line(position);
+            }
+        }
+    }
+    // A última linha pode não terminar em '\n'
+    if (line < end)
+        finish_line(end);
+    return count;
+}
+
+#endif  // CYCLE_FILE_HPP_
@@ -0,0 +1,197 @@
+#ifndef DELTA_HPP_
+#define DELTA_HPP_
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "proto/simulation.pb.h"
+
+/// Veículo de um ciclo delta depois de aplicado ao dicionário da conexão.
+struct DeltaVehicle {
+    uint32_t id;
+    // Faixa já combinada com a direção, como no Extract
+    uint32_t lane;
+    uint32_t distance;
+};
+
+/// Dicionário de uma conexão delta do lado de quem recebe. Guarda, para cada referência, o id
+/// do veículo no registro, a posição e o passo atuais, de modo que um veículo que só andou o
+/// passo de sempre não precisa de nenhum byte na mensagem. Os ciclos devem ser aplicados na
+/// ordem em que foram enviados, sem nenhum descartado, para que as referências liberadas sejam
+/// reutilizadas na mesma ordem que no `DeltaEncoder`.
+class DeltaDecoder {
+    static const uint32_t no_id = UINT32_MAX;
+
+    struct Entry {
+        uint32_t id;
+        uint32_t lane;
+        uint32_t distance;
+        int32_t step;
+        // Deslocamento da faixa pela direção do veículo
+        uint32_t lane_offset;
+    };
+
+    // Indexado pela referência; veículos que saíram ficam com `no_id` até a referência ser reutilizada
+    std::vector<Entry> entries;
+    // Referências dos veículos ainda na rodovia, em ordem de entrada
+    std::vector<uint32_t> live;
+    // Referências liberadas em ciclos anteriores, reutilizadas da última para a primeira, e as
+    // liberadas no ciclo atual, que só podem ser reutilizadas a partir do próximo
+    std::vector<uint32_t> free_refs;
+    std::vector<uint32_t> exited;
+
+    bool is_live(uint32_t ref) const {
+        return ref < entries.size() && entries[ref].id != no_id;
+    }
+
+ public:
+    /// @brief Aplica o ciclo ao dicionário e escreve em `vehicles` todos os veículos presentes.
+    /// @param lane_factor Número de faixas em cada direção, usado para combinar faixa e direção.
+    /// @param resolve Recebe a placa de um veículo que entrou e retorna seu id no registro.
+    template<typename Resolve>
+    void apply(const simulation::DeltaCycle& delta, uint32_t lane_factor, Resolve&& resolve,
+               std::vector<DeltaVehicle>& vehicles) {
+        vehicles.clear();
+        exited.clear();
+        if (delta.exited_size() > 0) {
+            for (uint32_t ref : delta.exited()) {
+                if (is_live(ref)) {
+                    entries[ref].id = no_id;
+                    exited.push_back(ref);
+                }
+            }
+            live.erase(std::remove_if(live.begin(), live.end(), [this](uint32_t ref) {
+                return entries[ref].id == no_id;
+            }), live.end());
+        }
+
+        // Referências inválidas vindas do cliente são ignoradas
+        int num_steps = std::min(delta.step_refs_size(), delta.steps_size());
+        for (int i = 0; i < num_steps; i++) {
+            if (is_live(delta.step_refs(i)))
+                entries[delta.step_refs(i)].step = delta.steps(i);
+        }
+        int num_lanes = std::min(delta.lane_refs_size(), delta.lanes_size());
+        for (int i = 0; i < num_lanes; i++) {
+            if (is_live(delta.lane_refs(i))) {
+                Entry& entry = entries[delta.lane_refs(i)];
+                entry.lane = delta.lanes(i) + entry.lane_offset;
+            }
+        }
+
+        vehicles.reserve(live.size() + delta.entered_size());
+        for (uint32_t ref : live) {
+            Entry& entry = entries[ref];
+            entry.distance += entry.step;
+            vehicles.push_back({entry.id, entry.lane, entry.distance});
+        }
+
+        // Os veículos que entraram estão na posição enviada, sem aplicar passo
+        for (const simulation::RawVehicle& vehicle : delta.entered()) {
+            uint32_t offset = vehicle.direction() * lane_factor;
+            Entry entry{resolve(vehicle.plate()), vehicle.lane() + offset, vehicle.distance(), 0, offset};
+            uint32_t ref;
+            if (free_refs.empty()) {
+                ref = entries.size();
+                entries.push_back(entry);
+            } else {
+                ref = free_refs.back();
+                free_refs.pop_back();
+                entries[ref] = entry;
+            }
+            live.push_back(ref);
+            vehicles.push_back({entry.id, entry.lane, entry.distance});
+        }
+        free_refs.insert(free_refs.end(), exited.begin(), exited.end());
+    }
+
+    /// Número de veículos presentes depois do último ciclo aplicado.
+    size_t size() const {
+        return live.size();
+    }
+
+    /// Número de referências do dicionário, presentes ou liberadas.
+    size_t capacity() const {
+        return entries.size();
+    }
+};
+
+/// Dicionário de uma conexão delta do lado de quem envia, que converte ciclos completos no
+/// formato delta. É o mesmo algoritmo do cliente Python e serve para produtores em C++. As
+/// referências dos veículos que saem são reutilizadas pelos que entram nos ciclos seguintes, então
+/// uma conexão longa não acumula placas nem referências cada vez maiores.
+class DeltaEncoder {
+    struct Entry {
+        uint32_t ref;
+        uint32_t lane;
+        uint32_t distance;
+        int32_t step;
+        // Último ciclo codificado em que o veículo apareceu
+        uint64_t seen;
+    };
+
+    std::unordered_map<std::string, Entry> dictionary;
+    uint32_t next_ref = 0;
+    // Referências liberadas, na ordem de `exited`; a última é a primeira reutilizada
+    std::vector<uint32_t> free_refs;
+    uint64_t generation = 0;
+
+ public:
+    void encode(const simulation::SimulationCycle& cycle, uint32_t highway_id, simulation::DeltaCycle& delta) {
+        delta.Clear();
+        delta.set_cycle(cycle.cycle());
+        delta.set_timestamp(cycle.timestamp());
+        delta.set_highway_id(highway_id);
+        generation++;
+
+        for (const simulation::RawVehicle& vehicle : cycle.vehicles()) {
+            auto [it, inserted] = dictionary.try_emplace(vehicle.plate());
+            Entry& entry = it->second;
+            if (inserted) {
+                uint32_t ref = next_ref;
+                if (free_refs.empty()) {
+                    next_ref++;
+                } else {
+                    ref = free_refs.back();
+                    free_refs.pop_back();
+                }
+                entry = {ref, vehicle.lane(), vehicle.distance(), 0, generation};
+                *delta.add_entered() = vehicle;
+                continue;
+            }
+            entry.seen = generation;
+            int32_t step = static_cast<int32_t>(vehicle.distance() - entry.distance);
+            if (step != entry.step) {
+                delta.add_step_refs(entry.ref);
+                delta.add_steps(step);
+                entry.step = step;
+            }
+            if (vehicle.lane() != entry.lane) {
+                delta.add_lane_refs(entry.ref);
+                delta.add_lanes(vehicle.lane());
+                entry.lane = vehicle.lane();
+            }
+            entry.distance = vehicle.distance();
+        }
+
+        for (auto it = dictionary.begin(); it != dictionary.end();) {
+            if (it->second.seen != generation) {
+                delta.add_exited(it->second.ref);
+                free_refs.push_back(it->second.ref);
+                it = dictionary.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+
+    /// Número de referências já criadas, presentes ou liberadas.
+    uint32_t capacity() const {
+        return next_ref;
+    }
+};
+
+#endif  // DELTA_HPP_
@@ -0,0 +1,317 @@
+#ifndef ENRICHMENT_HPP_
+#define ENRICHMENT_HPP_
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "./conversions.hpp"
+#include "./external.hpp"
+#include "./lru_cache.hpp"
+
+/// Cliente assíncrono do serviço externo. As placas submetidas entram em uma fila de prioridade
+/// limitada e são enviadas em lotes por um número fixo de threads, que é a quantidade máxima de
+/// requisições em andamento. Os resultados são entregues por callback e guardados em um cache
+/// LRU, de modo que uma placa já conhecida nunca é consultada de novo e quem submete nunca
+/// espera o serviço.
+///
+/// A prioridade combina a pontuação de risco da placa com o tempo desde que ela foi pedida pela
+/// primeira vez: cada ponto de pontuação equivale a `priority_boost` segundos de espera, então
+/// placas perigosas passam na frente, mas as outras não ficam esquecidas para sempre. Requisições
+/// descartadas pelo serviço voltam para a fila depois de um tempo que dobra a cada tentativa.
+class EnrichmentClient {
+ public:
+    // Número máximo de categorias (bits) usadas nas métricas
+    static const int max_categories = 8;
+
+    struct Result {
+        uint32_t id;
+        Plate plate;
+        OwnerInfo info;
+    };
+
+    struct Metrics {
+        // Placas pedidas, sem contar as descartadas, e placas respondidas em cada categoria
+        uint64_t requested = 0;
+        uint64_t completed = 0;
+        // Soma dos tempos entre o primeiro pedido e a resposta, em segundos
+        double total_latency = 0.0;
+
+        double coverage() const {
+            return requested ? static_cast<double>(completed) / requested : 0.0;
+        }
+
+        double mean_latency() const {
+            return completed ? total_latency / completed : 0.0;
+        }
+    };
+
+    // Chamado pelas threads do cliente com cada lote de resultados recebido
+    using Callback = std::function<void(std::vector<Result>&)>;
+
+    enum class Status {
+        CACHED,   // A placa estava no cache e o resultado foi copiado para quem submeteu
+        QUEUED,   // A placa foi enfileirada ou já estava aguardando uma resposta
+        DROPPED,  // A fila estava cheia de placas mais prioritárias
+    };
+
+ private:
+    static constexpr double priority_boost = 5.0;
+    static constexpr double base_backoff = 0.01;
+    static constexpr double max_backoff = 1.0;
+    static const int max_attempts = 8;
+
+    struct Request {
+        Plate plate;
+        // Instante do primeiro pedido da placa, em segundos
+        double first_submit;
+        // Chave de prioridade, mantida quando a requisição é tentada de novo
+        double priority;
+        int attempts = 0;
+    };
+
+    // Ordenadas pela chave de prioridade: a menor chave é a próxima a ser enviada
+    using Queue = std::multimap<double, Request>;
+
+    enum class Stage { QUEUED, IN_FLIGHT, RETRYING };
+
+    struct Waiting {
+        // Id mais recente que pediu a placa e categorias de todos os pedidos
+        uint32_t id;
+        uint8_t categories;
+        Stage stage;
+        Queue::iterator position;
+    };
+
+    SlowService& service;
+    Callback on_results;
+    size_t batch_size;
+    size_t max_pending;
+
+    std::mutex mutex;
+    std::condition_variable cv;
+    Queue pending;
+    // Requisições descartadas pelo serviço, ordenadas pelo instante da próxima tentativa
+    std::multimap<double, Request> retries;
+    std::unordered_map<uint64_t, Waiting, plate_code::Hash> waiting;
+    LruCache<uint64_t, OwnerInfo> cache;
+    Metrics metrics_[max_categories];
+    uint64_t dropped_ = 0;
+    uint64_t retried_ = 0;
+    std::vector<std::thread> dispatchers;
+    bool stopping = false;
+
+    static double now() {
+        using seconds = std::chrono::duration<double>;
+        return std::chrono::duration_cast<seconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    static double priority_key(double first_submit, float score) {
+        return first_submit - score * priority_boost;
+    }
+
+    /// Soma `delta` aos pedidos das categorias. Placas descartadas deixam de contar, pois serão
+    /// pedidas de novo no próximo lote em que aparecerem.
+    void count_requested(uint8_t categories, int delta) {
+        for (int c = 0; c < max_categories; c++) {
+            if (categories >> c & 1)
+                metrics_[c].requested += delta;
+        }
+    }
+
+    /// Move para a fila as requisições cuja espera terminou e retorna o instante da próxima.
+    double release_retries(double current) {
+        while (!retries.empty() && retries.begin()->first <= current) {
+            Request request = std::move(retries.begin()->second);
+            retries.erase(retries.begin());
+            Waiting& entry = waiting[request.plate.code()];
+            entry.stage = Stage::QUEUED;
+            // Tentativas novas mantêm a prioridade original, então passam na frente das placas
+            // que foram pedidas depois
+            double priority = request.priority;
+            entry.position = pending.emplace(priority, std::move(request));
+        }
+        return retries.empty() ? 0.0 : retries.begin()->first;
+    }
+
+    void dispatch_loop() {
+        std::vector<Request> batch;
+        std::vector<std::string> plates;
+        std::vector<Result> results;
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                while (true) {
+                    if (stopping)
+                        return;
+                    double next_retry = release_retries(now());
+                    if (!pending.empty())
+                        break;
+                    if (next_retry > 0.0)
+                        cv.wait_for(lock, std::chrono::duration<double>(next_retry - now()));
+                    else
+                        cv.wait(lock);
+                }
+                batch.clear();
+                while (!pending.empty() && batch.size() < batch_size) {
+                    batch.push_back(std::move(pending.begin()->second));
+                    pending.erase(pending.begin());
+                    waiting[batch.back().plate.code()].stage = Stage::IN_FLIGHT;
+                }
+            }
+
+            plates.clear();
+            for (const Request& request : batch)
+                plates.emplace_back(request.plate.plate);
+            auto response = service.query_vehicles(plates);
+
+            results.clear();
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                double current = now();
+                for (int i = 0; i < batch.size(); i++) {
+                    Request& request = batch[i];
+                    uint64_t key = request.plate.code();
+                    auto it = waiting.find(key);
+                    if (!response) {
+                        // O serviço estava cheio: tenta de novo mais tarde, até o limite de tentativas
+                        if (++request.attempts < max_attempts) {
+                            double backoff = std::min(max_backoff, base_backoff * (1 << (request.attempts - 1)));
+                            it->second.stage = Stage::RETRYING;
+                            retries.emplace(current + backoff, std::move(request));
+                            retried_++;
+                        } else {
+                            count_requested(it->second.categories, -1);
+                            waiting.erase(it);
+                            dropped_++;
+                        }
+                        continue;
+                    }
+                    for (int c = 0; c < max_categories; c++) {
+                        if (it->second.categories >> c & 1) {
+                            metrics_[c].completed++;
+                            metrics_[c].total_latency += current - request.first_submit;
+                        }
+                    }
+                    cache.put(key, (*response)[i]);
+                    results.push_back({it->second.id, request.plate, std::move((*response)[i])});
+                    waiting.erase(it);
+                }
+            }
+            if (!results.empty())
+                on_results(results);
+            // Com o serviço cheio, mandar o próximo lote na hora só gastaria as tentativas dele
+            if (!response) {
+                std::unique_lock<std::mutex> lock(mutex);
+                cv.wait_for(lock, std::chrono::duration<double>(base_backoff), [this] { return stopping; });
+            }
+        }
+    }
+
+ public:
+    /// @param max_in_flight Número máximo de requisições simultâneas ao serviço.
+    /// @param batch_size Número máximo de placas em cada requisição.
+    /// @param max_pending Tamanho da fila de placas à espera de uma requisição.
+    /// @param cache_capacity Número de placas guardadas no cache.
+    EnrichmentClient(SlowService& service, int max_in_flight, size_t batch_size, size_t max_pending,
+                     size_t cache_capacity, Callback on_results) :
+            service(service), on_results(std::move(on_results)), batch_size(batch_size),
+            max_pending(max_pending), cache(cache_capacity) {
+        for (int i = 0; i < max_in_flight; i++)
+            dispatchers.emplace_back(&EnrichmentClient::dispatch_loop, this);
+    }
+
+    ~EnrichmentClient() {
+        stop();
+    }
+
+    /// Encerra as threads do cliente, esperando as requisições em andamento.
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        cv.notify_all();
+        for (auto& thread : dispatchers) {
+            if (thread.joinable())
+                thread.join();
+        }
+    }
+
+    /// @brief Pede as informações da placa sem esperar o serviço.
+    /// @param categories Bits das categorias da placa, usados nas métricas.
+    /// @param score Pontuação de risco; quanto maior, mais cedo a placa é consultada.
+    /// @param cached Recebe as informações quando elas já estão no cache.
+    Status submit(uint32_t id, const Plate& plate, uint8_t categories, float score, OwnerInfo& cached) {
+        uint64_t key = plate.code();
+        std::unique_lock<std::mutex> lock(mutex);
+        if (cache.get(key, cached))
+            return Status::CACHED;
+
+        auto it = waiting.find(key);
+        if (it != waiting.end()) {
+            Waiting& entry = it->second;
+            entry.id = id;
+            count_requested(categories & ~entry.categories, 1);
+            entry.categories |= categories;
+            // Se a placa ficou mais perigosa enquanto esperava, sobe na fila
+            if (entry.stage == Stage::QUEUED) {
+                double bumped = priority_key(entry.position->second.first_submit, score);
+                if (bumped < entry.position->first) {
+                    Request request = std::move(entry.position->second);
+                    request.priority = bumped;
+                    pending.erase(entry.position);
+                    entry.position = pending.emplace(bumped, std::move(request));
+                }
+            }
+            return Status::QUEUED;
+        }
+
+        double current = now();
+        double priority = priority_key(current, score);
+        if (pending.size() >= max_pending) {
+            // Com a fila cheia, só entra se for mais prioritária que a última, que é descartada
+            auto last = std::prev(pending.end());
+            if (priority >= last->first)
+                return Status::DROPPED;
+            auto evicted = waiting.find(last->second.plate.code());
+            count_requested(evicted->second.categories, -1);
+            waiting.erase(evicted);
+            pending.erase(last);
+            dropped_++;
+        }
+        count_requested(categories, 1);
+        auto position = pending.emplace(priority, Request{plate, current, priority});
+        waiting.emplace(key, Waiting{id, categories, Stage::QUEUED, position});
+        lock.unlock();
+        cv.notify_one();
+        return Status::QUEUED;
+    }
+
+    Metrics metrics(int category) {
+        std::lock_guard<std::mutex> lock(mutex);
+        return metrics_[category];
+    }
+
+    /// Número de placas que foram descartadas sem resposta.
+    uint64_t dropped() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return dropped_;
+    }
+
+    /// Número de novas tentativas agendadas porque o serviço estava cheio.
+    uint64_t retried() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return retried_;
+    }
+};
+
+#endif  // ENRICHMENT_HPP_
@@ -5,14 +5,24 @@
 #include <condition_variable>
 #include <fstream>
 #include <mutex>
+#include <optional>
 #include <random>
 #include <string>
 #include <thread>
 #include <queue>
+#include <vector>
 
+// Informações de um veículo retornadas pelo serviço externo
+struct OwnerInfo {
+    std::string name;
+    std::string model;
+    int year = -1;
+};
 
 class SlowService {
-    std::queue<std::string> queue;
+    // Cada requisição recebe um número para que placas repetidas não se confundam na fila
+    std::queue<uint64_t> queue;
+    uint64_t next_ticket = 0;
     std::condition_variable cv;
     std::mutex processing_mutex;
     std::mutex queue_mutex;
@@ -23,10 +33,6 @@ class SlowService {
     std::vector<std::string> last_names;
     std::vector<std::string> models;
 
-    std::string name;
-    std::string model;
-    int year = -1;
-
     int random_number(int limit) {
         static std::random_device rd;
         static std::mt19937 gen(rd());
@@ -54,30 +60,39 @@ class SlowService {
             models.push_back(line);
     }
 
-    /// @brief Adiciona uma placa à fila de espera e descarta a requisição se a fila estiver cheia.
-    /// @param plate A placa a ser adicionada à fila.
-    /// @return Um booleano indicando se a placa foi adicionada à fila.
-    bool query_vehicle(const std::string& plate) {
+    /// @brief Adiciona um lote de placas à fila de espera como uma única requisição e descarta a
+    ///        requisição se a fila estiver cheia.
+    /// @param plates As placas a serem consultadas.
+    /// @return As informações de cada placa, na mesma ordem, ou nada se a requisição foi descartada.
+    std::optional<std::vector<OwnerInfo>> query_vehicles(const std::vector<std::string>& plates) {
         std::unique_lock<std::mutex> queue_lock(queue_mutex);
         if (queue.size() == max_queue_size)
-            return false;
-        queue.push(plate);
+            return {};
+        uint64_t ticket = next_ticket++;
+        queue.push(ticket);
         // Libera consultas à fila
         queue_lock.unlock();
 
         std::unique_lock<std::mutex> processing_lock(processing_mutex);
-        // Espera até que a próxima placa a ser processada seja a atual
-        if (queue.front() != plate)
-            cv.wait(processing_lock, [this, plate] { return queue.front() == plate; });
+        // Espera até que a próxima requisição a ser processada seja a atual
+        auto is_next = [this, ticket] {
+            std::lock_guard<std::mutex> lock(queue_mutex);
+            return queue.front() == ticket;
+        };
+        if (!is_next())
+            cv.wait(processing_lock, is_next);
 
         // Dorme para ser intencionalmente lento
         std::this_thread::sleep_for(std::chrono::nanoseconds(nap_time));
 
-        // Concatena strings toda vez ao invés de preprocessar
-        name = (first_names[random_number(first_names.size())] + " " +
-                last_names[random_number(last_names.size())]);
-        model = models[random_number(models.size())];
-        year = random_number(23) + 2000;
+        std::vector<OwnerInfo> result(plates.size());
+        for (OwnerInfo& info : result) {
+            // Concatena strings toda vez ao invés de preprocessar
+            info.name = (first_names[random_number(first_names.size())] + " " +
+                         last_names[random_number(last_names.size())]);
+            info.model = models[random_number(models.size())];
+            info.year = random_number(23) + 2000;
+        }
 
         queue_lock.lock();
         queue.pop();
@@ -85,19 +100,15 @@ class SlowService {
         processing_lock.unlock();
         // Notifica a próxima thread que a fila foi modificada
         cv.notify_all();
-        return true;
-    }
-
-    std::string get_name() const {
-        return name;
-    }
-
-    std::string get_model() const {
-        return model;
+        return result;
     }
 
-    int get_year() const {
-        return year;
+    /// Consulta uma única placa. Equivale a um lote de tamanho 1.
+    std::optional<OwnerInfo> query_vehicle(const std::string& plate) {
+        auto result = query_vehicles({plate});
+        if (!result)
+            return {};
+        return std::move(result->front());
     }
 };
 
@@ -0,0 +1,100 @@
+#ifndef FILE_INGEST_HPP_
+#define FILE_INGEST_HPP_
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+#include "./cycle_file.hpp"
+#include "./ingest.hpp"
+
+/// Terceiro transporte de entrada: observa pastas em que simuladores escrevem um arquivo por
+/// ciclo (`<ciclo>.txt`, no formato descrito em cycle_file.hpp). Cada arquivo novo é mapeado em
+/// memória, tem apenas o cabeçalho interpretado aqui e é removido; os veículos são interpretados
+/// em paralelo pelo ETL, dividindo o texto entre os workers, junto dos demais ciclos do lote.
+///
+/// Os simuladores devem escrever cada ciclo em um arquivo temporário com outra extensão e
+/// renomeá-lo no fim, para que um arquivo nunca seja lido pela metade.
+class FileIngest {
+    static constexpr std::chrono::milliseconds scan_interval{20};
+
+    IngestService& service;
+    std::vector<std::string> folders;
+    // Arquivos inválidos, que não são removidos nem lidos de novo
+    std::unordered_set<std::string> rejected;
+    std::atomic<bool> running{false};
+    std::thread thread;
+
+    /// Entrega os ciclos novos de uma pasta em ordem de ciclo.
+    void scan(const std::string& folder) {
+        std::vector<std::filesystem::path> files;
+        std::error_code error;
+        for (const auto& entry : std::filesystem::directory_iterator(folder, error)) {
+            if (entry.path().extension() == ".txt" && !rejected.count(entry.path().string()))
+                files.push_back(entry.path());
+        }
+        // Os nomes são números sem zeros à esquerda, então os menores vêm antes
+        std::sort(files.begin(), files.end(), [](const auto& a, const auto& b) {
+            std::string x = a.filename().string(), y = b.filename().string();
+            return x.size() != y.size() ? x.size() < y.size() : x < y;
+        });
+
+        for (const auto& path : files) {
+            // Com a fila do serviço cheia, os arquivos restantes esperam a próxima varredura
+            if (service.full())
+                break;
+            try {
+                auto cycle = std::make_shared<TextCycle>(TextCycle::parse(std::make_shared<MappedFile>(path.string())));
+                simulation::Highway highway;
+                highway.set_name(cycle->highway);
+                highway.set_lanes(cycle->lanes);
+                highway.set_size(cycle->size);
+                highway.set_speed_limit(cycle->speed_limit);
+                IngestedCycle ingested;
+                ingested.source_highway = service.register_highway(highway);
+                ingested.text = std::move(cycle);
+                // O conteúdo continua mapeado depois de o arquivo ser removido
+                std::filesystem::remove(path, error);
+                service.push(std::move(ingested));
+            } catch (const std::runtime_error&) {
+                rejected.insert(path.string());
+            }
+        }
+    }
+
+    void loop() {
+        while (running.load(std::memory_order_relaxed)) {
+            for (const std::string& folder : folders)
+                scan(folder);
+            std::this_thread::sleep_for(scan_interval);
+        }
+    }
+
+ public:
+    explicit FileIngest(IngestService& service, std::vector<std::string> folders) :
+            service(service), folders(std::move(folders)) {}
+
+    ~FileIngest() {
+        stop();
+    }
+
+    void start() {
+        if (running.exchange(true))
+            return;
+        thread = std::thread(&FileIngest::loop, this);
+    }
+
+    void stop() {
+        running = false;
+        if (thread.joinable())
+            thread.join();
+    }
+};
+
+#endif  // FILE_INGEST_HPP_
@@ -0,0 +1,81 @@
+#ifndef HISTORY_LOG_HPP_
+#define HISTORY_LOG_HPP_
+
+#include <cstdio>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+/// Log binário somente de acréscimo para o histórico que não cabe mais nos buffers circulares.
+/// Os registros têm tamanho fixo e são gravados sem nenhuma formatação, então o arquivo pode ser
+/// lido de volta como um vetor de `Record`. Cada worker escreve em um buffer próprio, que só
+/// trava o arquivo quando está cheio.
+template<typename Record>
+class HistoryLog {
+    static const int buffer_records = 4096;
+
+    std::FILE* file = nullptr;
+    std::mutex mutex;
+    std::vector<std::vector<Record>> buffers;
+
+    void write(std::vector<Record>& buffer) {
+        if (buffer.empty())
+            return;
+        std::lock_guard<std::mutex> lock(mutex);
+        std::fwrite(buffer.data(), sizeof(Record), buffer.size(), file);
+        buffer.clear();
+    }
+
+ public:
+    HistoryLog() = default;
+
+    ~HistoryLog() {
+        close();
+    }
+
+    HistoryLog(const HistoryLog&) = delete;
+    HistoryLog& operator=(const HistoryLog&) = delete;
+
+    void open(const std::string& path) {
+        close();
+        file = std::fopen(path.c_str(), "ab");
+        if (!file)
+            throw std::runtime_error("Não foi possível abrir o log de histórico " + path + ".");
+    }
+
+    void close() {
+        if (!file)
+            return;
+        flush();
+        std::fclose(file);
+        file = nullptr;
+    }
+
+    bool is_open() const {
+        return file != nullptr;
+    }
+
+    /// Garante um buffer para cada worker. Não pode ser chamada enquanto há escritas.
+    void prepare(int num_workers) {
+        if (buffers.size() < num_workers)
+            buffers.resize(num_workers);
+    }
+
+    void append(int worker, const Record& record) {
+        std::vector<Record>& buffer = buffers[worker];
+        buffer.push_back(record);
+        if (buffer.size() >= buffer_records)
+            write(buffer);
+    }
+
+    /// Grava os buffers de todos os workers. Não pode ser chamada enquanto há escritas.
+    void flush() {
+        for (auto& buffer : buffers)
+            write(buffer);
+        std::lock_guard<std::mutex> lock(mutex);
+        std::fflush(file);
+    }
+};
+
+#endif  // HISTORY_LOG_HPP_
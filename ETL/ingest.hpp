@@ -0,0 +1,416 @@
+#ifndef INGEST_HPP_
+#define INGEST_HPP_
+
+#ifndef GRPC_CALLBACK_API_NONEXPERIMENTAL
+#define GRPC_CALLBACK_API_NONEXPERIMENTAL
+#endif
+
+#include <grpcpp/grpcpp.h>
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "./arena_allocator.hpp"
+#include "./cycle_file.hpp"
+#include "./mpsc_queue.hpp"
+#include "./shm_ring.hpp"
+#include "proto/simulation.grpc.pb.h"
+
+/// Ciclo recebido em qualquer um dos formatos, ou o aviso de que uma conexão delta terminou.
+/// A mensagem fica na arena em que foi lida, sem cópia, e a arena é liberada de uma vez quando o
+/// último ciclo que a usa é destruído, normalmente ao fim do lote que os processou.
+struct IngestedCycle {
+    std::shared_ptr<google::protobuf::Arena> arena;
+    const simulation::SimulationCycle* cycle = nullptr;
+    const simulation::DeltaCycle* delta = nullptr;
+    // Ciclo no formato binário do transporte por memória compartilhada, copiado para a arena
+    const ShmCycle* record = nullptr;
+    // Ciclo lido de um arquivo, com os veículos ainda em texto
+    std::shared_ptr<const TextCycle> text;
+    // Id da rodovia dos ciclos de memória compartilhada e de arquivos, registrada por quem os leu
+    uint32_t source_highway = 0;
+    // Conexão delta que enviou o ciclo, ou 0 no formato completo
+    uint32_t stream = 0;
+    // Não traz ciclo: apenas indica que a conexão `stream` terminou
+    bool closed = false;
+
+    bool is_delta() const {
+        return stream != 0;
+    }
+
+    bool is_record() const {
+        return record != nullptr;
+    }
+
+    bool is_text() const {
+        return text != nullptr;
+    }
+
+    uint32_t number() const {
+        if (is_delta())
+            return delta->cycle();
+        if (is_record())
+            return record->cycle;
+        if (is_text())
+            return text->cycle;
+        return cycle->cycle();
+    }
+
+    double timestamp() const {
+        if (is_delta())
+            return delta->timestamp();
+        if (is_record())
+            return record->timestamp;
+        if (is_text())
+            return text->timestamp;
+        return cycle->timestamp();
+    }
+
+    uint32_t highway_id() const {
+        if (is_delta())
+            return delta->highway_id();
+        if (is_record() || is_text())
+            return source_highway;
+        return cycle->highway_id();
+    }
+};
+
+/// Recebe os ciclos da simulação pela API de callbacks do gRPC. Os handlers rodam nas threads do
+/// próprio gRPC, apenas colocam os ciclos em uma fila sem locks e respondem na hora, sem ocupar
+/// uma thread por chamada. O orquestrador consome a fila e só acorda quando há trabalho.
+///
+/// Além da chamada unária antiga, que reenvia a rodovia inteira a cada ciclo, os clientes podem
+/// registrar a rodovia uma vez e mandar ciclos com o id dela, em lotes (`ReportCycles`) ou em
+/// uma única chamada de streaming (`StreamCycles`). Em `StreamDeltas`, cada chamada ganha um
+/// número de conexão, e seus ciclos delta são decodificados pelo ETL com o dicionário dela.
+///
+/// Todas as mensagens são lidas em arenas do protobuf, e não campo a campo no heap: as chamadas
+/// unárias usam uma arena por chamada, e as de streaming leem várias mensagens seguidas na mesma
+/// arena até ela ocupar `stream_arena_size` bytes.
+///
+/// A fila guarda no máximo cerca de `max_queued_cycles` ciclos: com ela cheia, as chamadas de
+/// streaming só leem a próxima mensagem e as unárias só colocam o ciclo na fila e respondem quando o
+/// orquestrador retira algum, então o controle de fluxo do gRPC faz os simuladores esperarem.
+class IngestService final : public simulation::SimulationService::CallbackService {
+    static const size_t stream_arena_size = 1 << 16;
+    static const size_t max_queued_cycles = 1 << 12;
+
+    /// Arena compartilhada pelas mensagens seguintes de uma chamada de streaming.
+    class StreamArena {
+        ArenaFactory& factory;
+
+     public:
+        std::shared_ptr<google::protobuf::Arena> arena;
+
+        explicit StreamArena(ArenaFactory& factory) : factory(factory), arena(factory.create()) {}
+
+        /// Cria a próxima mensagem, trocando de arena se a atual já está cheia. A arena antiga
+        /// continua viva enquanto houver ciclos dela na fila.
+        template<typename Message>
+        Message* next() {
+            if (arena->SpaceUsed() >= stream_arena_size) {
+                factory.learn(*arena);
+                arena = factory.create();
+            }
+            return google::protobuf::Arena::CreateMessage<Message>(arena.get());
+        }
+    };
+
+    /// Lê os ciclos de uma chamada de streaming direto na arena, e vão para a fila sem cópia.
+    class CycleReader final : public grpc::ServerReadReactor<simulation::SimulationCycle> {
+        IngestService& service;
+        StreamArena arena;
+        simulation::SimulationCycle* cycle;
+
+     public:
+        explicit CycleReader(IngestService& service) : service(service), arena(service.stream_arenas) {
+            cycle = arena.next<simulation::SimulationCycle>();
+            StartRead(cycle);
+        }
+
+        void OnReadDone(bool ok) override {
+            // O cliente terminou de enviar
+            if (!ok) {
+                Finish(grpc::Status::OK);
+                return;
+            }
+            if (!service.is_registered(cycle->highway_id())) {
+                Finish(unknown_highway());
+                return;
+            }
+            IngestedCycle ingested;
+            ingested.arena = arena.arena;
+            ingested.cycle = cycle;
+            service.enqueue(std::move(ingested));
+            cycle = arena.next<simulation::SimulationCycle>();
+            service.when_ready([this](bool accepted) {
+                if (accepted)
+                    StartRead(cycle);
+                else
+                    Finish(shutting_down());
+            });
+        }
+
+        void OnDone() override {
+            delete this;
+        }
+    };
+
+    /// Lê os ciclos delta de uma conexão e avisa o ETL quando ela termina, para que o
+    /// dicionário seja liberado.
+    class DeltaReader final : public grpc::ServerReadReactor<simulation::DeltaCycle> {
+        IngestService& service;
+        uint32_t stream;
+        StreamArena arena;
+        simulation::DeltaCycle* delta;
+
+     public:
+        DeltaReader(IngestService& service, uint32_t stream) :
+                service(service), stream(stream), arena(service.stream_arenas) {
+            delta = arena.next<simulation::DeltaCycle>();
+            StartRead(delta);
+        }
+
+        void OnReadDone(bool ok) override {
+            if (!ok) {
+                Finish(grpc::Status::OK);
+                return;
+            }
+            // O formato delta não carrega a rodovia, então o id é obrigatório
+            if (delta->highway_id() == 0 || !service.is_registered(delta->highway_id())) {
+                Finish(unknown_highway());
+                return;
+            }
+            IngestedCycle ingested;
+            ingested.arena = arena.arena;
+            ingested.delta = delta;
+            ingested.stream = stream;
+            service.enqueue(std::move(ingested));
+            delta = arena.next<simulation::DeltaCycle>();
+            service.when_ready([this](bool accepted) {
+                if (accepted)
+                    StartRead(delta);
+                else
+                    Finish(shutting_down());
+            });
+        }
+
+        void OnDone() override {
+            IngestedCycle closed;
+            closed.stream = stream;
+            closed.closed = true;
+            service.enqueue(std::move(closed));
+            delete this;
+        }
+    };
+
+    MpscQueue<IngestedCycle> queue;
+    ArenaAllocator<simulation::SimulationCycle, simulation::Empty> cycle_allocator;
+    ArenaAllocator<simulation::CycleBatch, simulation::Empty> batch_allocator;
+    ArenaFactory stream_arenas;
+    std::atomic<uint32_t> next_stream{1};
+    // Rodovias registradas, em que o id é a posição no vetor mais 1
+    std::mutex highway_mutex;
+    std::deque<simulation::Highway> highways;
+    std::unordered_map<std::string, uint32_t> highway_ids;
+    std::atomic<uint32_t> num_highways{0};
+    // Ciclos na fila e as chamadas que esperam espaço nela. `has_waiting` deixa o orquestrador
+    // verificar a espera sem o mutex a cada ciclo retirado
+    std::atomic<size_t> queued{0};
+    std::mutex waiting_mutex;
+    std::vector<std::function<void(bool)>> waiting;
+    std::atomic<bool> has_waiting{false};
+    bool closed = false;
+
+    static grpc::Status unknown_highway() {
+        return grpc::Status(grpc::StatusCode::NOT_FOUND, "Rodovia não registrada.");
+    }
+
+    static grpc::Status shutting_down() {
+        return grpc::Status(grpc::StatusCode::UNAVAILABLE, "Servidor encerrando.");
+    }
+
+    void enqueue(IngestedCycle&& cycle) {
+        queued.fetch_add(1);
+        queue.push(std::move(cycle));
+    }
+
+    /// Chama `next(true)` quando a fila tiver espaço: na hora, se já tiver, ou na thread do
+    /// orquestrador, quando ele retirar um ciclo. Depois de `close`, chama `next(false)`.
+    void when_ready(std::function<void(bool)> next) {
+        {
+            std::unique_lock<std::mutex> lock(waiting_mutex);
+            if (closed || !full()) {
+                bool accepted = !closed;
+                lock.unlock();
+                next(accepted);
+                return;
+            }
+            waiting.push_back(std::move(next));
+            has_waiting.store(true);
+        }
+        // O orquestrador pode ter retirado ciclos depois da verificação e antes de `has_waiting`:
+        // um dos dois sempre vê a mudança do outro e libera a espera
+        if (!full())
+            resume(true);
+    }
+
+    void resume(bool accepted) {
+        std::vector<std::function<void(bool)>> ready;
+        {
+            std::lock_guard<std::mutex> lock(waiting_mutex);
+            ready.swap(waiting);
+            has_waiting.store(false);
+        }
+        for (std::function<void(bool)>& next : ready)
+            next(accepted);
+    }
+
+    bool is_registered(uint32_t highway_id) const {
+        return highway_id <= num_highways.load(std::memory_order_acquire);
+    }
+
+ public:
+    IngestService() {
+        SetMessageAllocatorFor_ReportCycle(&cycle_allocator);
+        SetMessageAllocatorFor_ReportCycles(&batch_allocator);
+    }
+
+    grpc::ServerUnaryReactor* ReportCycle(grpc::CallbackServerContext* context,
+                                          const simulation::SimulationCycle* cycle,
+                                          simulation::Empty* response) override {
+        grpc::ServerUnaryReactor* reactor = context->DefaultReactor();
+        if (!is_registered(cycle->highway_id())) {
+            reactor->Finish(unknown_highway());
+            return reactor;
+        }
+        // O ciclo continua na arena da chamada, que vive até o ETL terminar de usá-lo. Com a fila
+        // cheia, a resposta só sai quando ele entra nela
+        IngestedCycle ingested;
+        ingested.arena = decltype(cycle_allocator)::retain(context);
+        ingested.cycle = cycle;
+        when_ready([this, reactor, ingested](bool accepted) mutable {
+            if (accepted)
+                enqueue(std::move(ingested));
+            reactor->Finish(accepted ? grpc::Status::OK : shutting_down());
+        });
+        return reactor;
+    }
+
+    grpc::ServerUnaryReactor* RegisterHighway(grpc::CallbackServerContext* context,
+                                              const simulation::Highway* highway,
+                                              simulation::HighwayId* response) override {
+        response->set_id(register_highway(*highway));
+        grpc::ServerUnaryReactor* reactor = context->DefaultReactor();
+        reactor->Finish(grpc::Status::OK);
+        return reactor;
+    }
+
+    grpc::ServerUnaryReactor* ReportCycles(grpc::CallbackServerContext* context,
+                                           const simulation::CycleBatch* batch,
+                                           simulation::Empty* response) override {
+        grpc::ServerUnaryReactor* reactor = context->DefaultReactor();
+        for (const simulation::SimulationCycle& cycle : batch->cycles()) {
+            if (!is_registered(cycle.highway_id())) {
+                reactor->Finish(unknown_highway());
+                return reactor;
+            }
+        }
+        // Todos os ciclos do lote compartilham a arena da chamada
+        std::shared_ptr<google::protobuf::Arena> arena = decltype(batch_allocator)::retain(context);
+        when_ready([this, reactor, batch, arena](bool accepted) {
+            if (accepted) {
+                for (const simulation::SimulationCycle& cycle : batch->cycles()) {
+                    IngestedCycle ingested;
+                    ingested.arena = arena;
+                    ingested.cycle = &cycle;
+                    enqueue(std::move(ingested));
+                }
+            }
+            reactor->Finish(accepted ? grpc::Status::OK : shutting_down());
+        });
+        return reactor;
+    }
+
+    grpc::ServerReadReactor<simulation::SimulationCycle>* StreamCycles(grpc::CallbackServerContext* context,
+                                                                      simulation::Empty* response) override {
+        return new CycleReader(*this);
+    }
+
+    grpc::ServerReadReactor<simulation::DeltaCycle>* StreamDeltas(grpc::CallbackServerContext* context,
+                                                                 simulation::Empty* response) override {
+        return new DeltaReader(*this, next_stream++);
+    }
+
+    /// Registra a rodovia e retorna seu id. Uma rodovia registrada de novo (por exemplo, depois de
+    /// o cliente reiniciar) mantém o id.
+    uint32_t register_highway(const simulation::Highway& highway) {
+        std::lock_guard<std::mutex> lock(highway_mutex);
+        auto [it, inserted] = highway_ids.emplace(highway.name(), highways.size() + 1);
+        if (inserted) {
+            highways.push_back(highway);
+            num_highways.store(highways.size(), std::memory_order_release);
+        }
+        return it->second;
+    }
+
+    /// Entrega um ciclo recebido por outro transporte, como a memória compartilhada. A rodovia
+    /// do ciclo deve estar registrada. Quem entrega deve esperar enquanto `full` for verdadeira.
+    void push(IngestedCycle&& cycle) {
+        enqueue(std::move(cycle));
+    }
+
+    /// Indica se a fila chegou ao limite e os transportes devem parar de ler.
+    bool full() const {
+        return queued.load() >= max_queued_cycles;
+    }
+
+    /// Recusa os ciclos que esperam espaço na fila e os que chegarem depois, para que as chamadas
+    /// terminem no encerramento.
+    void close() {
+        {
+            std::lock_guard<std::mutex> lock(waiting_mutex);
+            closed = true;
+        }
+        resume(false);
+    }
+
+    /// Retorna uma cópia da rodovia registrada com o id, que deve ser válido.
+    simulation::Highway highway(uint32_t id) {
+        std::lock_guard<std::mutex> lock(highway_mutex);
+        return highways[id - 1];
+    }
+
+    /// Retira o ciclo mais antigo, se houver. Só pode ser chamada por uma thread.
+    bool pop(IngestedCycle& cycle) {
+        if (!queue.pop(cycle))
+            return false;
+        queued.fetch_sub(1);
+        if (has_waiting.load())
+            resume(true);
+        return true;
+    }
+
+    /// Bilhete a ser obtido antes de olhar a fila e de qualquer outra condição de espera.
+    uint32_t ticket() const {
+        return queue.ticket();
+    }
+
+    /// Espera um ciclo novo ou uma chamada de `wake` feita depois do bilhete.
+    void wait(uint32_t ticket) const {
+        queue.wait(ticket);
+    }
+
+    void wake() {
+        queue.wake();
+    }
+};
+
+#endif  // INGEST_HPP_
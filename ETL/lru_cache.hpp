@@ -0,0 +1,55 @@
+#ifndef LRU_CACHE_HPP_
+#define LRU_CACHE_HPP_
+
+#include <cstddef>
+#include <list>
+#include <unordered_map>
+#include <utility>
+
+/// Cache de capacidade fixa que descarta o item usado há mais tempo. Não é thread-safe: quem o
+/// usa deve protegê-lo com o próprio mutex.
+template<typename Key, typename Value>
+class LruCache {
+    using Entry = std::pair<Key, Value>;
+
+    size_t capacity;
+    // Do usado mais recentemente para o usado há mais tempo
+    std::list<Entry> entries;
+    std::unordered_map<Key, typename std::list<Entry>::iterator> index;
+
+ public:
+    explicit LruCache(size_t capacity) : capacity(capacity) {
+        index.reserve(capacity);
+    }
+
+    /// Copia o valor para `value` e o marca como usado, se a chave estiver no cache.
+    bool get(const Key& key, Value& value) {
+        auto it = index.find(key);
+        if (it == index.end())
+            return false;
+        entries.splice(entries.begin(), entries, it->second);
+        value = it->second->second;
+        return true;
+    }
+
+    void put(const Key& key, Value value) {
+        auto it = index.find(key);
+        if (it != index.end()) {
+            it->second->second = std::move(value);
+            entries.splice(entries.begin(), entries, it->second);
+            return;
+        }
+        if (entries.size() == capacity) {
+            index.erase(entries.back().first);
+            entries.pop_back();
+        }
+        entries.emplace_front(key, std::move(value));
+        index.emplace(key, entries.begin());
+    }
+
+    size_t size() const {
+        return entries.size();
+    }
+};
+
+#endif  // LRU_CACHE_HPP_
@@ -0,0 +1,302 @@
+#ifndef MOTION_HPP_
+#define MOTION_HPP_
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define MOTION_X86 1
+#endif
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/*
+ *  Cálculo da velocidade, da aceleração e do risco de colisão dos veículos no Transform.
+ *
+ *  O ETL percorre o buffer de posições de cada veículo e junta em um lote (MotionBatch) só a
+ *  posição mais recente de cada um; as anteriores do mesmo lote, que dependem umas das outras,
+ *  passam por `motion::step`. O lote é uma estrutura de arrays contíguos, calculada por kernels
+ *  AVX2 e AVX-512 escolhidos em tempo de execução conforme a CPU, ou pelo mesmo `step` quando
+ *  nenhum está disponível.
+ *
+ *  Tolerância: velocidade e aceleração são idênticas às do caminho escalar, pois usam as mesmas
+ *  operações IEEE. O risco usa uma aproximação de exp com erro relativo abaixo de 3e-7 e difere
+ *  do escalar em no máximo 1e-6 (em valor absoluto), o que nunca muda um veículo de lado no
+ *  limiar de 0.5 exceto a menos de 1e-6 dele.
+ */
+namespace motion {
+
+// Bits de `MotionBatch::flags`, na mesma ordem dos filtros do dashboard
+static const uint8_t all_flag = 1 << 0;
+static const uint8_t risk_flag = 1 << 1;
+static const uint8_t speeding_flag = 1 << 2;
+
+/// Limiar do risco a partir do qual um veículo é considerado em risco de colisão.
+static constexpr float risk_threshold = 0.5f;
+
+/// Lote de veículos do Transform. `speed`, `acceleration` e `risk` entram com os valores
+/// anteriores de cada veículo e saem com os novos.
+struct MotionBatch {
+    // Deslocamento e ciclos decorridos entre a posição mais recente e a anterior
+    std::vector<float> displacement;
+    std::vector<float> elapsed;
+    std::vector<float> speed_limit;
+    // Termo dos veículos vizinhos somado ao argumento da sigmoide (veja spatial_index.hpp)
+    std::vector<float> proximity;
+    // Posições registradas até a mais recente, incluindo ela; 0 se o veículo não tem posição
+    // nova, e então os valores anteriores são mantidos
+    std::vector<uint32_t> seen;
+    std::vector<float> speed;
+    std::vector<float> acceleration;
+    std::vector<float> risk;
+    std::vector<uint8_t> flags;
+
+    size_t size() const {
+        return seen.size();
+    }
+
+    void resize(size_t size) {
+        displacement.resize(size);
+        elapsed.resize(size);
+        speed_limit.resize(size);
+        proximity.resize(size);
+        seen.resize(size);
+        speed.resize(size);
+        acceleration.resize(size);
+        risk.resize(size);
+        flags.resize(size);
+    }
+};
+
+/// Aplica uma posição nova de um veículo, com `seen` posições registradas até ela (incluindo
+/// ela), aos seus valores anteriores. Valores negativos indicam dados insuficientes. `proximity`
+/// aumenta o risco conforme os veículos vizinhos na posição nova.
+inline void step(uint32_t seen, float displacement, float elapsed, float speed_limit, float& speed,
+                 float& acceleration, float& risk, float proximity = 0.0f) {
+    // Efetua o cálculo da velocidade e aceleração apenas se houver mais de uma posição
+    if (seen > 1) {
+        float prev_speed = speed;
+
+        // Calcula velocidade como deslocamento dividido por tempo decorrido
+        speed = displacement / elapsed;
+        if (speed == -0.0f)
+            speed = 0.0f;
+
+        if (seen > 2) {
+            // Calcula aceleração como variação de velocidade dividida por tempo decorrido
+            acceleration = (speed - prev_speed) / elapsed;
+            if (acceleration == -0.0f)
+                acceleration = 0.0f;
+
+            if (seen > 3) {
+                float x = 3.0f * (speed + speed * std::abs(acceleration)) / speed_limit - 5.0f + proximity;
+                // Cálculo do risco de colisão usando a função sigmoide
+                risk = 1.0f / (1.0f + std::exp(-x));
+            } else {
+                risk = -1.0f;
+            }
+        } else {
+            acceleration = 0.0f;
+            risk = -1.0f;
+        }
+    // Se não há dados suficientes, define como valores negativos para que possam ser
+    // descartados facilmente na análise posterior
+    } else {
+        speed = -1.0f;
+        acceleration = 0.0f;
+        risk = -1.0f;
+    }
+}
+
+inline uint8_t flags_of(float speed, float risk, float speed_limit) {
+    return all_flag | (risk >= risk_threshold) * risk_flag | (speed > speed_limit) * speeding_flag;
+}
+
+/// Calcula [begin, end) do lote um veículo por vez, com std::exp.
+inline void compute_scalar(MotionBatch& batch, size_t begin, size_t end) {
+    for (size_t i = begin; i < end; i++) {
+        if (batch.seen[i] > 0)
+            step(batch.seen[i], batch.displacement[i], batch.elapsed[i], batch.speed_limit[i], batch.speed[i],
+                 batch.acceleration[i], batch.risk[i], batch.proximity[i]);
+        batch.flags[i] = flags_of(batch.speed[i], batch.risk[i], batch.speed_limit[i]);
+    }
+}
+
+#if defined(MOTION_X86)
+
+// Coeficientes de 2^f para f em [-0.5, 0.5] (série de Taylor de grau 6 em ln 2)
+static constexpr float exp2_coefficients[] = {1.0f, 0.69314718f, 0.24022651f, 0.055504109f,
+                                              0.0096181291f, 0.0013333558f, 0.00015403530f};
+
+/// exp(x) em 8 floats: x = n ln 2 + f ln 2, com n inteiro somado ao expoente e 2^f polinomial.
+__attribute__((target("avx2,fma"))) inline __m256 exp_avx2(__m256 x) {
+    x = _mm256_min_ps(_mm256_max_ps(x, _mm256_set1_ps(-87.0f)), _mm256_set1_ps(88.0f));
+    __m256 t = _mm256_mul_ps(x, _mm256_set1_ps(1.44269504f));
+    __m256 n = _mm256_round_ps(t, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+    __m256 f = _mm256_sub_ps(t, n);
+    __m256 p = _mm256_set1_ps(exp2_coefficients[6]);
+    for (int c = 5; c >= 0; c--)
+        p = _mm256_fmadd_ps(p, f, _mm256_set1_ps(exp2_coefficients[c]));
+    __m256i exponent = _mm256_slli_epi32(_mm256_add_epi32(_mm256_cvtps_epi32(n), _mm256_set1_epi32(127)), 23);
+    return _mm256_mul_ps(p, _mm256_castsi256_ps(exponent));
+}
+
+__attribute__((target("avx2,fma"))) inline void compute_avx2(MotionBatch& batch, size_t begin, size_t end) {
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 one = _mm256_set1_ps(1.0f);
+    const __m256 minus_one = _mm256_set1_ps(-1.0f);
+    const __m256 abs_mask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7FFFFFFF));
+    size_t i = begin;
+    for (; i + 8 <= end; i += 8) {
+        __m256i seen = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(&batch.seen[i]));
+        __m256 elapsed = _mm256_loadu_ps(&batch.elapsed[i]);
+        __m256 limit = _mm256_loadu_ps(&batch.speed_limit[i]);
+        __m256 old_speed = _mm256_loadu_ps(&batch.speed[i]);
+        __m256 old_acceleration = _mm256_loadu_ps(&batch.acceleration[i]);
+        __m256 old_risk = _mm256_loadu_ps(&batch.risk[i]);
+
+        // Somar +0 transforma -0 em +0, como as comparações do caminho escalar
+        __m256 speed = _mm256_add_ps(_mm256_div_ps(_mm256_loadu_ps(&batch.displacement[i]), elapsed), zero);
+        __m256 acceleration = _mm256_add_ps(_mm256_div_ps(_mm256_sub_ps(speed, old_speed), elapsed), zero);
+        __m256 speed_factor = _mm256_fmadd_ps(speed, _mm256_and_ps(acceleration, abs_mask), speed);
+        __m256 x = _mm256_sub_ps(_mm256_div_ps(_mm256_mul_ps(_mm256_set1_ps(3.0f), speed_factor), limit),
+                                 _mm256_set1_ps(5.0f));
+        x = _mm256_add_ps(x, _mm256_loadu_ps(&batch.proximity[i]));
+        __m256 risk = _mm256_div_ps(one, _mm256_add_ps(one, exp_avx2(_mm256_sub_ps(zero, x))));
+
+        // seen é pequeno, então a comparação com sinal basta
+        __m256 fresh = _mm256_castsi256_ps(_mm256_cmpgt_epi32(seen, _mm256_setzero_si256()));
+        __m256 moving = _mm256_castsi256_ps(_mm256_cmpgt_epi32(seen, _mm256_set1_epi32(1)));
+        __m256 accelerating = _mm256_castsi256_ps(_mm256_cmpgt_epi32(seen, _mm256_set1_epi32(2)));
+        __m256 at_risk = _mm256_castsi256_ps(_mm256_cmpgt_epi32(seen, _mm256_set1_epi32(3)));
+        speed = _mm256_blendv_ps(minus_one, speed, moving);
+        acceleration = _mm256_blendv_ps(zero, acceleration, accelerating);
+        risk = _mm256_blendv_ps(minus_one, risk, at_risk);
+        speed = _mm256_blendv_ps(old_speed, speed, fresh);
+        acceleration = _mm256_blendv_ps(old_acceleration, acceleration, fresh);
+        risk = _mm256_blendv_ps(old_risk, risk, fresh);
+        _mm256_storeu_ps(&batch.speed[i], speed);
+        _mm256_storeu_ps(&batch.acceleration[i], acceleration);
+        _mm256_storeu_ps(&batch.risk[i], risk);
+
+        // Os filtros de cada veículo em 32 bits, reduzidos a um byte por veículo
+        __m256i risk_bits = _mm256_castps_si256(_mm256_cmp_ps(risk, _mm256_set1_ps(risk_threshold), _CMP_GE_OQ));
+        __m256i speeding_bits = _mm256_castps_si256(_mm256_cmp_ps(speed, limit, _CMP_GT_OQ));
+        __m256i flags = _mm256_or_si256(_mm256_set1_epi32(all_flag),
+                                        _mm256_or_si256(_mm256_and_si256(risk_bits, _mm256_set1_epi32(risk_flag)),
+                                                        _mm256_and_si256(speeding_bits, _mm256_set1_epi32(speeding_flag))));
+        flags = _mm256_packus_epi16(_mm256_packs_epi32(flags, flags), flags);
+        flags = _mm256_permutevar8x32_epi32(flags, _mm256_setr_epi32(0, 4, 0, 0, 0, 0, 0, 0));
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(&batch.flags[i]), _mm256_castsi256_si128(flags));
+    }
+    compute_scalar(batch, i, end);
+}
+
+__attribute__((target("avx512f"))) inline __m512 exp_avx512(__m512 x) {
+    x = _mm512_min_ps(_mm512_max_ps(x, _mm512_set1_ps(-87.0f)), _mm512_set1_ps(88.0f));
+    __m512 t = _mm512_mul_ps(x, _mm512_set1_ps(1.44269504f));
+    __m512 n = _mm512_roundscale_ps(t, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+    __m512 f = _mm512_sub_ps(t, n);
+    __m512 p = _mm512_set1_ps(exp2_coefficients[6]);
+    for (int c = 5; c >= 0; c--)
+        p = _mm512_fmadd_ps(p, f, _mm512_set1_ps(exp2_coefficients[c]));
+    // 2^n sem montar o expoente à mão
+    return _mm512_scalef_ps(p, n);
+}
+
+__attribute__((target("avx512f"))) inline void compute_avx512(MotionBatch& batch, size_t begin, size_t end) {
+    const __m512 zero = _mm512_setzero_ps();
+    const __m512 one = _mm512_set1_ps(1.0f);
+    const __m512 minus_one = _mm512_set1_ps(-1.0f);
+    size_t i = begin;
+    for (; i + 16 <= end; i += 16) {
+        __m512i seen = _mm512_loadu_si512(&batch.seen[i]);
+        __m512 elapsed = _mm512_loadu_ps(&batch.elapsed[i]);
+        __m512 limit = _mm512_loadu_ps(&batch.speed_limit[i]);
+        __m512 old_speed = _mm512_loadu_ps(&batch.speed[i]);
+        __m512 old_acceleration = _mm512_loadu_ps(&batch.acceleration[i]);
+        __m512 old_risk = _mm512_loadu_ps(&batch.risk[i]);
+
+        __m512 speed = _mm512_add_ps(_mm512_div_ps(_mm512_loadu_ps(&batch.displacement[i]), elapsed), zero);
+        __m512 acceleration = _mm512_add_ps(_mm512_div_ps(_mm512_sub_ps(speed, old_speed), elapsed), zero);
+        __m512 speed_factor = _mm512_fmadd_ps(speed, _mm512_abs_ps(acceleration), speed);
+        __m512 x = _mm512_sub_ps(_mm512_div_ps(_mm512_mul_ps(_mm512_set1_ps(3.0f), speed_factor), limit),
+                                 _mm512_set1_ps(5.0f));
+        x = _mm512_add_ps(x, _mm512_loadu_ps(&batch.proximity[i]));
+        __m512 risk = _mm512_div_ps(one, _mm512_add_ps(one, exp_avx512(_mm512_sub_ps(zero, x))));
+
+        __mmask16 fresh = _mm512_cmpgt_epu32_mask(seen, _mm512_setzero_si512());
+        __mmask16 moving = _mm512_cmpgt_epu32_mask(seen, _mm512_set1_epi32(1));
+        __mmask16 accelerating = _mm512_cmpgt_epu32_mask(seen, _mm512_set1_epi32(2));
+        __mmask16 at_risk = _mm512_cmpgt_epu32_mask(seen, _mm512_set1_epi32(3));
+        speed = _mm512_mask_blend_ps(moving, minus_one, speed);
+        acceleration = _mm512_mask_blend_ps(accelerating, zero, acceleration);
+        risk = _mm512_mask_blend_ps(at_risk, minus_one, risk);
+        speed = _mm512_mask_blend_ps(fresh, old_speed, speed);
+        acceleration = _mm512_mask_blend_ps(fresh, old_acceleration, acceleration);
+        risk = _mm512_mask_blend_ps(fresh, old_risk, risk);
+        _mm512_storeu_ps(&batch.speed[i], speed);
+        _mm512_storeu_ps(&batch.acceleration[i], acceleration);
+        _mm512_storeu_ps(&batch.risk[i], risk);
+
+        __mmask16 risk_bits = _mm512_cmp_ps_mask(risk, _mm512_set1_ps(risk_threshold), _CMP_GE_OQ);
+        __mmask16 speeding_bits = _mm512_cmp_ps_mask(speed, limit, _CMP_GT_OQ);
+        __m512i flags = _mm512_set1_epi32(all_flag);
+        flags = _mm512_mask_or_epi32(flags, risk_bits, flags, _mm512_set1_epi32(risk_flag));
+        flags = _mm512_mask_or_epi32(flags, speeding_bits, flags, _mm512_set1_epi32(speeding_flag));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(&batch.flags[i]), _mm512_cvtepi32_epi8(flags));
+    }
+    compute_avx2(batch, i, end);
+}
+
+#endif  // MOTION_X86
+
+enum class Kernel {
+    SCALAR,
+    AVX2,
+    AVX512,
+};
+
+/// O kernel mais largo suportado pela CPU em que o programa está rodando.
+inline Kernel best_kernel() {
+#if defined(MOTION_X86)
+    static const Kernel best = [] {
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+            return Kernel::AVX512;
+        if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+            return Kernel::AVX2;
+        return Kernel::SCALAR;
+    }();
+    return best;
+#else
+    return Kernel::SCALAR;
+#endif
+}
+
+inline const char* kernel_name(Kernel kernel) {
+    switch (kernel) {
+        case Kernel::AVX512:
+            return "AVX-512";
+        case Kernel::AVX2:
+            return "AVX2";
+        default:
+            return "escalar";
+    }
+}
+
+/// Calcula todo o lote com o kernel dado. Kernels não suportados pela CPU não podem ser pedidos.
+inline void compute(MotionBatch& batch, Kernel kernel = best_kernel()) {
+#if defined(MOTION_X86)
+    if (kernel == Kernel::AVX512)
+        return compute_avx512(batch, 0, batch.size());
+    if (kernel == Kernel::AVX2)
+        return compute_avx2(batch, 0, batch.size());
+#endif
+    compute_scalar(batch, 0, batch.size());
+}
+
+}  // namespace motion
+
+#endif  // MOTION_HPP_
@@ -0,0 +1,81 @@
+#ifndef MPSC_QUEUE_HPP_
+#define MPSC_QUEUE_HPP_
+
+#include <atomic>
+#include <cstdint>
+#include <utility>
+
+/// Fila sem locks com vários produtores e um único consumidor (algoritmo de Vyukov). Cada
+/// `push` é uma troca atômica no início da lista, então as threads do gRPC nunca disputam um
+/// mutex, e o consumidor retira do fim sem nenhuma operação atômica de escrita.
+///
+/// O consumidor dorme com `wait` em um contador que os produtores incrementam, e não em um
+/// tempo limite: ele pega um bilhete com `ticket`, tenta `pop` e, se a fila estiver vazia,
+/// espera até que alguém chame `wake` depois do bilhete.
+template<typename T>
+class MpscQueue {
+    struct Node {
+        std::atomic<Node*> next{nullptr};
+        T value;
+    };
+
+    // Último nó inserido, disputado pelos produtores
+    alignas(64) std::atomic<Node*> head;
+    // Nó já consumido que precede o próximo a ser retirado, usado só pelo consumidor
+    alignas(64) Node* tail;
+    alignas(64) std::atomic<uint32_t> signal{0};
+
+ public:
+    MpscQueue() {
+        tail = new Node();
+        head.store(tail, std::memory_order_relaxed);
+    }
+
+    ~MpscQueue() {
+        while (Node* next = tail->next.load(std::memory_order_relaxed)) {
+            delete tail;
+            tail = next;
+        }
+        delete tail;
+    }
+
+    MpscQueue(const MpscQueue&) = delete;
+    MpscQueue& operator=(const MpscQueue&) = delete;
+
+    void push(T&& value) {
+        Node* node = new Node();
+        node->value = std::move(value);
+        Node* prev = head.exchange(node, std::memory_order_acq_rel);
+        prev->next.store(node, std::memory_order_release);
+        wake();
+    }
+
+    /// Retira o item mais antigo. Pode falhar por um instante enquanto um produtor termina de
+    /// ligar o seu nó, mas esse produtor chama `wake` em seguida.
+    bool pop(T& value) {
+        Node* next = tail->next.load(std::memory_order_acquire);
+        if (!next)
+            return false;
+        value = std::move(next->value);
+        delete tail;
+        tail = next;
+        return true;
+    }
+
+    uint32_t ticket() const {
+        return signal.load(std::memory_order_acquire);
+    }
+
+    /// Espera até que `wake` seja chamada depois de o bilhete ter sido obtido.
+    void wait(uint32_t ticket) const {
+        signal.wait(ticket, std::memory_order_acquire);
+    }
+
+    /// Acorda o consumidor, seja por um item novo ou por outro motivo (como o encerramento).
+    void wake() {
+        signal.fetch_add(1, std::memory_order_release);
+        signal.notify_one();
+    }
+};
+
+#endif  // MPSC_QUEUE_HPP_
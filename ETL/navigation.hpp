@@ -0,0 +1,126 @@
+#ifndef NAVIGATION_HPP_
+#define NAVIGATION_HPP_
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+/*
+ *  Índices usados na navegação do dashboard. Cada worker do Transform monta, para cada filtro, a
+ *  lista dos ids que satisfazem o filtro no lote, e um heap com os veículos de maior risco. No fim
+ *  do lote as listas são publicadas sem cópia em um `SegmentedIndex`, que acessa o n-ésimo veículo
+ *  do filtro em O(log workers) pelas posições iniciais de cada lista, e os heaps são juntados em um
+ *  só. O dashboard não precisa percorrer os veículos para avançar, voltar, saltar ou contar.
+ */
+namespace navigation {
+
+// Número de veículos na lista dos maiores riscos
+static const int top_k = 10;
+
+/// Sequência formada pelas listas de cada worker, em ordem.
+template<typename T = uint32_t>
+class SegmentedIndex {
+    std::vector<std::vector<T>> parts;
+    // Posição da primeira entrada de cada lista, com o total no fim
+    std::vector<size_t> offsets{0};
+
+ public:
+    /// Lista do worker `p`, que pode ser trocada (std::swap) pela do lote novo. Depois das trocas,
+    /// `update` recalcula as posições.
+    std::vector<T>& part(size_t p) {
+        if (p >= parts.size())
+            parts.resize(p + 1);
+        return parts[p];
+    }
+
+    const std::vector<T>& part(size_t p) const {
+        return parts[p];
+    }
+
+    void update() {
+        offsets.resize(parts.size() + 1);
+        for (size_t p = 0; p < parts.size(); p++)
+            offsets[p + 1] = offsets[p] + parts[p].size();
+    }
+
+    size_t num_parts() const {
+        return parts.size();
+    }
+
+    size_t size() const {
+        return offsets.back();
+    }
+
+    bool empty() const {
+        return size() == 0;
+    }
+
+    /// Lista e posição nela da n-ésima entrada, começando em 0, em O(log workers). As listas
+    /// vazias têm a mesma posição inicial da seguinte, então a busca sempre cai em uma lista com a
+    /// posição pedida.
+    std::pair<size_t, size_t> locate(size_t n) const {
+        size_t p = std::upper_bound(offsets.begin() + 1, offsets.end(), n) - offsets.begin() - 1;
+        return {p, n - offsets[p]};
+    }
+
+    const T& operator[](size_t n) const {
+        auto [p, k] = locate(n);
+        return parts[p][k];
+    }
+};
+
+/// Veículo com a sua prioridade em `TopK`.
+struct Ranked {
+    float score;
+    uint32_t id;
+};
+
+/// Os `k` veículos de maior prioridade vistos, mantidos em um heap de mínimo: um veículo que não
+/// entra na lista custa uma comparação, e um que entra, O(log k).
+class TopK {
+    std::vector<Ranked> heap;
+    size_t k;
+
+    // O topo do heap é o menor, que sai primeiro
+    static bool greater(const Ranked& a, const Ranked& b) {
+        return a.score > b.score || (a.score == b.score && a.id < b.id);
+    }
+
+ public:
+    explicit TopK(size_t k = top_k) : k(k) {
+        heap.reserve(k);
+    }
+
+    void clear() {
+        heap.clear();
+    }
+
+    void offer(float score, uint32_t id) {
+        if (heap.size() < k) {
+            heap.push_back({score, id});
+            std::push_heap(heap.begin(), heap.end(), greater);
+        } else if (k > 0 && greater({score, id}, heap.front())) {
+            std::pop_heap(heap.begin(), heap.end(), greater);
+            heap.back() = {score, id};
+            std::push_heap(heap.begin(), heap.end(), greater);
+        }
+    }
+
+    void merge(const TopK& other) {
+        for (const Ranked& entry : other.heap)
+            offer(entry.score, entry.id);
+    }
+
+    /// Veículos em ordem decrescente de prioridade.
+    std::vector<Ranked> sorted() const {
+        std::vector<Ranked> result = heap;
+        std::sort(result.begin(), result.end(), greater);
+        return result;
+    }
+};
+
+}  // namespace navigation
+
+#endif  // NAVIGATION_HPP_
@@ -0,0 +1,83 @@
+#ifndef PIPELINE_HPP_
+#define PIPELINE_HPP_
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+
+/// Fila limitada que liga duas etapas do pipeline. Quem produz espera quando a fila está cheia,
+/// o que impede uma etapa rápida de acumular trabalho na frente de uma lenta, e quem consome
+/// espera quando ela está vazia. Depois de `close`, os itens restantes ainda podem ser retirados.
+template<typename T>
+class BoundedQueue {
+    std::deque<T> items;
+    size_t capacity;
+    std::mutex mutex;
+    std::condition_variable not_empty;
+    std::condition_variable not_full;
+    bool closed = false;
+
+ public:
+    explicit BoundedQueue(size_t capacity) : capacity(capacity) {}
+
+    BoundedQueue(const BoundedQueue&) = delete;
+    BoundedQueue& operator=(const BoundedQueue&) = delete;
+
+    /// Espera haver espaço na fila. Retorna false, sem mover o item, se a fila foi fechada.
+    bool push(T&& item) {
+        std::unique_lock<std::mutex> lock(mutex);
+        not_full.wait(lock, [this] { return closed || items.size() < capacity; });
+        if (closed)
+            return false;
+        items.push_back(std::move(item));
+        lock.unlock();
+        not_empty.notify_one();
+        return true;
+    }
+
+    /// Adiciona o item somente se houver espaço, sem esperar. Se falhar, o item não é movido.
+    bool try_push(T& item) {
+        std::unique_lock<std::mutex> lock(mutex);
+        if (closed || items.size() >= capacity)
+            return false;
+        items.push_back(std::move(item));
+        lock.unlock();
+        not_empty.notify_one();
+        return true;
+    }
+
+    /// Espera um item. Retorna false quando a fila foi fechada e não há mais itens.
+    bool pop(T& item) {
+        std::unique_lock<std::mutex> lock(mutex);
+        not_empty.wait(lock, [this] { return closed || !items.empty(); });
+        if (items.empty())
+            return false;
+        item = std::move(items.front());
+        items.pop_front();
+        lock.unlock();
+        not_full.notify_one();
+        return true;
+    }
+
+    void close() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            closed = true;
+        }
+        not_empty.notify_all();
+        not_full.notify_all();
+    }
+
+    size_t size() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return items.size();
+    }
+
+    /// Se a fila não está cheia e só há um produtor, o próximo `push` dele não espera.
+    bool full() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return items.size() >= capacity;
+    }
+};
+
+#endif  // PIPELINE_HPP_
@@ -0,0 +1,375 @@
+#ifndef QUERY_HPP_
+#define QUERY_HPP_
+
+#ifndef GRPC_CALLBACK_API_NONEXPERIMENTAL
+#define GRPC_CALLBACK_API_NONEXPERIMENTAL
+#endif
+
+#include <grpcpp/grpcpp.h>
+
+#include <algorithm>
+#include <cctype>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "./batch_snapshot.hpp"
+#include "./conversions.hpp"
+#include "./external.hpp"
+#include "./rules.hpp"
+#include "./snapshot.hpp"
+#include "proto/simulation.grpc.pb.h"
+
+/// Consultas dos dashboards externos pela API de callbacks do gRPC, lidas dos lotes publicados
+/// pelo ETL sem bloquear o pipeline. `QueryVehicles` devolve uma página dos veículos de um filtro
+/// no último lote, ou o veículo de uma placa. `Subscribe` envia uma mensagem por lote com os
+/// contadores, as latências e só os veículos acompanhados pela chamada que mudaram ou saíram do
+/// filtro, então o cliente nunca baixa de novo o que já tem.
+///
+/// As mensagens de uma chamada são montadas por uma thread do serviço, avisada quando o lote é
+/// publicado, se a anterior já foi enviada, ou quando o envio dela termina. O ETL só acorda essa
+/// thread, então o custo das assinaturas não entra na latência do pipeline. Um cliente lento não
+/// acumula mensagens: recebe o lote mais recente, marcado com `reset` se algum foi pulado.
+class QueryService final : public simulation::QueryService::CallbackService {
+    static const uint32_t default_page_size = 100;
+    static const uint32_t max_page_size = 1000;
+    static const uint32_t default_subscription_limit = 1000;
+    static const uint32_t max_subscription_limit = 10000;
+
+ public:
+    /// Acesso aos dados do ETL que ficam fora do lote publicado.
+    struct Resolver {
+        // Dados do veículo da placa no lote, ou nullptr se ela não está no registro ou no lote
+        std::function<const VehicleView*(const BatchSnapshot&, const Plate&)> find_plate;
+        // Informações do serviço externo do veículo, com `year` negativo se ainda não chegaram
+        std::function<OwnerInfo(const VehicleView&)> owner;
+    };
+
+ private:
+    using SnapshotReader = snapshot::Publisher<BatchSnapshot>::Reader;
+
+    /// Chamada de `Subscribe`. Acompanha até `limit` veículos do filtro: os que já foram enviados
+    /// são reenviados quando computados de novo no filtro, e os que saem dele ou do registro vão
+    /// para `removed`; as vagas que sobram recebem os próximos veículos do filtro.
+    class Subscription final : public grpc::ServerWriteReactor<simulation::BatchUpdate> {
+        QueryService& service;
+        int filter;
+        size_t limit;
+        std::mutex mutex;
+        simulation::BatchUpdate update;
+        // Há uma mensagem sendo enviada, um lote ainda não enviado, ou a chamada deve terminar
+        bool writing = false;
+        bool pending = true;
+        bool finishing = false;
+        bool finished = false;
+        int64_t last_batch = -1;
+        // Veículos acompanhados e o código da placa enviada, que confirma que o id não mudou de dono
+        std::unordered_map<uint32_t, uint64_t> sent;
+
+        void finish(const grpc::Status& status) {
+            if (!finished) {
+                finished = true;
+                Finish(status);
+            }
+        }
+
+        /// Envia o lote mais recente, se for novo. Chamada com o mutex e sem envio em andamento.
+        void write_next() {
+            SnapshotReader snapshot = service.snapshots.read();
+            pending = false;
+            if (!snapshot || snapshot->batch == last_batch)
+                return;
+            build(*snapshot);
+            writing = true;
+            StartWrite(&update);
+        }
+
+        void build(const BatchSnapshot& batch) {
+            update.Clear();
+            update.set_batch(batch.batch);
+            bool reset = last_batch < 0 || batch.batch != last_batch + 1;
+            update.set_reset(reset);
+            last_batch = batch.batch;
+            service.fill_counters(batch, update);
+            if (reset) {
+                sent.clear();
+            } else {
+                // Os ids removidos podem voltar com outra placa no próximo lote, então saem antes
+                for (uint32_t id : batch.evicted) {
+                    auto it = sent.find(id);
+                    if (it != sent.end()) {
+                        update.add_removed(Plate(it->second).plate);
+                        sent.erase(it);
+                    }
+                }
+                // Os que não foram computados no lote não mudaram e continuam com o cliente
+                for (auto it = sent.begin(); it != sent.end();) {
+                    const VehicleView* view = batch.find(it->first);
+                    if (!view || view->plate.code() != it->second) {
+                        ++it;
+                    } else if (view->flags >> filter & 1) {
+                        service.fill_vehicle(batch, *view, update.add_changed());
+                        ++it;
+                    } else {
+                        update.add_removed(view->plate.plate);
+                        it = sent.erase(it);
+                    }
+                }
+            }
+            size_t size = batch.size(filter);
+            for (size_t n = 0; n < size && sent.size() < limit; n++) {
+                const VehicleView& view = batch.at(filter, n);
+                if (sent.emplace(view.id, view.plate.code()).second)
+                    service.fill_vehicle(batch, view, update.add_changed());
+            }
+        }
+
+     public:
+        Subscription(QueryService& service, int filter, size_t limit) :
+                service(service), filter(filter), limit(limit) {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!service.add(this)) {
+                finish(grpc::Status(grpc::StatusCode::UNAVAILABLE, "Servidor encerrando."));
+                return;
+            }
+            write_next();
+        }
+
+        /// Avisa que um lote foi publicado. Chamada pela thread de avisos do serviço.
+        void notify() {
+            std::lock_guard<std::mutex> lock(mutex);
+            pending = true;
+            if (!writing && !finishing)
+                write_next();
+        }
+
+        /// Termina a chamada depois da mensagem em andamento.
+        void close() {
+            std::lock_guard<std::mutex> lock(mutex);
+            finishing = true;
+            if (!writing)
+                finish(grpc::Status::OK);
+        }
+
+        void OnWriteDone(bool ok) override {
+            std::lock_guard<std::mutex> lock(mutex);
+            writing = false;
+            // O cliente foi embora ou a chamada foi cancelada
+            if (!ok)
+                finishing = true;
+            if (finishing)
+                finish(grpc::Status::OK);
+            else if (pending)
+                write_next();
+        }
+
+        void OnCancel() override {
+            std::lock_guard<std::mutex> lock(mutex);
+            finishing = true;
+            if (!writing)
+                finish(grpc::Status::CANCELLED);
+        }
+
+        void OnDone() override {
+            service.remove(this);
+            delete this;
+        }
+    };
+
+    snapshot::Publisher<BatchSnapshot>& snapshots;
+    Resolver resolver;
+    std::vector<rules::FilterInfo> filters;
+    // Chamadas de `Subscribe` em andamento. O mutex também impede que uma seja destruída enquanto
+    // o ETL a avisa de um lote
+    std::mutex subscriptions_mutex;
+    std::unordered_set<Subscription*> subscriptions;
+    bool closed = false;
+    // Thread que avisa as chamadas de `Subscribe` dos lotes publicados. Lotes publicados enquanto
+    // ela ainda avisa do anterior são avisados de uma vez
+    std::mutex notifier_mutex;
+    std::condition_variable notifier_cv;
+    bool published = false;
+    bool stopping = false;
+    std::thread notifier;
+
+    void notifier_loop() {
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lock(notifier_mutex);
+                notifier_cv.wait(lock, [this] { return published || stopping; });
+                if (stopping)
+                    return;
+                published = false;
+            }
+            std::lock_guard<std::mutex> lock(subscriptions_mutex);
+            for (Subscription* subscription : subscriptions)
+                subscription->notify();
+        }
+    }
+
+    void stop_notifier() {
+        {
+            std::lock_guard<std::mutex> lock(notifier_mutex);
+            stopping = true;
+        }
+        notifier_cv.notify_one();
+    }
+
+    bool add(Subscription* subscription) {
+        std::lock_guard<std::mutex> lock(subscriptions_mutex);
+        if (closed)
+            return false;
+        subscriptions.insert(subscription);
+        return true;
+    }
+
+    void remove(Subscription* subscription) {
+        std::lock_guard<std::mutex> lock(subscriptions_mutex);
+        subscriptions.erase(subscription);
+    }
+
+    bool valid_filter(uint32_t filter) const {
+        return filter < filters.size();
+    }
+
+    static grpc::Status unknown_filter() {
+        return grpc::Status(grpc::StatusCode::INVALID_ARGUMENT, "Filtro inexistente.");
+    }
+
+    void fill_vehicle(const BatchSnapshot& batch, const VehicleView& view, simulation::VehicleData* data) const {
+        data->set_plate(view.plate.plate);
+        if (view.highway_index >= 0 && view.highway_index < batch.highways.size())
+            data->set_highway(batch.highways[view.highway_index].name);
+        data->set_lane(view.lane);
+        data->set_distance(view.distance);
+        data->set_speed(view.speed);
+        data->set_acceleration(view.acceleration);
+        data->set_risk(view.risk);
+        data->set_gap(view.gap);
+        data->set_ttc(view.ttc);
+        data->set_flags(view.flags);
+        OwnerInfo owner = resolver.owner(view);
+        data->set_owner(std::move(owner.name));
+        data->set_model(std::move(owner.model));
+        data->set_year(owner.year);
+    }
+
+    void fill_counters(const BatchSnapshot& batch, simulation::BatchUpdate& update) const {
+        for (int f = 0; f < filters.size(); f++) {
+            simulation::FilterCount* count = update.add_filters();
+            count->set_name(filters[f].name);
+            count->set_key(std::string(1, filters[f].key));
+            count->set_batch_count(batch.size(f));
+            count->set_registered(batch.registered[f]);
+        }
+        for (const HighwayView& highway : batch.highways) {
+            simulation::HighwayLatency* latency = update.add_latencies();
+            latency->set_name(highway.name);
+            latency->set_seconds(highway.time_elapsed);
+        }
+        update.set_dropped_cycles(batch.dropped_cycles);
+    }
+
+ public:
+    QueryService(snapshot::Publisher<BatchSnapshot>& snapshots, Resolver resolver) :
+            snapshots(snapshots), resolver(std::move(resolver)) {
+        notifier = std::thread(&QueryService::notifier_loop, this);
+    }
+
+    ~QueryService() {
+        stop_notifier();
+        notifier.join();
+    }
+
+    QueryService(const QueryService&) = delete;
+    QueryService& operator=(const QueryService&) = delete;
+
+    /// Filtros das regras ativas, na ordem do dashboard. Deve ser chamada antes de o servidor
+    /// iniciar.
+    void set_filters(const std::vector<rules::FilterInfo>& filters) {
+        this->filters = filters;
+    }
+
+    grpc::ServerUnaryReactor* QueryVehicles(grpc::CallbackServerContext* context,
+                                            const simulation::VehicleQuery* query,
+                                            simulation::VehiclePage* page) override {
+        grpc::ServerUnaryReactor* reactor = context->DefaultReactor();
+        if (query->plate().empty() && !valid_filter(query->filter())) {
+            reactor->Finish(unknown_filter());
+            return reactor;
+        }
+        SnapshotReader snapshot = snapshots.read();
+        if (!snapshot) {
+            reactor->Finish(grpc::Status::OK);
+            return reactor;
+        }
+        const BatchSnapshot& batch = *snapshot;
+        page->set_batch(batch.batch);
+        if (!query->plate().empty()) {
+            std::string symbols = query->plate();
+            for (char& symbol : symbols)
+                symbol = static_cast<char>(std::toupper(static_cast<unsigned char>(symbol)));
+            const VehicleView* view = resolver.find_plate(batch, Plate(symbols.c_str(), symbols.size()));
+            page->set_total(view ? 1 : 0);
+            if (view)
+                fill_vehicle(batch, *view, page->add_vehicles());
+        } else {
+            size_t total = batch.size(query->filter());
+            uint32_t limit = query->limit() ? std::min(query->limit(), max_page_size) : default_page_size;
+            page->set_total(total);
+            for (size_t n = query->offset(); n < total && n < size_t(query->offset()) + limit; n++)
+                fill_vehicle(batch, batch.at(query->filter(), n), page->add_vehicles());
+        }
+        reactor->Finish(grpc::Status::OK);
+        return reactor;
+    }
+
+    grpc::ServerWriteReactor<simulation::BatchUpdate>* Subscribe(grpc::CallbackServerContext* context,
+                                                                const simulation::SubscribeRequest* request) override {
+        if (!valid_filter(request->filter())) {
+            // Uma chamada de streaming precisa de um reactor mesmo para terminar com erro
+            class Rejected final : public grpc::ServerWriteReactor<simulation::BatchUpdate> {
+             public:
+                Rejected() {
+                    Finish(unknown_filter());
+                }
+
+                void OnDone() override {
+                    delete this;
+                }
+            };
+            return new Rejected();
+        }
+        uint32_t limit = request->limit() ? std::min(request->limit(), max_subscription_limit) :
+                                            default_subscription_limit;
+        return new Subscription(*this, request->filter(), limit);
+    }
+
+    /// Avisa as chamadas de `Subscribe` de que um lote foi publicado. Só acorda a thread de avisos,
+    /// que monta as mensagens fora da thread de quem publicou.
+    void notify() {
+        {
+            std::lock_guard<std::mutex> lock(notifier_mutex);
+            published = true;
+        }
+        notifier_cv.notify_one();
+    }
+
+    /// Termina as chamadas de `Subscribe` e recusa as novas, para que o servidor possa encerrar sem
+    /// esperar o prazo.
+    void shutdown() {
+        stop_notifier();
+        std::lock_guard<std::mutex> lock(subscriptions_mutex);
+        closed = true;
+        for (Subscription* subscription : subscriptions)
+            subscription->close();
+    }
+};
+
+#endif  // QUERY_HPP_
@@ -0,0 +1,239 @@
+#ifndef REGISTRY_HPP_
+#define REGISTRY_HPP_
+
+#include <atomic>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "./conversions.hpp"
+
+/// Registro concorrente que associa o código de cada placa (ver `plate_code`) a um id denso. Os dados são divididos
+/// em shards, cada um com uma tabela de endereçamento aberto e sondagem linear. Buscas não usam
+/// locks e terminam em um número limitado de passos; inserções travam apenas o shard da placa.
+/// Os ids são atribuídos em sequência e reaproveitados depois que uma placa é removida, então
+/// podem indexar diretamente vetores com o estado dos veículos e as etapas seguintes do ETL não
+/// precisam calcular o hash de novo.
+class VehicleRegistry {
+ public:
+    static const uint32_t no_id = std::numeric_limits<uint32_t>::max();
+
+ private:
+    static const int shard_bits = 6;
+    static const int num_shards = 1 << shard_bits;
+    // Chave reservada para as posições vazias, pois só a placa sem nenhum símbolo tem código 0
+    static const uint64_t empty_key = 0;
+    // Marca posições de placas removidas, que não interrompem a sondagem das buscas
+    static const uint64_t tombstone_key = std::numeric_limits<uint64_t>::max();
+
+    struct Slot {
+        std::atomic<uint64_t> key{empty_key};
+        std::atomic<uint32_t> id{no_id};
+    };
+
+    struct Table {
+        size_t mask;
+        std::unique_ptr<Slot[]> slots;
+
+        explicit Table(size_t capacity) : mask(capacity - 1), slots(new Slot[capacity]) {}
+    };
+
+    struct Shard {
+        std::atomic<Table*> table{nullptr};
+        // Serializa as inserções do shard; as buscas nunca o usam
+        std::mutex mutex;
+        size_t size = 0;
+        // Posições ocupadas, incluindo as marcadas como removidas
+        size_t used = 0;
+        std::unique_ptr<Table> owner;
+        // Tabelas substituídas no crescimento que ainda podem estar sendo lidas
+        std::vector<std::unique_ptr<Table>> retired;
+    };
+
+    std::unique_ptr<Shard[]> shards;
+    std::atomic<uint32_t> next_id{0};
+    std::atomic<uint32_t> live{0};
+    // Ids de placas removidas, reaproveitados antes de criar novos
+    std::vector<uint32_t> free_ids;
+    std::mutex free_mutex;
+
+    static uint64_t hash(uint64_t key) {
+        return plate_code::mix(key);
+    }
+
+    Shard& shard_of(uint64_t h) const {
+        return shards[h & (num_shards - 1)];
+    }
+
+    static uint32_t find_in(const Table* table, uint64_t key, uint64_t h) {
+        size_t i = (h >> shard_bits) & table->mask;
+        for (size_t probes = 0; probes <= table->mask; probes++, i = (i + 1) & table->mask) {
+            uint64_t current = table->slots[i].key.load(std::memory_order_acquire);
+            if (current == key)
+                return table->slots[i].id.load(std::memory_order_relaxed);
+            if (current == empty_key)
+                return no_id;
+        }
+        return no_id;
+    }
+
+    uint32_t new_id() {
+        std::lock_guard<std::mutex> lock(free_mutex);
+        if (free_ids.empty())
+            return next_id++;
+        uint32_t id = free_ids.back();
+        free_ids.pop_back();
+        return id;
+    }
+
+    /// Escreve a chave na primeira posição livre. Retorna true se ela estava vazia, e não apenas
+    /// marcada como removida.
+    static bool place(Table* table, uint64_t key, uint64_t h, uint32_t id) {
+        size_t i = (h >> shard_bits) & table->mask;
+        uint64_t current;
+        while ((current = table->slots[i].key.load(std::memory_order_relaxed)) != empty_key
+                && current != tombstone_key)
+            i = (i + 1) & table->mask;
+        // O id é publicado antes da chave, então quem enxerga a chave enxerga o id
+        table->slots[i].id.store(id, std::memory_order_relaxed);
+        table->slots[i].key.store(key, std::memory_order_release);
+        return current == empty_key;
+    }
+
+    /// Reconstrói a tabela de um único shard, sem parar as buscas nem os outros shards. Ela só
+    /// dobra de tamanho se as placas vivas ocuparem mais de 1/4 dela; caso contrário, apenas
+    /// descarta as marcas de remoção.
+    void grow(Shard& shard) {
+        Table* old = shard.owner.get();
+        size_t capacity = old->mask + 1;
+        if ((shard.size + 1) * 4 > capacity)
+            capacity *= 2;
+        auto table = std::make_unique<Table>(capacity);
+        for (size_t i = 0; i <= old->mask; i++) {
+            uint64_t key = old->slots[i].key.load(std::memory_order_relaxed);
+            if (key != empty_key && key != tombstone_key)
+                place(table.get(), key, hash(key), old->slots[i].id.load(std::memory_order_relaxed));
+        }
+        shard.used = shard.size;
+        shard.table.store(table.get(), std::memory_order_release);
+        shard.retired.push_back(std::move(shard.owner));
+        shard.owner = std::move(table);
+    }
+
+ public:
+    /// @param capacity Número aproximado de veículos esperados, dividido entre os shards.
+    explicit VehicleRegistry(size_t capacity = 4096) : shards(new Shard[num_shards]) {
+        size_t per_shard = 16;
+        while (per_shard * num_shards < capacity * 2)
+            per_shard *= 2;
+        for (int i = 0; i < num_shards; i++) {
+            shards[i].owner = std::make_unique<Table>(per_shard);
+            shards[i].table.store(shards[i].owner.get(), std::memory_order_release);
+        }
+    }
+
+    /// Converte a placa no código usado como chave pelo registro.
+    static uint64_t key_of(std::string_view plate) {
+        return plate_code::encode(plate.data(), plate.size());
+    }
+
+    /// Retorna o id da placa com o código dado ou `no_id` se ela não estiver registrada. Não usa
+    /// locks.
+    uint32_t find(uint64_t key) const {
+        uint64_t h = hash(key);
+        const Shard& shard = shard_of(h);
+        return find_in(shard.table.load(std::memory_order_acquire), key, h);
+    }
+
+    uint32_t find(std::string_view plate) const {
+        return find(key_of(plate));
+    }
+
+    /// @brief Retorna o id da placa com o código dado, registrando-a se necessário.
+    /// @param on_insert Chamada com o novo id antes que ele fique visível para outras threads,
+    ///        para que os vetores indexados por ele sejam preparados.
+    /// @return O id e um booleano indicando se a placa é nova.
+    template<typename OnInsert>
+    std::pair<uint32_t, bool> find_or_insert(uint64_t key, OnInsert&& on_insert) {
+        uint64_t h = hash(key);
+        Shard& shard = shard_of(h);
+        uint32_t id = find_in(shard.table.load(std::memory_order_acquire), key, h);
+        if (id != no_id)
+            return {id, false};
+
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        // Outra thread pode ter inserido a mesma placa enquanto esperávamos o lock
+        id = find_in(shard.owner.get(), key, h);
+        if (id != no_id)
+            return {id, false};
+        // Mantém o fator de carga abaixo de 1/2 para que as sondagens continuem curtas
+        if ((shard.used + 1) * 2 > shard.owner->mask + 1)
+            grow(shard);
+        id = new_id();
+        on_insert(id);
+        shard.used += place(shard.owner.get(), key, h, id);
+        shard.size++;
+        live++;
+        return {id, true};
+    }
+
+    template<typename OnInsert>
+    std::pair<uint32_t, bool> find_or_insert(std::string_view plate, OnInsert&& on_insert) {
+        return find_or_insert(key_of(plate), std::forward<OnInsert>(on_insert));
+    }
+
+    /// Remove a placa com o código dado e libera seu id para ser reaproveitado. Não pode ser
+    /// chamada enquanto outras threads buscam a mesma placa ou ainda usam o id, como durante o
+    /// Extract.
+    bool erase(uint64_t key) {
+        uint64_t h = hash(key);
+        Shard& shard = shard_of(h);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        Table* table = shard.owner.get();
+        size_t i = (h >> shard_bits) & table->mask;
+        for (size_t probes = 0; probes <= table->mask; probes++, i = (i + 1) & table->mask) {
+            uint64_t current = table->slots[i].key.load(std::memory_order_relaxed);
+            if (current == empty_key)
+                return false;
+            if (current != key)
+                continue;
+            uint32_t id = table->slots[i].id.load(std::memory_order_relaxed);
+            table->slots[i].key.store(tombstone_key, std::memory_order_release);
+            shard.size--;
+            live--;
+            std::lock_guard<std::mutex> free_lock(free_mutex);
+            free_ids.push_back(id);
+            return true;
+        }
+        return false;
+    }
+
+    bool erase(std::string_view plate) {
+        return erase(key_of(plate));
+    }
+
+    /// Número de placas registradas atualmente.
+    uint32_t size() const {
+        return live;
+    }
+
+    /// Limite superior dos ids já atribuídos, incluindo os que estão livres.
+    uint32_t id_limit() const {
+        return next_id;
+    }
+
+    /// Libera as tabelas antigas. Só pode ser chamada quando nenhuma busca estiver em andamento,
+    /// como entre um lote e outro do ETL.
+    void collect() {
+        for (int i = 0; i < num_shards; i++) {
+            std::lock_guard<std::mutex> lock(shards[i].mutex);
+            shards[i].retired.clear();
+        }
+    }
+};
+
+#endif  // REGISTRY_HPP_
@@ -0,0 +1,79 @@
+#ifndef RING_BUFFER_HPP_
+#define RING_BUFFER_HPP_
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+
+/// Buffer circular de capacidade fixa que guarda apenas os valores mais recentes. A memória é
+/// alocada uma única vez em `reset`, e cada `push` com o buffer cheio sobrescreve o mais antigo.
+template<typename T>
+class RingBuffer {
+    std::unique_ptr<T[]> data;
+    uint32_t capacity_ = 0;
+    // Posição em que o próximo valor será escrito
+    uint32_t head = 0;
+    // Número de valores adicionados desde o último `reset`, incluindo os sobrescritos
+    uint64_t count = 0;
+
+ public:
+    RingBuffer() = default;
+
+    explicit RingBuffer(uint32_t capacity) {
+        reset(capacity);
+    }
+
+    /// Descarta o conteúdo e define uma nova capacidade. Com capacidade 0, libera a memória.
+    void reset(uint32_t capacity) {
+        if (capacity != capacity_)
+            data.reset(capacity ? new T[capacity]() : nullptr);
+        capacity_ = capacity;
+        head = 0;
+        count = 0;
+    }
+
+    void push(const T& value) {
+        data[head] = value;
+        head = head + 1 == capacity_ ? 0 : head + 1;
+        count++;
+    }
+
+    uint32_t capacity() const {
+        return capacity_;
+    }
+
+    uint32_t size() const {
+        return std::min<uint64_t>(count, capacity_);
+    }
+
+    bool empty() const {
+        return count == 0;
+    }
+
+    bool full() const {
+        return count >= capacity_;
+    }
+
+    /// Número total de valores já adicionados, mesmo os que não estão mais no buffer.
+    uint64_t total() const {
+        return count;
+    }
+
+    /// Retorna o k-ésimo valor mais recente, sendo `back(0)` o último adicionado.
+    const T& back(uint32_t k = 0) const {
+        uint32_t i = head >= k + 1 ? head - k - 1 : head + capacity_ - k - 1;
+        return data[i];
+    }
+
+    /// Retorna o valor mais antigo, que é o próximo a ser sobrescrito quando o buffer está cheio.
+    const T& front() const {
+        return (*this)[0];
+    }
+
+    /// Acessa os valores guardados do mais antigo (0) para o mais recente (size() - 1).
+    const T& operator[](uint32_t i) const {
+        return back(size() - 1 - i);
+    }
+};
+
+#endif  // RING_BUFFER_HPP_
@@ -0,0 +1,281 @@
+#ifndef RULES_HPP_
+#define RULES_HPP_
+
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <unordered_map>
+#include <utility>
+#include <variant>
+#include <vector>
+
+#include "./motion.hpp"
+
+/*
+ *  Regras de alerta do Transform. Cada regra é um tipo com um nome, uma tecla do dashboard, um
+ *  peso na prioridade do serviço externo e um operador que diz se um veículo a satisfaz. Um
+ *  `RuleSet` junta as regras em tempo de compilação: a avaliação de todas é expandida no laço do
+ *  Transform, sem chamadas virtuais, no mesmo passo que escreve o estado de cada veículo.
+ *
+ *  Cada regra ativa vira um filtro do dashboard e um contador, no bit `1 + posição` das flags do
+ *  veículo; o bit 0 é o filtro de todos os veículos. O conjunto ativo é escolhido entre os
+ *  compilados em `ActiveRules` pelo arquivo de configuração (veja `RuleConfig`).
+ *
+ *  O risco de colisão continua sendo calculado pelo kernel de motion.hpp, que é vetorizado; as
+ *  regras leem o resultado dele e o histórico de posições do veículo.
+ */
+namespace rules {
+
+// Filtros do dashboard: o de todos os veículos mais no máximo 7 regras, um bit de uint8_t cada
+static const int all_filter = 0;
+static const int max_filters = 8;
+
+/// Dados de um veículo depois do kernel, vistos pelas regras.
+template<typename History>
+struct VehicleSample {
+    float speed;
+    float acceleration;
+    float risk;
+    float speed_limit;
+    // Flags calculadas pelo kernel (motion::risk_flag e motion::speeding_flag)
+    uint8_t motion_flags;
+    // Distância ao veículo à frente na mesma faixa e menor tempo até a colisão com os da frente
+    // nela e nas vizinhas (spatial_index.hpp), infinitos se não houver
+    float gap;
+    float ttc;
+    // Posições mais recentes do veículo, com `lane`, `distance` e `cycle`
+    const History& positions;
+};
+
+/// Parâmetros lidos do arquivo de configuração, no formato `chave = valor` com uma chave por
+/// linha. Linhas vazias e que começam com '#' são ignoradas.
+class RuleConfig {
+    std::unordered_map<std::string, std::string> values;
+
+    static std::string trim(const std::string& text) {
+        size_t begin = text.find_first_not_of(" \t\r");
+        if (begin == std::string::npos)
+            return "";
+        size_t end = text.find_last_not_of(" \t\r");
+        return text.substr(begin, end - begin + 1);
+    }
+
+ public:
+    /// Retorna uma configuração vazia se o arquivo não existir.
+    static RuleConfig load(const std::string& path) {
+        RuleConfig config;
+        std::ifstream file(path);
+        std::string line;
+        for (int number = 1; std::getline(file, line); number++) {
+            line = trim(line);
+            if (line.empty() || line[0] == '#')
+                continue;
+            size_t equals = line.find('=');
+            if (equals == std::string::npos)
+                throw std::runtime_error(path + ":" + std::to_string(number) + ": linha sem '='.");
+            config.values[trim(line.substr(0, equals))] = trim(line.substr(equals + 1));
+        }
+        return config;
+    }
+
+    std::string get(const std::string& key, const std::string& default_value) const {
+        auto it = values.find(key);
+        return it == values.end() ? default_value : it->second;
+    }
+
+    int get(const std::string& key, int default_value) const {
+        auto it = values.find(key);
+        if (it == values.end())
+            return default_value;
+        char* end;
+        long value = std::strtol(it->second.c_str(), &end, 10);
+        if (*end != '\0' || it->second.empty())
+            throw std::runtime_error("Valor inválido para " + key + ": " + it->second + ".");
+        return static_cast<int>(value);
+    }
+};
+
+/// Risco de colisão do kernel acima de motion::risk_threshold.
+struct CollisionRisk {
+    static constexpr const char* name = "Veículos com risco de colisão";
+    static constexpr char key = 'r';
+    static constexpr float weight = 2.0f;
+
+    void configure(const RuleConfig&) {}
+
+    template<typename History>
+    bool operator()(const VehicleSample<History>& vehicle) const {
+        return vehicle.motion_flags & motion::risk_flag;
+    }
+};
+
+/// Velocidade mais recente acima do limite da rodovia.
+struct AboveSpeedLimit {
+    static constexpr const char* name = "Veículos acima do limite de velocidade";
+    static constexpr char key = 'v';
+    static constexpr float weight = 1.0f;
+
+    void configure(const RuleConfig&) {}
+
+    template<typename History>
+    bool operator()(const VehicleSample<History>& vehicle) const {
+        return vehicle.motion_flags & motion::speeding_flag;
+    }
+};
+
+/// Velocidade acima do limite em cada um dos últimos `intervals` intervalos entre posições
+/// guardadas, e não só no mais recente. Precisa de um histórico com mais de `intervals` posições.
+struct SustainedSpeeding {
+    static constexpr const char* name = "Veículos acima do limite há vários ciclos";
+    static constexpr char key = 's';
+    static constexpr float weight = 1.0f;
+
+    uint32_t intervals = 3;
+
+    void configure(const RuleConfig& config) {
+        int value = config.get("excesso_sustentado.intervalos", static_cast<int>(intervals));
+        if (value < 1)
+            throw std::runtime_error("excesso_sustentado.intervalos deve ser pelo menos 1.");
+        intervals = value;
+    }
+
+    template<typename History>
+    bool operator()(const VehicleSample<History>& vehicle) const {
+        // A maioria dos veículos está dentro do limite, e a regra nem olha o histórico
+        if (!(vehicle.motion_flags & motion::speeding_flag) || vehicle.positions.size() <= intervals)
+            return false;
+        for (uint32_t k = 1; k < intervals; k++) {
+            const auto& current = vehicle.positions.back(k);
+            const auto& previous = vehicle.positions.back(k + 1);
+            float displacement = static_cast<float>(current.distance - previous.distance);
+            float elapsed = static_cast<float>(current.cycle - previous.cycle);
+            if (!(displacement / elapsed > vehicle.speed_limit))
+                return false;
+        }
+        return true;
+    }
+};
+
+/// Pelo menos `changes` trocas de faixa entre as posições guardadas do veículo.
+struct FrequentLaneChanges {
+    static constexpr const char* name = "Veículos com trocas de faixa frequentes";
+    static constexpr char key = 'f';
+    static constexpr float weight = 1.0f;
+
+    uint32_t changes = 3;
+
+    void configure(const RuleConfig& config) {
+        int value = config.get("troca_de_faixa.trocas", static_cast<int>(changes));
+        if (value < 1)
+            throw std::runtime_error("troca_de_faixa.trocas deve ser pelo menos 1.");
+        changes = value;
+    }
+
+    template<typename History>
+    bool operator()(const VehicleSample<History>& vehicle) const {
+        uint32_t size = vehicle.positions.size();
+        if (size <= changes)
+            return false;
+        uint32_t count = 0;
+        for (uint32_t k = 0; k + 1 < size && count < changes; k++)
+            count += vehicle.positions.back(k).lane != vehicle.positions.back(k + 1).lane;
+        return count >= changes;
+    }
+};
+
+/// Tempo até a colisão com um veículo à frente, na mesma faixa ou em uma vizinha, abaixo de
+/// `cycles` ciclos.
+struct ImminentCollision {
+    static constexpr const char* name = "Veículos prestes a colidir";
+    static constexpr char key = 'c';
+    static constexpr float weight = 2.0f;
+
+    float cycles = 2.0f;
+
+    void configure(const RuleConfig& config) {
+        int value = config.get("colisao_iminente.ciclos", static_cast<int>(cycles));
+        if (value < 1)
+            throw std::runtime_error("colisao_iminente.ciclos deve ser pelo menos 1.");
+        cycles = value;
+    }
+
+    template<typename History>
+    bool operator()(const VehicleSample<History>& vehicle) const {
+        return vehicle.ttc < cycles;
+    }
+};
+
+/// Nome e tecla de um filtro do dashboard.
+struct FilterInfo {
+    const char* name;
+    char key;
+};
+
+/// Conjunto de regras avaliado em um único passo. A regra `i` fica no bit `i + 1` das flags.
+template<typename... Rules>
+class RuleSet {
+    std::tuple<Rules...> rules;
+
+    template<typename History, size_t... I>
+    uint8_t evaluate(const VehicleSample<History>& vehicle, float& weight, std::index_sequence<I...>) const {
+        uint8_t flags = 1 << all_filter;
+        auto apply = [&flags, &weight](bool satisfied, int bit, float rule_weight) {
+            flags |= satisfied << bit;
+            weight += satisfied * rule_weight;
+        };
+        (apply(std::get<I>(rules)(vehicle), I + 1, Rules::weight), ...);
+        return flags;
+    }
+
+ public:
+    static constexpr int size = sizeof...(Rules);
+    static_assert(size + 1 <= max_filters, "Cada regra usa um bit das flags do veículo.");
+
+    void configure(const RuleConfig& config) {
+        std::apply([&config](auto&... rule) { (rule.configure(config), ...); }, rules);
+    }
+
+    /// Filtros do dashboard, começando pelo de todos os veículos.
+    static std::vector<FilterInfo> filters() {
+        return {{"Todos os veículos", 't'}, {Rules::name, Rules::key}...};
+    }
+
+    /// @brief Avalia todas as regras para o veículo.
+    /// @param weight Recebe a soma dos pesos das regras satisfeitas.
+    /// @return Flags do veículo, com o bit de todos os veículos sempre ligado.
+    template<typename History>
+    uint8_t operator()(const VehicleSample<History>& vehicle, float& weight) const {
+        return evaluate(vehicle, weight, std::index_sequence_for<Rules...>());
+    }
+};
+
+// Conjuntos compilados, escolhidos pela chave `regras` do arquivo de configuração
+using DefaultRules = RuleSet<CollisionRisk, AboveSpeedLimit>;
+using CompleteRules = RuleSet<CollisionRisk, AboveSpeedLimit, ImminentCollision, SustainedSpeeding,
+                              FrequentLaneChanges>;
+
+using ActiveRules = std::variant<DefaultRules, CompleteRules>;
+
+static const char* const rule_set_names[] = {"padrao", "completo"};
+static_assert(sizeof(rule_set_names) / sizeof(rule_set_names[0]) == std::variant_size_v<ActiveRules>);
+
+/// Cria o conjunto de regras escolhido pela configuração, com os parâmetros dela.
+inline ActiveRules make_rules(const RuleConfig& config) {
+    std::string name = config.get("regras", std::string(rule_set_names[0]));
+    ActiveRules active;
+    if (name == rule_set_names[0])
+        active.emplace<DefaultRules>();
+    else if (name == rule_set_names[1])
+        active.emplace<CompleteRules>();
+    else
+        throw std::runtime_error("Conjunto de regras desconhecido: " + name + ".");
+    std::visit([&config](auto& rule_set) { rule_set.configure(config); }, active);
+    return active;
+}
+
+}  // namespace rules
+
+#endif  // RULES_HPP_
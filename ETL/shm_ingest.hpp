@@ -0,0 +1,151 @@
+#ifndef SHM_INGEST_HPP_
+#define SHM_INGEST_HPP_
+
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+#include "./arena_allocator.hpp"
+#include "./ingest.hpp"
+#include "./shm_ring.hpp"
+
+/// Segundo transporte de entrada, para simuladores na mesma máquina: lê os anéis de memória
+/// compartilhada criados por eles e entrega os ciclos ao mesmo serviço que recebe os do gRPC,
+/// então o orquestrador não distingue a origem. Uma única thread procura segmentos novos com o
+/// prefixo em /dev/shm, registra a rodovia de cada um e lê todos os anéis em rodadas.
+///
+/// Os registros lidos em uma rodada são copiados para a mesma arena, que é liberada junto do lote
+/// que os processar, e as posições do anel voltam logo para o produtor.
+class ShmIngest {
+    static constexpr std::chrono::milliseconds discovery_interval{100};
+    // Rodadas sem nenhum ciclo antes de a thread passar a dormir entre elas
+    static const int idle_spins = 256;
+
+    struct Source {
+        std::unique_ptr<ShmRingReader> ring;
+        uint32_t highway_id;
+    };
+
+    IngestService& service;
+    std::string prefix;
+    std::vector<Source> sources;
+    // Segmentos já abertos, que não são abertos de novo
+    std::unordered_set<std::string> known;
+    ArenaFactory arenas;
+    std::atomic<bool> running{false};
+    std::thread thread;
+
+    /// Abre os segmentos com o prefixo que apareceram desde a última busca e remove os que foram
+    /// encerrados pelo produtor e já foram lidos.
+    void discover() {
+        for (size_t i = 0; i < sources.size();) {
+            if (sources[i].ring->finished()) {
+                sources[i].ring->unlink();
+                known.erase(sources[i].ring->segment_name());
+                sources[i] = std::move(sources.back());
+                sources.pop_back();
+            } else {
+                i++;
+            }
+        }
+
+        std::error_code error;
+        for (const auto& entry : std::filesystem::directory_iterator("/dev/shm", error)) {
+            std::string file = entry.path().filename().string();
+            if (file.compare(0, prefix.size(), prefix) != 0)
+                continue;
+            std::string name = "/" + file;
+            if (known.count(name))
+                continue;
+            try {
+                auto ring = std::make_unique<ShmRingReader>(name);
+                simulation::Highway highway;
+                highway.set_name(ring->highway_name());
+                highway.set_lanes(ring->lanes());
+                highway.set_size(ring->highway_size());
+                highway.set_speed_limit(ring->speed_limit());
+                uint32_t highway_id = service.register_highway(highway);
+                sources.push_back({std::move(ring), highway_id});
+                known.insert(name);
+            } catch (const std::runtime_error&) {
+                // O produtor ainda está criando o segmento: tenta de novo na próxima busca
+            }
+        }
+    }
+
+    /// Lê os ciclos disponíveis nos anéis até a fila do serviço encher, retornando quantos foram
+    /// lidos. Os que ficam nos anéis fazem os produtores esperarem.
+    size_t poll() {
+        size_t count = 0;
+        std::shared_ptr<google::protobuf::Arena> arena;
+        for (Source& source : sources) {
+            while (!service.full() && source.ring->try_pop([&](const ShmCycle& record) {
+                if (!arena)
+                    arena = arenas.create();
+                size_t bytes = record.bytes();
+                char* copy = google::protobuf::Arena::CreateArray<char>(arena.get(), bytes);
+                std::memcpy(copy, &record, bytes);
+                IngestedCycle ingested;
+                ingested.arena = arena;
+                ingested.record = reinterpret_cast<const ShmCycle*>(copy);
+                ingested.source_highway = source.highway_id;
+                service.push(std::move(ingested));
+            })) {
+                count++;
+            }
+        }
+        if (arena)
+            arenas.learn(*arena);
+        return count;
+    }
+
+    void loop() {
+        auto last_discovery = std::chrono::steady_clock::time_point();
+        int idle = 0;
+        while (running.load(std::memory_order_relaxed)) {
+            auto now = std::chrono::steady_clock::now();
+            if (now - last_discovery >= discovery_interval) {
+                discover();
+                last_discovery = now;
+            }
+            if (poll() > 0) {
+                idle = 0;
+            } else if (++idle < idle_spins) {
+                std::this_thread::yield();
+            } else {
+                // Sem produtores ativos, a latência do primeiro ciclo depois de uma pausa
+                // fica limitada por este intervalo
+                std::this_thread::sleep_for(std::chrono::microseconds(100));
+            }
+        }
+    }
+
+ public:
+    /// @param prefix Prefixo dos nomes dos segmentos em /dev/shm, sem a barra inicial.
+    explicit ShmIngest(IngestService& service, std::string prefix = ShmRing::default_prefix) :
+            service(service), prefix(std::move(prefix)) {}
+
+    ~ShmIngest() {
+        stop();
+    }
+
+    void start() {
+        if (running.exchange(true))
+            return;
+        thread = std::thread(&ShmIngest::loop, this);
+    }
+
+    void stop() {
+        running = false;
+        if (thread.joinable())
+            thread.join();
+    }
+};
+
+#endif  // SHM_INGEST_HPP_
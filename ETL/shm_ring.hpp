@@ -0,0 +1,333 @@
+#ifndef SHM_RING_HPP_
+#define SHM_RING_HPP_
+
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+/// Veículo no formato binário fixo do transporte por memória compartilhada.
+struct ShmVehicle {
+    // Sem '\0' no fim quando a placa ocupa os 8 bytes
+    char plate[8];
+    uint32_t distance;
+    uint16_t lane;
+    uint8_t direction;
+    uint8_t padding;
+};
+
+/// Registro de um ciclo no anel. Os `num_vehicles` veículos vêm logo depois do cabeçalho.
+struct ShmCycle {
+    uint32_t cycle;
+    uint32_t num_vehicles;
+    double timestamp;
+
+    const ShmVehicle* vehicles() const {
+        return reinterpret_cast<const ShmVehicle*>(this + 1);
+    }
+
+    ShmVehicle* vehicles() {
+        return reinterpret_cast<ShmVehicle*>(this + 1);
+    }
+
+    /// Tamanho em bytes do registro com os seus veículos.
+    size_t bytes() const {
+        return sizeof(ShmCycle) + num_vehicles * sizeof(ShmVehicle);
+    }
+};
+
+static_assert(sizeof(ShmVehicle) == 16 && sizeof(ShmCycle) == 16, "O formato do registro é fixo");
+
+/// Anel de ciclos em um segmento de memória compartilhada POSIX, escrito por um único produtor
+/// (um simulador na mesma máquina) e lido por um ou mais consumidores. Cada posição do anel
+/// guarda um registro de tamanho fixo e um número de sequência, como na fila limitada de Vyukov:
+/// o produtor escreve na posição quando a sequência indica que ela está livre e os consumidores
+/// disputam as posições preenchidas com um CAS no índice de leitura. Os índices só crescem, e
+/// as operações atômicas usadas são livres de locks, então funcionam entre processos.
+///
+/// Cada segmento pertence a uma rodovia, descrita no cabeçalho, e é criado pelo produtor com o
+/// nome `/<prefixo><pid>-<n>`, para que o ETL encontre os segmentos novos listando /dev/shm.
+class ShmRing {
+ public:
+    static constexpr const char* default_prefix = "highway-etl-";
+    static const uint64_t magic = 0x3130676e69724d53;  // "SMring01"
+    static const size_t max_name_size = 64;
+
+ protected:
+    struct Header {
+        // Escrito por último, indica que o resto do cabeçalho já está pronto
+        std::atomic<uint64_t> magic;
+        uint32_t num_slots;
+        uint32_t max_vehicles;
+        uint64_t slot_size;
+        int32_t producer_pid;
+        uint32_t lanes;
+        uint32_t size;
+        uint32_t speed_limit;
+        char highway_name[max_name_size];
+        // Próxima posição a ser escrita, avançada só pelo produtor
+        alignas(64) std::atomic<uint64_t> head;
+        // Próxima posição a ser lida, disputada pelos consumidores
+        alignas(64) std::atomic<uint64_t> tail;
+        alignas(64) std::atomic<uint32_t> closed;
+        std::atomic<uint32_t> consumers;
+    };
+
+    struct Slot {
+        std::atomic<uint64_t> sequence;
+        uint64_t padding;
+        ShmCycle cycle;
+    };
+
+    static_assert(std::atomic<uint64_t>::is_always_lock_free, "O anel precisa de atômicos sem locks");
+
+    std::string name;
+    Header* header = nullptr;
+    size_t mapped_size = 0;
+
+    static size_t slot_size_for(uint32_t max_vehicles) {
+        size_t size = sizeof(Slot) + max_vehicles * sizeof(ShmVehicle);
+        return (size + 63) / 64 * 64;
+    }
+
+    Slot& slot(uint64_t position) const {
+        char* slots = reinterpret_cast<char*>(header + 1);
+        return *reinterpret_cast<Slot*>(slots + (position & (header->num_slots - 1)) * header->slot_size);
+    }
+
+    static std::runtime_error error(const std::string& message, const std::string& name) {
+        return std::runtime_error(message + " " + name + ": " + std::strerror(errno));
+    }
+
+    ShmRing() = default;
+
+ public:
+    ShmRing(const ShmRing&) = delete;
+    ShmRing& operator=(const ShmRing&) = delete;
+
+    ~ShmRing() {
+        if (header)
+            munmap(header, mapped_size);
+    }
+
+    const std::string& segment_name() const {
+        return name;
+    }
+
+    std::string highway_name() const {
+        return std::string(header->highway_name, strnlen(header->highway_name, max_name_size));
+    }
+
+    uint32_t lanes() const {
+        return header->lanes;
+    }
+
+    uint32_t highway_size() const {
+        return header->size;
+    }
+
+    uint32_t speed_limit() const {
+        return header->speed_limit;
+    }
+
+    uint32_t max_vehicles() const {
+        return header->max_vehicles;
+    }
+};
+
+/// Lado do produtor: cria o segmento e escreve os ciclos.
+class ShmRingWriter : public ShmRing {
+    uint64_t head = 0;
+
+ public:
+    /// @brief Cria o segmento de uma rodovia.
+    /// @param name Nome do segmento, começando com '/'. Se vazio, usa o prefixo padrão e o pid.
+    /// @param num_slots Número de ciclos que cabem no anel, arredondado para uma potência de 2.
+    /// @param max_vehicles Número máximo de veículos de um ciclo.
+    ShmRingWriter(std::string name, const std::string& highway_name, uint32_t lanes, uint32_t size,
+                  uint32_t speed_limit, uint32_t num_slots = 64, uint32_t max_vehicles = 4096) {
+        static std::atomic<uint32_t> counter{0};
+        if (name.empty())
+            name = "/" + std::string(default_prefix) + std::to_string(getpid()) + "-" + std::to_string(counter++);
+        if (num_slots < 2 || max_vehicles == 0)
+            throw std::runtime_error("O anel deve ter pelo menos 2 posições e espaço para 1 veículo.");
+        if (highway_name.size() > max_name_size)
+            throw std::runtime_error("O nome da rodovia deve ter no máximo 64 caracteres.");
+        uint32_t slots = 2;
+        while (slots < num_slots)
+            slots *= 2;
+
+        this->name = name;
+        mapped_size = sizeof(Header) + slots * slot_size_for(max_vehicles);
+        int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+        if (fd < 0)
+            throw error("Não foi possível criar a memória compartilhada", name);
+        if (ftruncate(fd, mapped_size) != 0) {
+            ::close(fd);
+            shm_unlink(name.c_str());
+            throw error("Não foi possível dimensionar a memória compartilhada", name);
+        }
+        void* memory = mmap(nullptr, mapped_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (memory == MAP_FAILED) {
+            shm_unlink(name.c_str());
+            throw error("Não foi possível mapear a memória compartilhada", name);
+        }
+
+        // O segmento novo vem zerado, então os atômicos já começam em 0
+        header = static_cast<Header*>(memory);
+        header->num_slots = slots;
+        header->max_vehicles = max_vehicles;
+        header->slot_size = slot_size_for(max_vehicles);
+        header->producer_pid = getpid();
+        header->lanes = lanes;
+        header->size = size;
+        header->speed_limit = speed_limit;
+        std::memcpy(header->highway_name, highway_name.data(), highway_name.size());
+        for (uint64_t i = 0; i < slots; i++)
+            slot(i).sequence.store(i, std::memory_order_relaxed);
+        header->magic.store(magic, std::memory_order_release);
+    }
+
+    /// Encerra o anel e espera até 1 segundo que os consumidores leiam o que falta. Os que já
+    /// abriram o segmento continuam lendo depois que o nome é removido.
+    ~ShmRingWriter() {
+        close();
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+        while (header->consumers.load() > 0 && header->tail.load() < head &&
+               std::chrono::steady_clock::now() < deadline)
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        shm_unlink(name.c_str());
+    }
+
+    /// Retorna o registro da próxima posição para ser preenchido, ou nulo se o anel está cheio.
+    /// O registro só fica visível aos consumidores depois de `publish`.
+    ShmCycle* try_claim() {
+        Slot& next = slot(head);
+        if (next.sequence.load(std::memory_order_acquire) != head)
+            return nullptr;
+        return &next.cycle;
+    }
+
+    void publish() {
+        slot(head).sequence.store(head + 1, std::memory_order_release);
+        head++;
+        header->head.store(head, std::memory_order_release);
+    }
+
+    /// Escreve um ciclo, esperando até `timeout` segundos se o anel estiver cheio. Retorna
+    /// falso se o tempo acabou, e lança uma exceção se o ciclo tem veículos demais.
+    bool push(uint32_t cycle, double timestamp, const ShmVehicle* vehicles, uint32_t num_vehicles,
+              double timeout = 1.0) {
+        if (num_vehicles > header->max_vehicles)
+            throw std::runtime_error("O ciclo tem mais veículos do que cabem em um registro do anel.");
+        ShmCycle* record = try_claim();
+        if (!record) {
+            auto deadline = std::chrono::steady_clock::now() + std::chrono::duration<double>(timeout);
+            for (int spins = 0; !(record = try_claim()); spins++) {
+                if (std::chrono::steady_clock::now() >= deadline)
+                    return false;
+                if (spins < 64)
+                    std::this_thread::yield();
+                else
+                    std::this_thread::sleep_for(std::chrono::microseconds(50));
+            }
+        }
+        record->cycle = cycle;
+        record->timestamp = timestamp;
+        record->num_vehicles = num_vehicles;
+        std::memcpy(record->vehicles(), vehicles, num_vehicles * sizeof(ShmVehicle));
+        publish();
+        return true;
+    }
+
+    /// Avisa os consumidores que não haverá mais ciclos.
+    void close() {
+        header->closed.store(1, std::memory_order_release);
+    }
+};
+
+/// Lado do consumidor: abre um segmento já criado e retira os ciclos.
+class ShmRingReader : public ShmRing {
+ public:
+    /// Abre o segmento `name`. Lança uma exceção se ele não existe, ainda não foi inicializado
+    /// pelo produtor ou não é um anel de ciclos.
+    explicit ShmRingReader(const std::string& name) {
+        this->name = name;
+        int fd = shm_open(name.c_str(), O_RDWR, 0);
+        if (fd < 0)
+            throw error("Não foi possível abrir a memória compartilhada", name);
+        struct stat info;
+        if (fstat(fd, &info) != 0 || static_cast<size_t>(info.st_size) < sizeof(Header)) {
+            ::close(fd);
+            throw std::runtime_error("Memória compartilhada " + name + " ainda não inicializada.");
+        }
+        mapped_size = info.st_size;
+        void* memory = mmap(nullptr, mapped_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (memory == MAP_FAILED)
+            throw error("Não foi possível mapear a memória compartilhada", name);
+        header = static_cast<Header*>(memory);
+        if (header->magic.load(std::memory_order_acquire) != magic || header->num_slots == 0 ||
+            (header->num_slots & (header->num_slots - 1)) != 0 ||
+            header->slot_size != slot_size_for(header->max_vehicles) ||
+            sizeof(Header) + header->num_slots * header->slot_size > mapped_size)
+            throw std::runtime_error("Memória compartilhada " + name + " não é um anel de ciclos válido.");
+        header->consumers.fetch_add(1);
+    }
+
+    ~ShmRingReader() {
+        if (header && header->magic.load() == magic)
+            header->consumers.fetch_sub(1);
+    }
+
+    /// Retira o próximo ciclo, se houver, chamando `consume` com o registro ainda no anel. A
+    /// posição só é devolvida ao produtor quando `consume` retorna.
+    template<typename Consume>
+    bool try_pop(Consume&& consume) {
+        uint64_t position = header->tail.load(std::memory_order_relaxed);
+        while (true) {
+            Slot& current = slot(position);
+            uint64_t sequence = current.sequence.load(std::memory_order_acquire);
+            int64_t diff = static_cast<int64_t>(sequence - (position + 1));
+            if (diff == 0) {
+                if (header->tail.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                    // O produtor é outro processo, então o número de veículos não é confiável
+                    current.cycle.num_vehicles = std::min(current.cycle.num_vehicles, header->max_vehicles);
+                    consume(static_cast<const ShmCycle&>(current.cycle));
+                    current.sequence.store(position + header->num_slots, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                position = header->tail.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    /// Se o produtor encerrou o anel, ou terminou sem encerrá-lo, e não há mais ciclos a ler.
+    bool finished() const {
+        bool closed = header->closed.load(std::memory_order_acquire) != 0 ||
+                      (kill(header->producer_pid, 0) != 0 && errno == ESRCH);
+        return closed && header->tail.load() >= header->head.load(std::memory_order_acquire);
+    }
+
+    /// Remove o nome do segmento, que continua mapeado até este objeto ser destruído.
+    void unlink() {
+        shm_unlink(name.c_str());
+    }
+};
+
+#endif  // SHM_RING_HPP_
@@ -0,0 +1,144 @@
+#ifndef SNAPSHOT_HPP_
+#define SNAPSHOT_HPP_
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <utility>
+#include <vector>
+
+/*
+ *  Publicação de versões imutáveis de um objeto por um ponteiro atômico, com reclamação por
+ *  épocas. Quem publica troca o ponteiro e guarda a versão antiga com a época da troca; cada leitor
+ *  anuncia a época em que começou a ler antes de carregar o ponteiro, e uma versão só é liberada
+ *  quando todos os leitores ativos começaram depois da troca dela. Leitores nunca esperam quem
+ *  publica, e quem publica nunca espera os leitores: as versões que ainda estão sendo lidas só
+ *  ficam guardadas por mais tempo.
+ */
+namespace snapshot {
+
+/// Versões publicadas de um `T`. Só uma thread pode publicar; qualquer número de threads pode
+/// ler, com no máximo `max_readers` leituras simultâneas.
+template<typename T>
+class Publisher {
+    static const int max_readers = 64;
+    // Época dos leitores que não estão lendo
+    static const uint64_t idle = 0;
+
+    struct alignas(64) ReaderSlot {
+        std::atomic<uint64_t> epoch{idle};
+    };
+
+    std::atomic<T*> current{nullptr};
+    std::atomic<uint64_t> epoch{1};
+    ReaderSlot readers[max_readers];
+    // Versões substituídas e a época em que saíram, usadas apenas por quem publica
+    std::vector<std::pair<uint64_t, std::unique_ptr<T>>> retired;
+    // Versões que nenhum leitor pode ver mais, reaproveitadas por `reuse`
+    std::vector<std::unique_ptr<T>> spare;
+
+    /// Libera as versões que saíram antes da época de todos os leitores ativos.
+    void reclaim() {
+        uint64_t oldest = UINT64_MAX;
+        for (const ReaderSlot& reader : readers) {
+            uint64_t reading = reader.epoch.load();
+            if (reading != idle && reading < oldest)
+                oldest = reading;
+        }
+        size_t kept = 0;
+        for (auto& [retired_epoch, version] : retired) {
+            if (retired_epoch < oldest)
+                spare.push_back(std::move(version));
+            else
+                retired[kept++] = {retired_epoch, std::move(version)};
+        }
+        retired.resize(kept);
+    }
+
+ public:
+    /// Leitura de uma versão, que não é liberada enquanto o objeto existir.
+    class Reader {
+        Publisher* publisher = nullptr;
+        int slot = 0;
+        const T* value = nullptr;
+
+        friend class Publisher;
+
+        Reader(Publisher* publisher, int slot, const T* value) : publisher(publisher), slot(slot), value(value) {}
+
+     public:
+        Reader(Reader&& other) noexcept
+            : publisher(std::exchange(other.publisher, nullptr)), slot(other.slot), value(other.value) {}
+
+        Reader(const Reader&) = delete;
+        Reader& operator=(const Reader&) = delete;
+        Reader& operator=(Reader&&) = delete;
+
+        ~Reader() {
+            if (publisher)
+                publisher->readers[slot].epoch.store(idle, std::memory_order_release);
+        }
+
+        /// Versão lida, ou nullptr se nada foi publicado ainda.
+        const T* get() const {
+            return value;
+        }
+
+        const T* operator->() const {
+            return value;
+        }
+
+        const T& operator*() const {
+            return *value;
+        }
+
+        explicit operator bool() const {
+            return value != nullptr;
+        }
+    };
+
+    Publisher() = default;
+    Publisher(const Publisher&) = delete;
+    Publisher& operator=(const Publisher&) = delete;
+
+    ~Publisher() {
+        delete current.load();
+    }
+
+    /// Anuncia a leitura e carrega a versão atual. A época anunciada pode estar atrasada, o que
+    /// só faz as versões serem guardadas por mais tempo.
+    Reader read() {
+        for (int attempt = 0;; attempt++) {
+            int slot = attempt % max_readers;
+            uint64_t expected = idle;
+            if (readers[slot].epoch.compare_exchange_strong(expected, epoch.load()))
+                return Reader(this, slot, current.load());
+            if (slot == max_readers - 1)
+                std::this_thread::yield();
+        }
+    }
+
+    /// Versão já liberada pelos leitores, com o conteúdo antigo, para ser preenchida e publicada
+    /// sem alocar de novo; nullptr se não houver nenhuma.
+    std::unique_ptr<T> reuse() {
+        reclaim();
+        if (spare.empty())
+            return nullptr;
+        std::unique_ptr<T> version = std::move(spare.back());
+        spare.pop_back();
+        return version;
+    }
+
+    /// Publica a próxima versão. A anterior continua válida para quem já a está lendo.
+    void publish(std::unique_ptr<T> next) {
+        T* previous = current.exchange(next.release());
+        if (previous)
+            retired.emplace_back(epoch.fetch_add(1), std::unique_ptr<T>(previous));
+        reclaim();
+    }
+};
+
+}  // namespace snapshot
+
+#endif  // SNAPSHOT_HPP_
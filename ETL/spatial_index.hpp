@@ -0,0 +1,225 @@
+#ifndef SPATIAL_INDEX_HPP_
+#define SPATIAL_INDEX_HPP_
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+/*
+ *  Vizinhança dos veículos de uma rodovia, usada no risco de colisão. Os veículos do ciclo mais
+ *  recente ficam em um vetor ordenado por (faixa, distância), então o veículo à frente na mesma
+ *  faixa é o próximo do vetor e os das faixas vizinhas são encontrados por ponteiros que só
+ *  avançam. Entre um ciclo e o seguinte os veículos quase não trocam de ordem: o vetor é montado
+ *  na ordem do ciclo anterior e ordenado por inserção, em O(n + trocas), com std::sort apenas
+ *  quando as trocas passam de um limite. Os m veículos novos ou que trocaram de faixa custam
+ *  O(m log m) e uma intercalação.
+ */
+namespace spatial {
+
+static constexpr float no_collision = std::numeric_limits<float>::infinity();
+// Tempo até a colisão, em ciclos, a partir do qual o veículo da frente não aumenta o risco
+static constexpr float ttc_horizon = 5.0f;
+// Valor somado ao argumento da sigmoide do risco com o tempo até a colisão igual a 0
+static constexpr float proximity_gain = 4.0f;
+// Peso das faixas vizinhas em relação à própria faixa
+static constexpr float side_weight = 0.5f;
+
+/// Distância e tempo até a colisão com o veículo à frente. Sem veículo à frente, ou sem
+/// aproximação, os valores são infinitos.
+struct Neighbours {
+    float gap = no_collision;
+    float ttc = no_collision;
+    // Menor tempo até a colisão com o veículo à frente em uma das faixas vizinhas
+    float side_ttc = no_collision;
+};
+
+/// Chave de ordenação do índice: faixa nos 32 bits altos e distância nos baixos.
+inline uint64_t key(uint32_t lane, uint32_t distance) {
+    return uint64_t(lane) << 32 | distance;
+}
+
+/// Ciclos até o veículo alcançar o da frente, que está `gap` adiante, mantidas as velocidades.
+inline float time_to_collision(float gap, float speed, float speed_ahead) {
+    if (gap <= 0.0f)
+        return 0.0f;
+    float closing = speed - speed_ahead;
+    return closing > 0.0f ? gap / closing : no_collision;
+}
+
+/// Termo somado ao argumento da sigmoide do risco, que cresce conforme o tempo até a colisão
+/// fica abaixo de `ttc_horizon`.
+inline float proximity(const Neighbours& neighbours) {
+    float ahead = std::max(0.0f, 1.0f - neighbours.ttc / ttc_horizon);
+    float side = std::max(0.0f, 1.0f - neighbours.side_ttc / ttc_horizon);
+    return proximity_gain * (ahead + side_weight * side);
+}
+
+/// Índice dos veículos do ciclo mais recente de uma rodovia, por faixa e distância.
+class LaneIndex {
+ public:
+    struct Entry {
+        uint64_t key;
+        uint32_t id;
+        float speed;
+
+        uint32_t lane() const {
+            return key >> 32;
+        }
+
+        uint32_t distance() const {
+            return static_cast<uint32_t>(key);
+        }
+    };
+
+ private:
+    static constexpr uint32_t empty = std::numeric_limits<uint32_t>::max();
+
+    std::vector<Entry> entries;
+    // Vetores reaproveitados entre as atualizações
+    std::vector<Entry> placed;
+    std::vector<Entry> appended;
+    std::vector<uint32_t> lane_begin;
+    uint64_t moves_ = 0;
+    bool resorted_ = false;
+
+    /// Ordena por inserção, que é linear quando a ordem do ciclo anterior ainda vale, e recorre
+    /// ao std::sort se os deslocamentos passarem de algumas vezes o número de veículos.
+    void sort_nearly_sorted() {
+        uint64_t budget = 8 * uint64_t(entries.size()) + 64;
+        moves_ = 0;
+        resorted_ = false;
+        for (size_t i = 1; i < entries.size(); i++) {
+            Entry entry = entries[i];
+            size_t j = i;
+            for (; j > 0 && entries[j - 1].key > entry.key; j--)
+                entries[j] = entries[j - 1];
+            entries[j] = entry;
+            moves_ += i - j;
+            if (moves_ > budget) {
+                std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) {
+                    return a.key < b.key;
+                });
+                resorted_ = true;
+                return;
+            }
+        }
+    }
+
+ public:
+    /// @brief Substitui o conteúdo pelos veículos `ids` do ciclo novo.
+    /// @param key_of Chave (`spatial::key`) da posição atual do veículo.
+    /// @param speed_of Velocidade atual do veículo, usada no tempo até a colisão.
+    /// @param slots Posição de cada id no índice, indexada pelo id e escrita aqui. Só serve de
+    ///        dica de ordem: valores antigos ou de outra rodovia apenas deixam a ordenação mais lenta.
+    template<typename KeyOf, typename SpeedOf, typename Slots>
+    void update(const uint32_t* ids, size_t count, KeyOf&& key_of, SpeedOf&& speed_of, Slots& slots) {
+        // Os veículos que continuam na mesma faixa voltam para a posição que tinham e os que
+        // saíram deixam buracos, removidos logo em seguida. Os novos e os que trocaram de faixa
+        // iriam longe da posição antiga, então são ordenados à parte e intercalados no fim
+        placed.assign(entries.size(), Entry{0, empty, 0.0f});
+        appended.clear();
+        for (size_t i = 0; i < count; i++) {
+            uint32_t id = ids[i];
+            Entry entry{key_of(id), id, speed_of(id)};
+            uint32_t slot = slots[id];
+            if (slot < entries.size() && entries[slot].id == id && entries[slot].lane() == entry.lane() &&
+                placed[slot].id == empty)
+                placed[slot] = entry;
+            else
+                appended.push_back(entry);
+        }
+        entries.clear();
+        for (const Entry& entry : placed) {
+            if (entry.id != empty)
+                entries.push_back(entry);
+        }
+        sort_nearly_sorted();
+        if (!appended.empty()) {
+            auto by_key = [](const Entry& a, const Entry& b) {
+                return a.key < b.key;
+            };
+            std::sort(appended.begin(), appended.end(), by_key);
+            placed.resize(entries.size() + appended.size());
+            std::merge(entries.begin(), entries.end(), appended.begin(), appended.end(), placed.begin(), by_key);
+            entries.swap(placed);
+        }
+        for (uint32_t k = 0; k < entries.size(); k++)
+            slots[entries[k].id] = k;
+    }
+
+    /// @brief Chama `on_vehicle(id, Neighbours)` para cada veículo do índice, em O(n).
+    /// @param lanes_per_direction Número de faixas em cada direção. As faixas de direções
+    ///        diferentes nunca são vizinhas, e veículos em faixas além das duas direções são
+    ///        ignorados.
+    template<typename OnVehicle>
+    void neighbours(uint32_t lanes_per_direction, OnVehicle&& on_vehicle) {
+        uint32_t num_lanes = entries.empty() ? 0 : std::min(entries.back().lane() + 1, 2 * lanes_per_direction);
+        lane_begin.assign(num_lanes + 1, 0);
+        for (const Entry& entry : entries) {
+            if (entry.lane() < num_lanes)
+                lane_begin[entry.lane() + 1]++;
+        }
+        for (uint32_t lane = 0; lane < num_lanes; lane++)
+            lane_begin[lane + 1] += lane_begin[lane];
+
+        for (uint32_t lane = 0; lane < num_lanes; lane++) {
+            uint32_t begin = lane_begin[lane], end = lane_begin[lane + 1];
+            // Faixas vizinhas na mesma direção e o próximo veículo de cada uma a ser comparado
+            uint32_t sides[2], cursors[2];
+            int num_sides = 0;
+            for (uint32_t side : {lane - 1, lane + 1}) {
+                if (side < num_lanes && side / lanes_per_direction == lane / lanes_per_direction) {
+                    sides[num_sides] = side;
+                    cursors[num_sides++] = lane_begin[side];
+                }
+            }
+
+            for (uint32_t k = begin; k < end; k++) {
+                const Entry& entry = entries[k];
+                Neighbours result;
+                if (k + 1 < end) {
+                    const Entry& ahead = entries[k + 1];
+                    result.gap = static_cast<float>(ahead.distance() - entry.distance());
+                    result.ttc = time_to_collision(result.gap, entry.speed, ahead.speed);
+                }
+                // Nas faixas vizinhas só conta quem está estritamente à frente: lado a lado não
+                // é uma colisão a menos que um deles troque de faixa
+                for (int s = 0; s < num_sides; s++) {
+                    uint32_t& cursor = cursors[s];
+                    uint32_t side_end = lane_begin[sides[s] + 1];
+                    while (cursor < side_end && entries[cursor].distance() <= entry.distance())
+                        cursor++;
+                    if (cursor < side_end) {
+                        const Entry& ahead = entries[cursor];
+                        float gap = static_cast<float>(ahead.distance() - entry.distance());
+                        result.side_ttc = std::min(result.side_ttc, time_to_collision(gap, entry.speed, ahead.speed));
+                    }
+                }
+                on_vehicle(entry.id, result);
+            }
+        }
+    }
+
+    size_t size() const {
+        return entries.size();
+    }
+
+    const std::vector<Entry>& sorted() const {
+        return entries;
+    }
+
+    /// Deslocamentos da ordenação por inserção na última atualização.
+    uint64_t moves() const {
+        return moves_;
+    }
+
+    /// Indica se a última atualização precisou do std::sort.
+    bool resorted() const {
+        return resorted_;
+    }
+};
+
+}  // namespace spatial
+
+#endif  // SPATIAL_INDEX_HPP_
@@ -0,0 +1,174 @@
+#ifndef THREAD_POOL_HPP_
+#define THREAD_POOL_HPP_
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/// Pool de threads persistente com uma fila de tarefas por worker. Cada worker consome a
+/// própria fila pelo fim e, quando ela esvazia, rouba tarefas do início das filas dos outros,
+/// o que equilibra a carga sem que todos disputem uma única fila global.
+class ThreadPool {
+ public:
+    // A tarefa recebe o índice do worker que a executa para escrever apenas nos dados dele
+    using Task = std::function<void(int)>;
+    using RangeTask = std::function<void(int, int, int)>;
+
+ private:
+    struct Worker {
+        std::deque<Task> tasks;
+        std::mutex mutex;
+        std::thread thread;
+    };
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    // Número de tarefas enfileiradas que ainda não foram retiradas por nenhum worker
+    std::atomic<int> queued{0};
+    // Usado para distribuir as tarefas submetidas entre as filas dos workers
+    std::atomic<unsigned> next_queue{0};
+    std::condition_variable sleep_cv;
+    std::mutex sleep_mutex;
+    bool stopping = false;
+
+    bool pop_local(int id, Task& task) {
+        Worker& worker = *workers[id];
+        std::lock_guard<std::mutex> lock(worker.mutex);
+        if (worker.tasks.empty())
+            return false;
+        task = std::move(worker.tasks.back());
+        worker.tasks.pop_back();
+        return true;
+    }
+
+    bool steal(int id, Task& task) {
+        int n = workers.size();
+        for (int k = 1; k < n; k++) {
+            Worker& victim = *workers[(id + k) % n];
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if (victim.tasks.empty())
+                continue;
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            return true;
+        }
+        return false;
+    }
+
+    void worker_loop(int id) {
+        Task task;
+        while (true) {
+            if (pop_local(id, task) || steal(id, task)) {
+                queued--;
+                task(id);
+                task = nullptr;
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(sleep_mutex);
+            sleep_cv.wait(lock, [this] { return stopping || queued > 0; });
+            if (stopping && queued <= 0)
+                return;
+        }
+    }
+
+    void start(int num_threads) {
+        stopping = false;
+        workers.reserve(num_threads);
+        for (int i = 0; i < num_threads; i++)
+            workers.push_back(std::make_unique<Worker>());
+        // As threads só começam depois que todas as filas existem, pois elas roubam umas das outras
+        for (int i = 0; i < num_threads; i++)
+            workers[i]->thread = std::thread(&ThreadPool::worker_loop, this, i);
+    }
+
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lock(sleep_mutex);
+            stopping = true;
+        }
+        sleep_cv.notify_all();
+        for (auto& worker : workers)
+            worker->thread.join();
+        workers.clear();
+    }
+
+ public:
+    explicit ThreadPool(int num_threads = 0) {
+        start(num_threads);
+    }
+
+    ~ThreadPool() {
+        stop();
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    int size() const {
+        return workers.size();
+    }
+
+    /// Enfileira uma tarefa sem esperar sua execução.
+    void submit(Task task) {
+        int id = next_queue++ % workers.size();
+        {
+            std::lock_guard<std::mutex> lock(workers[id]->mutex);
+            workers[id]->tasks.push_back(std::move(task));
+        }
+        queued++;
+        // Garante que um worker prestes a dormir veja a nova tarefa antes de esperar
+        { std::lock_guard<std::mutex> lock(sleep_mutex); }
+        sleep_cv.notify_one();
+    }
+
+    /// @brief Divide o intervalo [begin, end) em blocos de até `grain` elementos e os executa
+    ///        no pool, retornando apenas quando todos tiverem terminado.
+    /// @param body Função chamada com (início, fim, índice do worker) de cada bloco.
+    void parallel_for(int begin, int end, int grain, const RangeTask& body) {
+        if (begin >= end)
+            return;
+        grain = std::max(grain, 1);
+        // Sem workers (antes de `run`), executa tudo na thread atual como se fosse o worker 0
+        if (workers.empty()) {
+            body(begin, end, 0);
+            return;
+        }
+
+        // O grupo fica na pilha desta chamada, então cada tarefa só o toca com o mutex: quem espera
+        // só vê o contador zerado depois que a última tarefa o solta, e nenhuma o usa depois disso
+        struct Group {
+            int remaining;
+            std::condition_variable cv;
+            std::mutex mutex;
+        } group;
+        group.remaining = (end - begin + grain - 1) / grain;
+
+        for (int start = begin; start < end; start += grain) {
+            int stop = std::min(start + grain, end);
+            submit([&group, &body, start, stop](int worker) {
+                body(start, stop, worker);
+                std::lock_guard<std::mutex> lock(group.mutex);
+                if (--group.remaining == 0)
+                    group.cv.notify_all();
+            });
+        }
+        std::unique_lock<std::mutex> lock(group.mutex);
+        group.cv.wait(lock, [&group] { return group.remaining == 0; });
+    }
+
+    /// Altera o número de workers. Espera as tarefas já enfileiradas terminarem, então não
+    /// deve ser chamada de dentro de uma tarefa do próprio pool.
+    void resize(int num_threads) {
+        if (num_threads == size())
+            return;
+        stop();
+        start(num_threads);
+    }
+};
+
+#endif  // THREAD_POOL_HPP_
@@ -0,0 +1,1730 @@
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "ETL/aggregates.hpp"
+#include "ETL/batch_snapshot.hpp"
+#include "ETL/cycle_file.hpp"
+#include "ETL/delta.hpp"
+#include "ETL/enrichment.hpp"
+#include "ETL/ingest.hpp"
+#include "ETL/motion.hpp"
+#include "ETL/navigation.hpp"
+#include "ETL/registry.hpp"
+#include "ETL/ring_buffer.hpp"
+#include "ETL/rules.hpp"
+#include "ETL/shm_ingest.hpp"
+#include "ETL/snapshot.hpp"
+#include "ETL/spatial_index.hpp"
+#include "ETL/thread_pool.hpp"
+
+using Clock = std::chrono::steady_clock;
+
+// Alocações feitas pelo operador new global, incluindo as dos blocos de arenas do protobuf
+std::atomic<uint64_t> num_allocations{0};
+
+void* operator new(size_t size) {
+    num_allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* ptr = std::malloc(size == 0 ? 1 : size))
+        return ptr;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* ptr) noexcept {
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept {
+    std::free(ptr);
+}
+
+/// Tempo decorrido em microssegundos desde `start`.
+double elapsed_us(Clock::time_point start) {
+    return std::chrono::duration<double, std::micro>(Clock::now() - start).count();
+}
+
+/// Compara o custo fixo de um lote do ETL (três etapas paralelas) criando threads a cada etapa,
+/// como era feito antes, com o custo de submeter blocos ao pool persistente.
+void bench_pool(int workers, int num_batches, int vehicles) {
+    static const int chunk_size = 1024;
+    std::vector<long> sums(workers);
+    // Trabalho trivial, para que o tempo medido seja basicamente o custo de despacho
+    auto work = [&sums](int start, int end, int worker) {
+        long sum = 0;
+        for (int i = start; i < end; i++)
+            sum += i;
+        sums[worker] += sum;
+    };
+
+    auto start = Clock::now();
+    for (int b = 0; b < num_batches; b++) {
+        for (int phase = 0; phase < 3; phase++) {
+            std::vector<std::thread> threads;
+            int size = vehicles / workers;
+            for (int i = 0; i < workers; i++) {
+                int end = i == workers - 1 ? vehicles : (i + 1) * size;
+                threads.emplace_back(work, i * size, end, i);
+            }
+            for (auto& thread : threads)
+                thread.join();
+        }
+    }
+    double spawn_time = elapsed_us(start) / num_batches;
+
+    ThreadPool pool(workers);
+    start = Clock::now();
+    for (int b = 0; b < num_batches; b++) {
+        for (int phase = 0; phase < 3; phase++)
+            pool.parallel_for(0, vehicles, chunk_size, work);
+    }
+    double pool_time = elapsed_us(start) / num_batches;
+
+    std::cout << "workers=" << workers << " veículos=" << vehicles << " lotes=" << num_batches << '\n';
+    std::cout << "threads por lote: " << spawn_time << " us/lote\n";
+    std::cout << "pool persistente: " << pool_time << " us/lote\n";
+}
+
+/// Instante atual em segundos, usado como timestamp dos ciclos enviados pelos clientes.
+double now_seconds() {
+    return std::chrono::duration<double>(Clock::now().time_since_epoch()).count();
+}
+
+/// Mede a vazão da recepção de ciclos e a latência entre o envio de cada ciclo e sua retirada
+/// da fila pelo consumidor, que faz o papel do orquestrador, com `connections` simuladores
+/// enviando ao mesmo tempo pelo servidor de callbacks.
+void bench_ingest(int connections, int cycles_per_connection, int vehicles) {
+    IngestService service;
+    grpc::ServerBuilder builder;
+    int port = 0;
+    builder.AddListeningPort("localhost:0", grpc::InsecureServerCredentials(), &port);
+    builder.RegisterService(&service);
+    std::unique_ptr<grpc::Server> server = builder.BuildAndStart();
+
+    size_t total = static_cast<size_t>(connections) * cycles_per_connection;
+    std::vector<double> latencies;
+    latencies.reserve(total);
+    std::thread consumer([&service, &latencies, total] {
+        IngestedCycle cycle;
+        while (latencies.size() < total) {
+            uint32_t ticket = service.ticket();
+            if (!service.pop(cycle)) {
+                service.wait(ticket);
+                continue;
+            }
+            latencies.push_back(now_seconds() - cycle.timestamp());
+        }
+    });
+
+    auto start = Clock::now();
+    std::vector<std::thread> clients;
+    for (int c = 0; c < connections; c++) {
+        clients.emplace_back([port, c, cycles_per_connection, vehicles] {
+            grpc::ChannelArguments args;
+            // Cada cliente abre a própria conexão, como simuladores em processos separados
+            args.SetInt(GRPC_ARG_USE_LOCAL_SUBCHANNEL_POOL, 1);
+            auto channel = grpc::CreateCustomChannel("localhost:" + std::to_string(port),
+                                                     grpc::InsecureChannelCredentials(), args);
+            auto stub = simulation::SimulationService::NewStub(channel);
+
+            simulation::SimulationCycle cycle;
+            simulation::Highway* highway = cycle.mutable_highway();
+            highway->set_name("Rodovia " + std::to_string(c));
+            highway->set_lanes(4);
+            highway->set_size(1000);
+            highway->set_speed_limit(5);
+            for (int v = 0; v < vehicles; v++) {
+                simulation::RawVehicle* vehicle = cycle.add_vehicles();
+                std::string plate = std::to_string(1000000 + c * vehicles + v);
+                vehicle->set_plate(plate.substr(plate.size() - 7));
+                vehicle->set_lane(v % 2);
+                vehicle->set_direction(v % 2);
+                vehicle->set_distance(v);
+            }
+            for (int i = 0; i < cycles_per_connection; i++) {
+                grpc::ClientContext context;
+                simulation::Empty response;
+                cycle.set_cycle(i);
+                cycle.set_timestamp(now_seconds());
+                stub->ReportCycle(&context, cycle, &response);
+            }
+        });
+    }
+    for (auto& client : clients)
+        client.join();
+    consumer.join();
+    double seconds = elapsed_us(start) / 1e6;
+    server->Shutdown();
+
+    std::sort(latencies.begin(), latencies.end());
+    double p50 = latencies[latencies.size() / 2] * 1e3;
+    double p99 = latencies[std::min(latencies.size() - 1, latencies.size() * 99 / 100)] * 1e3;
+    std::cout << "conexões=" << connections << ": " << total / seconds << " ciclos/s, latência p50 "
+              << p50 << " ms, p99 " << p99 << " ms\n";
+}
+
+/// Gera `num_cycles` ciclos de uma rodovia com cerca de `vehicles` veículos, que mantêm a
+/// velocidade na maior parte do tempo, como no simulador.
+std::vector<simulation::SimulationCycle> generate_cycles(int num_cycles, int vehicles) {
+    static const char symbols[] = "0123456789abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ";
+    static const uint32_t size = 100000;
+    std::mt19937 rng(42);
+    auto random = [&rng](uint32_t n) {
+        return static_cast<uint32_t>(rng() % n);
+    };
+    auto new_plate = [&random] {
+        std::string plate(7, ' ');
+        for (char& c : plate)
+            c = symbols[random(62)];
+        return plate;
+    };
+    struct Car {
+        std::string plate;
+        bool direction;
+        uint32_t lane;
+        uint32_t distance;
+        uint32_t speed;
+    };
+    std::vector<Car> cars;
+    for (int v = 0; v < vehicles; v++)
+        cars.push_back({new_plate(), v % 2 == 1, random(4), random(size), 1 + random(5)});
+
+    std::vector<simulation::SimulationCycle> cycles(num_cycles);
+    for (int c = 0; c < num_cycles; c++) {
+        for (Car& car : cars) {
+            // Poucos veículos mudam de velocidade ou de faixa a cada ciclo
+            if (random(20) == 0)
+                car.speed = 1 + random(5);
+            if (random(100) == 0)
+                car.lane = random(4);
+            car.distance += car.speed;
+            // Quem chega ao fim sai da rodovia e dá lugar a um veículo novo
+            if (car.distance >= size)
+                car = {new_plate(), car.direction, random(4), 0, 1 + random(5)};
+        }
+        simulation::SimulationCycle& cycle = cycles[c];
+        cycle.set_cycle(c);
+        cycle.set_timestamp(c);
+        simulation::Highway* highway = cycle.mutable_highway();
+        highway->set_name("Rodovia");
+        highway->set_lanes(8);
+        highway->set_size(size);
+        highway->set_speed_limit(5);
+        for (const Car& car : cars) {
+            simulation::RawVehicle* vehicle = cycle.add_vehicles();
+            vehicle->set_plate(car.plate);
+            vehicle->set_direction(car.direction);
+            vehicle->set_lane(car.lane);
+            vehicle->set_distance(car.distance);
+        }
+    }
+    return cycles;
+}
+
+/// Compara o formato completo com o delta: bytes na rede e tempo para interpretar cada
+/// veículo, incluindo a busca da placa no registro, que o delta só faz quando o veículo entra.
+/// Troca `churn` dos veículos por placas novas a cada ciclo de uma mesma conexão delta e confere
+/// que os dicionários do `DeltaEncoder` e do `DeltaDecoder` continuam do tamanho da rodovia, e
+/// não do número de placas já vistas, e que o decodificado bate com os ciclos completos. Retorna o
+/// número de divergências.
+int check_delta_churn(int num_cycles, int vehicles, double churn) {
+    std::mt19937 rng(7);
+    int next_plate = 0;
+    auto new_plate = [&next_plate] {
+        char plate[8];
+        std::snprintf(plate, sizeof(plate), "D%06d", next_plate++ % 1000000);
+        return std::string(plate);
+    };
+    std::vector<std::pair<std::string, uint32_t>> cars;
+    for (int v = 0; v < vehicles; v++)
+        cars.emplace_back(new_plate(), 0);
+
+    auto noop = [](uint32_t) {};
+    VehicleRegistry registry(4096);
+    auto resolve = [&registry, &noop](const std::string& plate) {
+        return registry.find_or_insert(plate, noop).first;
+    };
+    DeltaEncoder encoder;
+    DeltaDecoder decoder;
+    simulation::SimulationCycle cycle;
+    simulation::DeltaCycle delta;
+    std::string wire;
+    std::vector<DeltaVehicle> decoded;
+    int divergences = 0;
+    size_t max_capacity = 0;
+    for (int c = 0; c < num_cycles; c++) {
+        cycle.Clear();
+        cycle.set_cycle(c);
+        uint64_t expected = 0;
+        for (auto& [plate, distance] : cars) {
+            if (rng() % 1000 < churn * 1000)
+                plate = new_plate(), distance = 0;
+            distance += 1 + rng() % 3;
+            simulation::RawVehicle* vehicle = cycle.add_vehicles();
+            vehicle->set_plate(plate);
+            vehicle->set_distance(distance);
+            expected += resolve(plate) + distance;
+        }
+        encoder.encode(cycle, 1, delta);
+        delta.SerializeToString(&wire);
+        delta.ParseFromString(wire);
+        decoder.apply(delta, 4, resolve, decoded);
+        uint64_t checksum = 0;
+        for (const DeltaVehicle& vehicle : decoded)
+            checksum += vehicle.id + vehicle.distance;
+        divergences += checksum != expected || decoded.size() != cars.size();
+        max_capacity = std::max({max_capacity, decoder.capacity(), size_t(encoder.capacity())});
+    }
+    // As referências liberadas em um ciclo só voltam no seguinte, então o dicionário pode passar
+    // da rodovia no máximo pelos veículos que saem de uma vez
+    if (max_capacity > 2 * size_t(vehicles))
+        divergences++;
+    std::cout << "troca de " << churn * 100 << "% por ciclo: " << next_plate << " placas, dicionário com até "
+              << max_capacity << " referências para " << vehicles << " veículos\n";
+    return divergences;
+}
+
+/// Retorna falso se os formatos ou os dicionários delta divergirem.
+bool bench_delta(int num_cycles, int vehicles) {
+    std::vector<simulation::SimulationCycle> cycles = generate_cycles(num_cycles, vehicles);
+    std::vector<std::string> full_wire(num_cycles);
+    std::vector<std::string> delta_wire(num_cycles);
+    size_t full_bytes = 0;
+    size_t delta_bytes = 0;
+    size_t total_vehicles = 0;
+    DeltaEncoder encoder;
+    simulation::DeltaCycle delta;
+    for (int c = 0; c < num_cycles; c++) {
+        cycles[c].SerializeToString(&full_wire[c]);
+        encoder.encode(cycles[c], 1, delta);
+        delta.SerializeToString(&delta_wire[c]);
+        full_bytes += full_wire[c].size();
+        delta_bytes += delta_wire[c].size();
+        total_vehicles += cycles[c].vehicles_size();
+    }
+
+    auto noop = [](uint32_t) {};
+    uint64_t checksum = 0;
+    {
+        VehicleRegistry registry(4096);
+        simulation::SimulationCycle cycle;
+        auto start = Clock::now();
+        for (int c = 0; c < num_cycles; c++) {
+            cycle.ParseFromString(full_wire[c]);
+            for (const simulation::RawVehicle& vehicle : cycle.vehicles())
+                checksum += registry.find_or_insert(vehicle.plate(), noop).first + vehicle.distance();
+        }
+        double ns = elapsed_us(start) * 1e3 / total_vehicles;
+        std::cout << "completo: " << static_cast<double>(full_bytes) / total_vehicles << " bytes/veículo, "
+                  << ns << " ns/veículo\n";
+    }
+    {
+        VehicleRegistry registry(4096);
+        DeltaDecoder decoder;
+        std::vector<DeltaVehicle> decoded;
+        auto resolve = [&registry, &noop](const std::string& plate) {
+            return registry.find_or_insert(plate, noop).first;
+        };
+        auto start = Clock::now();
+        for (int c = 0; c < num_cycles; c++) {
+            delta.ParseFromString(delta_wire[c]);
+            decoder.apply(delta, 4, resolve, decoded);
+            for (const DeltaVehicle& vehicle : decoded)
+                checksum -= vehicle.id + vehicle.distance;
+        }
+        double ns = elapsed_us(start) * 1e3 / total_vehicles;
+        std::cout << "delta:    " << static_cast<double>(delta_bytes) / total_vehicles << " bytes/veículo, "
+                  << ns << " ns/veículo\n";
+    }
+    // Os dois formatos devem produzir os mesmos ids e distâncias
+    bool ok = true;
+    if (checksum != 0) {
+        std::cerr << "Os formatos divergiram!\n";
+        ok = false;
+    }
+    if (check_delta_churn(num_cycles, vehicles, 0.05) > 0) {
+        std::cerr << "Os dicionários delta cresceram ou divergiram com a troca de veículos!\n";
+        ok = false;
+    }
+    return ok;
+}
+
+/// Conta as alocações por veículo entre a chegada de um ciclo e a busca das placas no registro,
+/// que é o que o Extract faz. No caminho antigo, cada ciclo é lido campo a campo no heap e
+/// copiado para a fila; no novo, os ciclos de um lote são lidos na mesma arena, vão para a fila
+/// como ponteiros e a arena é liberada de uma vez depois do lote. Retorna falso se os caminhos
+/// divergirem.
+bool bench_alloc(int num_cycles, int vehicles, int batch_size) {
+    std::vector<simulation::SimulationCycle> cycles = generate_cycles(num_cycles, vehicles);
+    std::vector<std::string> wire(num_cycles);
+    size_t total_vehicles = 0;
+    for (int c = 0; c < num_cycles; c++) {
+        cycles[c].SerializeToString(&wire[c]);
+        total_vehicles += cycles[c].vehicles_size();
+    }
+    cycles.clear();
+
+    // Todas as placas já estão registradas, como em regime, para medir só o caminho dos ciclos
+    auto noop = [](uint32_t) {};
+    VehicleRegistry registry(4096);
+    {
+        simulation::SimulationCycle cycle;
+        for (const std::string& message : wire) {
+            cycle.ParseFromString(message);
+            for (const simulation::RawVehicle& vehicle : cycle.vehicles())
+                registry.find_or_insert(vehicle.plate(), noop);
+        }
+    }
+
+    auto report = [total_vehicles](const char* name, uint64_t allocations, Clock::time_point start) {
+        double ns = elapsed_us(start) * 1e3 / total_vehicles;
+        std::cout << name << static_cast<double>(allocations) / total_vehicles << " alocações/veículo, "
+                  << ns << " ns/veículo\n";
+    };
+    uint64_t checksum = 0;
+    {
+        MpscQueue<simulation::SimulationCycle> queue;
+        simulation::SimulationCycle popped;
+        uint64_t before = num_allocations.load();
+        auto start = Clock::now();
+        for (const std::string& message : wire) {
+            auto cycle = std::make_unique<simulation::SimulationCycle>();
+            cycle->ParseFromString(message);
+            queue.push(simulation::SimulationCycle(*cycle));
+            while (queue.pop(popped)) {
+                for (const simulation::RawVehicle& vehicle : popped.vehicles())
+                    checksum += registry.find(vehicle.plate());
+            }
+        }
+        report("heap:  ", num_allocations.load() - before, start);
+    }
+    {
+        MpscQueue<IngestedCycle> queue;
+        ArenaFactory arenas;
+        std::vector<IngestedCycle> batch;
+        batch.reserve(batch_size);
+        IngestedCycle popped;
+        uint64_t before = num_allocations.load();
+        auto start = Clock::now();
+        for (int c = 0; c < num_cycles; c += batch_size) {
+            std::shared_ptr<google::protobuf::Arena> arena = arenas.create();
+            for (int k = c; k < std::min(c + batch_size, num_cycles); k++) {
+                auto* cycle = google::protobuf::Arena::CreateMessage<simulation::SimulationCycle>(arena.get());
+                cycle->ParseFromString(wire[k]);
+                IngestedCycle ingested;
+                ingested.arena = arena;
+                ingested.cycle = cycle;
+                queue.push(std::move(ingested));
+            }
+            arenas.learn(*arena);
+            arena.reset();
+            while (queue.pop(popped)) {
+                for (const simulation::RawVehicle& vehicle : popped.cycle->vehicles())
+                    checksum -= registry.find(vehicle.plate());
+                batch.push_back(std::move(popped));
+            }
+            // Fim do lote: a arena é liberada com o último ciclo
+            batch.clear();
+        }
+        report("arena: ", num_allocations.load() - before, start);
+    }
+    if (checksum != 0) {
+        std::cerr << "Os caminhos divergiram!\n";
+        return false;
+    }
+    return true;
+}
+
+/// Compara os dois transportes de entrada com um simulador enviando `num_cycles` ciclos de
+/// `vehicles` veículos, a `rate` ciclos por segundo (0 para o máximo possível): uma chamada de
+/// StreamCycles pelo gRPC local e um anel de memória compartilhada. O consumidor faz o papel do
+/// orquestrador e mede a vazão em veículos por segundo e a latência desde o envio de cada ciclo.
+/// Retorna falso se algum veículo se perder.
+bool bench_transport(const std::string& transport, int num_cycles, int vehicles, double rate) {
+    IngestService service;
+    size_t total = num_cycles;
+    std::vector<double> latencies;
+    latencies.reserve(total);
+    uint64_t checksum = 0;
+    std::thread consumer([&service, &latencies, &checksum, total] {
+        IngestedCycle cycle;
+        while (latencies.size() < total) {
+            uint32_t ticket = service.ticket();
+            if (!service.pop(cycle)) {
+                service.wait(ticket);
+                continue;
+            }
+            latencies.push_back(now_seconds() - cycle.timestamp());
+            // Percorre os veículos, como o Extract
+            if (cycle.is_record()) {
+                for (uint32_t i = 0; i < cycle.record->num_vehicles; i++)
+                    checksum += cycle.record->vehicles()[i].distance;
+            } else {
+                for (const simulation::RawVehicle& vehicle : cycle.cycle->vehicles())
+                    checksum += vehicle.distance();
+            }
+        }
+    });
+
+    std::vector<ShmVehicle> fleet(vehicles);
+    for (int v = 0; v < vehicles; v++) {
+        std::string plate = std::to_string(1000000 + v);
+        std::memcpy(fleet[v].plate, plate.data() + plate.size() - 7, 7);
+        fleet[v].plate[7] = '\0';
+        fleet[v].lane = v % 2;
+        fleet[v].direction = v % 2;
+        fleet[v].distance = v;
+    }
+    // Espera até o instante de envio do ciclo i, se a taxa for limitada
+    auto start = Clock::now();
+    auto pace = [start, rate](int i) {
+        if (rate > 0)
+            std::this_thread::sleep_until(start + std::chrono::duration_cast<Clock::duration>(
+                                                      std::chrono::duration<double>(i / rate)));
+    };
+
+    if (transport == "grpc") {
+        grpc::ServerBuilder builder;
+        int port = 0;
+        builder.AddListeningPort("localhost:0", grpc::InsecureServerCredentials(), &port);
+        builder.RegisterService(&service);
+        std::unique_ptr<grpc::Server> server = builder.BuildAndStart();
+        auto stub = simulation::SimulationService::NewStub(
+            grpc::CreateChannel("localhost:" + std::to_string(port), grpc::InsecureChannelCredentials()));
+
+        simulation::Highway highway;
+        highway.set_name("Rodovia");
+        highway.set_lanes(4);
+        highway.set_size(1000);
+        highway.set_speed_limit(5);
+        simulation::HighwayId id;
+        {
+            grpc::ClientContext context;
+            stub->RegisterHighway(&context, highway, &id);
+        }
+        simulation::SimulationCycle cycle;
+        cycle.set_highway_id(id.id());
+        for (const ShmVehicle& car : fleet) {
+            simulation::RawVehicle* vehicle = cycle.add_vehicles();
+            vehicle->set_plate(car.plate);
+            vehicle->set_lane(car.lane);
+            vehicle->set_direction(car.direction);
+            vehicle->set_distance(car.distance);
+        }
+        start = Clock::now();
+        grpc::ClientContext context;
+        simulation::Empty response;
+        auto writer = stub->StreamCycles(&context, &response);
+        for (int i = 0; i < num_cycles; i++) {
+            pace(i);
+            cycle.set_cycle(i);
+            cycle.set_timestamp(now_seconds());
+            writer->Write(cycle);
+        }
+        writer->WritesDone();
+        writer->Finish();
+        consumer.join();
+        server->Shutdown();
+    } else {
+        // Um prefixo próprio, para não competir com um ETL rodando na mesma máquina
+        // O anel é criado antes, para que a primeira busca do consumidor já o encontre
+        ShmRingWriter ring("/highway-bench-" + std::to_string(getpid()), "Rodovia", 4, 1000, 5, 64, vehicles);
+        ShmIngest ingest(service, "highway-bench-");
+        ingest.start();
+        start = Clock::now();
+        for (int i = 0; i < num_cycles; i++) {
+            pace(i);
+            ring.push(i, now_seconds(), fleet.data(), vehicles);
+        }
+        consumer.join();
+        ingest.stop();
+    }
+    double seconds = elapsed_us(start) / 1e6;
+
+    std::sort(latencies.begin(), latencies.end());
+    auto percentile = [&latencies](double p) {
+        return latencies[std::min(latencies.size() - 1, static_cast<size_t>(latencies.size() * p))] * 1e6;
+    };
+    std::cout << transport << ": " << total * vehicles / seconds << " veículos/s, latência p50 "
+              << percentile(0.5) << " us, p99 " << percentile(0.99) << " us, p99.9 " << percentile(0.999)
+              << " us\n";
+    if (checksum != static_cast<uint64_t>(num_cycles) * vehicles * (vehicles - 1) / 2) {
+        std::cerr << "Veículos perdidos no transporte " << transport << "!\n";
+        return false;
+    }
+    return true;
+}
+
+/// Confere que `TextCycle::parse` recusa cabeçalhos com campos faltando, sobrando ou que não são
+/// números, sem ler além da linha, e aceita um cabeçalho válido. Retorna o número de divergências.
+int check_cycle_headers(const std::filesystem::path& folder) {
+    const std::pair<const char*, bool> headers[] = {
+        {"4 100 120 7 1.5", true},  {"4 100 120", false},        {"", false},
+        {"4 100 120 7", false},     {"4 100 120 7 abc", false},  {"4 x 120 7 1.5", false},
+        {"4 100 120 7 1.5 9", false}, {"4  100 120 7 1.5", false},
+    };
+    int divergences = 0;
+    for (const auto& [header, valid] : headers) {
+        std::filesystem::path path = folder / "header.txt";
+        {
+            std::ofstream file(path);
+            file << "BR-101\n" << header << "\nABC1D23 0 1 10\n";
+        }
+        bool accepted = true;
+        try {
+            TextCycle cycle = TextCycle::parse(std::make_shared<MappedFile>(path.string()));
+            accepted = cycle.lanes == 4 && cycle.size == 100 && cycle.cycle == 7 && cycle.timestamp == 1.5;
+        } catch (const std::runtime_error&) {
+            accepted = false;
+        }
+        if (accepted != valid) {
+            std::cerr << "Cabeçalho \"" << header << "\" " << (valid ? "recusado" : "aceito") << "!\n";
+            divergences++;
+        }
+    }
+    std::filesystem::remove(folder / "header.txt");
+    return divergences;
+}
+
+/// Mede a vazão da interpretação de arquivos de ciclo já gravados (e no cache do sistema):
+/// caractere a caractere com as funções de conversions.hpp, como era feito antes, com a busca
+/// de delimitadores por SIMD em uma thread, e dividida por blocos de bytes entre `workers`
+/// threads, com e sem o registro das placas. Retorna falso se algum cabeçalho inválido for aceito
+/// ou o válido recusado.
+bool bench_files(int num_cycles, int vehicles, int workers) {
+    std::filesystem::path folder = std::filesystem::temp_directory_path() /
+                                   ("highway-bench-files-" + std::to_string(getpid()));
+    std::filesystem::create_directories(folder);
+    std::vector<simulation::SimulationCycle> generated = generate_cycles(num_cycles, vehicles);
+    for (int c = 0; c < num_cycles; c++) {
+        const simulation::SimulationCycle& cycle = generated[c];
+        std::ofstream file(folder / (std::to_string(c) + ".txt"));
+        const simulation::Highway& highway = cycle.highway();
+        file << highway.name() << '\n' << highway.lanes() << ' ' << highway.size() << ' '
+             << highway.speed_limit() << ' ' << cycle.cycle() << ' ' << std::fixed << cycle.timestamp() << '\n';
+        for (const simulation::RawVehicle& vehicle : cycle.vehicles())
+            file << vehicle.plate() << ' ' << vehicle.direction() << ' ' << vehicle.lane() << ' '
+                 << vehicle.distance() << '\n';
+    }
+    generated.clear();
+
+    std::vector<TextCycle> cycles;
+    size_t total_bytes = 0;
+    for (int c = 0; c < num_cycles; c++) {
+        cycles.push_back(TextCycle::parse(std::make_shared<MappedFile>((folder / (std::to_string(c) + ".txt")).string())));
+        total_bytes += cycles.back().file->size();
+    }
+    int divergences = check_cycle_headers(folder);
+    std::filesystem::remove_all(folder);
+    std::cout << "cabeçalhos inválidos: " << divergences << " divergências\n";
+
+    auto report = [total_bytes](const std::string& name, Clock::time_point start, uint64_t checksum) {
+        double seconds = elapsed_us(start) / 1e6;
+        std::cout << name << total_bytes / seconds / 1e9 << " GB/s (soma " << checksum << ")\n";
+    };
+    {
+        uint64_t checksum = 0;
+        auto start = Clock::now();
+        for (const TextCycle& cycle : cycles) {
+            std::string_view text(cycle.begin, cycle.end - cycle.begin);
+            size_t line = 0;
+            while (line < text.size()) {
+                // Procura o fim da placa e converte os campos até cada separador
+                int index = text.find(' ', line) - line + 1;
+                const char* str = text.data() + line;
+                int direction = str_to_int(str, index, ' ');
+                int lane = str_to_int(str, index, ' ');
+                int distance = str_to_int(str, index, '\n');
+                checksum += direction + lane + distance;
+                line += index;
+            }
+        }
+        report("caractere a caractere:   ", start, checksum);
+    }
+    auto sum_fields = [](uint64_t& checksum) {
+        return [&checksum](std::string_view, uint32_t direction, uint32_t lane, uint32_t distance) {
+            checksum += direction + lane + distance;
+        };
+    };
+    {
+        uint64_t checksum = 0;
+        auto start = Clock::now();
+        for (const TextCycle& cycle : cycles)
+            parse_vehicles(cycle.begin, cycle.end, sum_fields(checksum));
+        report("SIMD, 1 thread:          ", start, checksum);
+    }
+
+    ThreadPool pool(workers);
+    std::vector<std::pair<const char*, const char*>> chunks;
+    for (const TextCycle& cycle : cycles) {
+        auto split = delimiters::split_lines(cycle.begin, cycle.end, 1 << 16);
+        chunks.insert(chunks.end(), split.begin(), split.end());
+    }
+    std::vector<uint64_t> sums(workers);
+    auto total = [&sums] {
+        uint64_t sum = 0;
+        for (uint64_t& value : sums) {
+            sum += value;
+            value = 0;
+        }
+        return sum;
+    };
+    {
+        auto start = Clock::now();
+        pool.parallel_for(0, chunks.size(), 1, [&](int begin, int end, int worker) {
+            for (int k = begin; k < end; k++)
+                parse_vehicles(chunks[k].first, chunks[k].second, sum_fields(sums[worker]));
+        });
+        report("SIMD, " + std::to_string(workers) + " threads:         ", start, total());
+    }
+    {
+        VehicleRegistry registry(4096);
+        auto noop = [](uint32_t) {};
+        auto start = Clock::now();
+        pool.parallel_for(0, chunks.size(), 1, [&](int begin, int end, int worker) {
+            uint64_t& checksum = sums[worker];
+            for (int k = begin; k < end; k++) {
+                parse_vehicles(chunks[k].first, chunks[k].second, [&](std::string_view plate, uint32_t direction,
+                                                                      uint32_t lane, uint32_t distance) {
+                    registry.find_or_insert(plate, noop);
+                    checksum += direction + lane + distance;
+                });
+            }
+        });
+        report("SIMD + registro, " + std::to_string(workers) + " threads: ", start, total());
+    }
+    return divergences == 0;
+}
+
+/// Compara os resultados dos kernels de conversions.hpp com std::from_chars em `iterations`
+/// campos aleatórios, válidos e inválidos. Retorna o número de divergências.
+int fuzz_numbers(int iterations) {
+    std::mt19937_64 rng(7);
+    std::uniform_int_distribution<int> digit('0', '9');
+    std::uniform_int_distribution<int> any_char(0, 255);
+    auto random_digits = [&](int size) {
+        std::string text;
+        for (int i = 0; i < size; i++)
+            text += static_cast<char>(digit(rng));
+        return text;
+    };
+    int errors = 0;
+    auto check = [&errors](bool ok, const std::string& what, const std::string& text) {
+        if (!ok && ++errors <= 10)
+            std::cerr << "Divergência em " << what << ": \"" << text << "\"\n";
+    };
+
+    for (int i = 0; i < iterations; i++) {
+        int size = 1 + rng() % 19;
+        std::string text = random_digits(size);
+        // Um caractere qualquer em uma posição qualquer, às vezes
+        bool corrupt = rng() % 4 == 0;
+        if (corrupt)
+            text[rng() % size] = static_cast<char>(any_char(rng));
+        uint64_t expected = 0;
+        auto [ptr, ec] = std::from_chars(text.data(), text.data() + size, expected);
+        bool expected_valid = ec == std::errc() && ptr == text.data() + size;
+
+        uint64_t value;
+        bool valid = digits::parse(text.data(), text.data() + size, value);
+        check(valid == expected_valid && (!valid || value == expected), "digits::parse", text);
+
+        if (size <= 8) {
+            // Bytes quaisquer antes do campo, que o kernel deve ignorar
+            std::string padded(8, static_cast<char>(any_char(rng)));
+            padded += text;
+            uint32_t tail;
+            valid = digits::parse_tail(padded.data() + padded.size(), size, tail);
+            check(valid == expected_valid && (!valid || tail == expected), "digits::parse_tail", text);
+        }
+        if (!corrupt && size <= 9) {
+            std::string field = (rng() % 2 ? "-" : "") + text + ' ';
+            int index = 0;
+            int parsed = str_to_int(field.c_str(), index, ' ');
+            int reference = 0;
+            std::from_chars(field.data(), field.data() + field.size() - 1, reference);
+            check(parsed == reference && index == static_cast<int>(field.size()), "str_to_int", field);
+        }
+
+        // Decimais como o timestamp dos ciclos
+        std::string decimal = (rng() % 2 ? "-" : "") + random_digits(1 + rng() % 10) + '.' +
+                              random_digits(1 + rng() % 22);
+        double reference = 0;
+        std::from_chars(decimal.data(), decimal.data() + decimal.size(), reference);
+        // As conversões arredondam duas vezes (fração e soma), então podem diferir no último bit
+        auto close = [reference](double x) {
+            return std::abs(x - reference) <= 4 * std::abs(reference) * std::numeric_limits<double>::epsilon();
+        };
+        double parsed;
+        valid = digits::parse_decimal(decimal.data(), decimal.data() + decimal.size(), parsed);
+        check(valid && close(parsed), "digits::parse_decimal", decimal);
+        std::string field = decimal + '\n';
+        int index = 0;
+        check(close(str_to_double(field.c_str(), index, '\n')), "str_to_double", field);
+    }
+    return errors;
+}
+
+/// Mede o custo por campo de cada forma de converter as colunas numéricas dos arquivos de ciclo,
+/// no formato do Google Benchmark: as funções de conversions.hpp, std::from_chars e os kernels
+/// SWAR/SIMD. Cada coluna tem `fields` valores em um único texto, separados por espaços. Retorna
+/// falso se o fuzz encontrar divergências.
+bool bench_numbers(int fields, int fuzz_iterations) {
+    int errors = fuzz_numbers(fuzz_iterations);
+    std::cout << "fuzz: " << fuzz_iterations << " casos, " << errors << " divergências\n";
+
+    std::mt19937_64 rng(11);
+    struct Column {
+        std::string name;
+        std::string text;
+        std::vector<std::pair<int, int>> fields;
+    };
+    auto make_column = [&](const std::string& name, auto&& generate) {
+        Column column{name, "", {}};
+        // Os kernels que leem antes do campo precisam de 8 bytes no início do texto
+        column.text = "        ";
+        for (int i = 0; i < fields; i++) {
+            std::string value = generate();
+            column.fields.emplace_back(column.text.size(), value.size());
+            column.text += value + ' ';
+        }
+        return column;
+    };
+    std::vector<Column> integers = {
+        make_column("faixa", [&] { return std::to_string(rng() % 6); }),
+        make_column("distância", [&] { return std::to_string(rng() % 100000); }),
+        make_column("8 dígitos", [&] { return std::to_string(10000000 + rng() % 90000000); }),
+        make_column("16 dígitos", [&] { return std::to_string(1000000000000000 + rng() % 9000000000000000); }),
+    };
+    Column timestamps = make_column("timestamp", [&] {
+        std::ostringstream value;
+        value << std::fixed << std::setprecision(6) << 1.7e9 + (rng() % 100000000) / 1e3;
+        return value.str();
+    });
+
+    auto run = [fields](const std::string& name, const Column& column, auto&& parse) {
+        const char* text = column.text.data();
+        uint64_t checksum = 0;
+        int repetitions = std::max(1, 20000000 / fields);
+        auto start = Clock::now();
+        for (int r = 0; r < repetitions; r++) {
+            for (auto [offset, size] : column.fields)
+                checksum += parse(text + offset, size);
+        }
+        double ns = elapsed_us(start) * 1e3 / (static_cast<double>(repetitions) * fields);
+        std::cout << std::left << std::setw(40) << ("BM_" + name + "/" + column.name) << std::right
+                  << std::setw(8) << std::fixed << std::setprecision(2) << ns << " ns/campo   (soma "
+                  << checksum << ")\n";
+    };
+
+    for (const Column& column : integers) {
+        run("str_to_int", column, [](const char* field, int size) -> uint64_t {
+            int index = 0;
+            // Os campos de 16 dígitos não cabem em um int: só mede o custo
+            return static_cast<uint32_t>(str_to_int(field, index, ' '));
+        });
+        run("from_chars", column, [](const char* field, int size) {
+            uint64_t value = 0;
+            std::from_chars(field, field + size, value);
+            return value;
+        });
+        run("digits::parse", column, [](const char* field, int size) {
+            uint64_t value;
+            digits::parse(field, field + size, value);
+            return value;
+        });
+        if (column.fields.front().second <= 8) {
+            run("digits::parse_tail", column, [](const char* field, int size) -> uint64_t {
+                uint32_t value;
+                digits::parse_tail(field + size, size, value);
+                return value;
+            });
+        }
+    }
+    run("str_to_double", timestamps, [](const char* field, int size) {
+        int index = 0;
+        return static_cast<uint64_t>(str_to_double(field, index, ' ') * 1e3);
+    });
+    run("from_chars", timestamps, [](const char* field, int size) {
+        double value = 0;
+        std::from_chars(field, field + size, value);
+        return static_cast<uint64_t>(value * 1e3);
+    });
+    run("digits::parse_decimal", timestamps, [](const char* field, int size) {
+        double value;
+        digits::parse_decimal(field, field + size, value);
+        return static_cast<uint64_t>(value * 1e3);
+    });
+    return errors == 0;
+}
+
+/// Mede a conversão das placas em códigos e o espalhamento dos hashes com `count` placas, metade
+/// no formato do simulador (7 símbolos alfanuméricos quaisquer) e metade no formato Mercosul
+/// (LLLNLNN), e a vazão de buscas no registro com todas elas registradas.
+void bench_plates(size_t count) {
+    std::mt19937_64 rng(13);
+    static const char symbols[] = "0123456789abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ";
+    std::vector<Plate> plates(count);
+    for (size_t i = 0; i < count; i++) {
+        char* plate = plates[i].plate;
+        if (i % 2 == 0) {
+            for (int k = 0; k < 7; k++)
+                plate[k] = symbols[rng() % 62];
+        } else {
+            for (int k = 0; k < 7; k++)
+                plate[k] = k == 3 || k >= 5 ? '0' + rng() % 10 : 'A' + rng() % 26;
+        }
+    }
+
+    // Conversão de ida e volta, uma por vez e em lotes
+    std::vector<uint64_t> codes(count), batch(count);
+    auto start = Clock::now();
+    for (size_t i = 0; i < count; i++)
+        codes[i] = plate_code::encode(plates[i].plate, 7);
+    double scalar_ns = elapsed_us(start) * 1e3 / count;
+    start = Clock::now();
+    plate_code::encode_batch(plates[0].plate, sizeof(Plate), count, batch.data());
+    double batch_ns = elapsed_us(start) * 1e3 / count;
+    size_t errors = 0;
+    for (size_t i = 0; i < count; i++)
+        errors += codes[i] != batch[i] || Plate(codes[i]) != plates[i] || codes[i] >> 42 != 0;
+    std::cout << "conversão: " << scalar_ns << " ns/placa uma por vez, " << batch_ns << " ns/placa em lotes, "
+              << errors << " erros de ida e volta\n";
+
+    // Fração das placas que caem em um bucket já ocupado de uma tabela com o dobro de posições,
+    // como a do registro, usando os bits baixos do hash
+    size_t buckets = 1;
+    while (buckets < 2 * count)
+        buckets *= 2;
+    double ideal = 1.0 - static_cast<double>(buckets) / count * (1.0 - std::exp(-static_cast<double>(count) / buckets));
+    auto collisions = [&](const std::string& name, auto&& hash) {
+        std::vector<bool> used(buckets);
+        size_t collided = 0;
+        for (size_t i = 0; i < count; i++) {
+            size_t bucket = hash(i) & (buckets - 1);
+            collided += used[bucket];
+            used[bucket] = true;
+        }
+        std::cout << std::left << std::setw(48) << name << std::right << std::fixed << std::setprecision(2)
+                  << 100.0 * collided / count << "% de colisões (ideal " << 100.0 * ideal << "%)\n";
+    };
+    auto raw = [&plates](size_t i) {
+        uint64_t bytes;
+        std::memcpy(&bytes, plates[i].plate, sizeof(bytes));
+        return bytes;
+    };
+    collisions("bytes da placa (std::hash<Plate> antigo):", raw);
+    collisions("bytes da placa * φ ^ >> 29 (registro antigo):", [&raw](size_t i) {
+        uint64_t key = raw(i) * 0x9E3779B97F4A7C15ull;
+        return (key ^ (key >> 29)) >> 6;
+    });
+    collisions("código da placa:", [&codes](size_t i) { return codes[i]; });
+    collisions("fmix64 do código (registro atual):", [&codes](size_t i) { return plate_code::mix(codes[i]) >> 6; });
+    std::cout.unsetf(std::ios::fixed);
+    std::cout << std::setprecision(6);
+
+    VehicleRegistry registry(count);
+    auto noop = [](uint32_t) {};
+    start = Clock::now();
+    for (size_t i = 0; i < count; i++)
+        registry.find_or_insert(codes[i], noop);
+    double insert_s = elapsed_us(start) / 1e6;
+    std::vector<uint32_t> order(count);
+    for (size_t i = 0; i < count; i++)
+        order[i] = rng() % count;
+    uint64_t checksum = 0;
+    start = Clock::now();
+    for (uint32_t i : order)
+        checksum += registry.find(codes[i]);
+    double find_code_s = elapsed_us(start) / 1e6;
+    start = Clock::now();
+    for (uint32_t i : order)
+        checksum += registry.find(std::string_view(plates[i].plate, 7));
+    double find_plate_s = elapsed_us(start) / 1e6;
+    std::cout << "registro: " << count / insert_s / 1e6 << " M inserções/s, " << count / find_code_s / 1e6
+              << " M buscas/s por código, " << count / find_plate_s / 1e6 << " M buscas/s por placa (soma "
+              << checksum << ")\n";
+}
+
+/// Compara os kernels do Transform (motion.hpp) em um lote de `vehicles` veículos com valores
+/// realistas: tempo por veículo de cada kernel suportado pela CPU e maior diferença em relação
+/// ao caminho escalar.
+void bench_transform(int vehicles, int repetitions) {
+    std::mt19937 rng(17);
+    std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+    motion::MotionBatch input;
+    input.resize(vehicles);
+    for (int i = 0; i < vehicles; i++) {
+        // A maioria dos veículos já tem histórico suficiente para o risco
+        uint32_t choice = rng() % 20;
+        input.seen[i] = choice < 4 ? choice : 4 + rng() % 100;
+        input.elapsed[i] = 1 + rng() % 3;
+        input.displacement[i] = static_cast<float>(rng() % 8) * input.elapsed[i];
+        input.speed_limit[i] = 3 + rng() % 4;
+        input.speed[i] = static_cast<float>(rng() % 8);
+        input.acceleration[i] = static_cast<float>(static_cast<int>(rng() % 5) - 2);
+        input.risk[i] = uniform(rng);
+    }
+
+    motion::MotionBatch reference = input;
+    motion::compute(reference, motion::Kernel::SCALAR);
+    std::vector<motion::Kernel> kernels{motion::Kernel::SCALAR};
+    if (motion::best_kernel() != motion::Kernel::SCALAR)
+        kernels.push_back(motion::Kernel::AVX2);
+    if (motion::best_kernel() == motion::Kernel::AVX512)
+        kernels.push_back(motion::Kernel::AVX512);
+
+    std::cout << "kernel escolhido: " << motion::kernel_name(motion::best_kernel()) << '\n';
+    motion::MotionBatch batch;
+    for (motion::Kernel kernel : kernels) {
+        double total_us = 0.0;
+        for (int r = 0; r < repetitions; r++) {
+            // Cada repetição parte dos mesmos valores anteriores, copiados fora da medição
+            batch = input;
+            auto start = Clock::now();
+            motion::compute(batch, kernel);
+            total_us += elapsed_us(start);
+        }
+        float speed_error = 0.0f, acceleration_error = 0.0f, risk_error = 0.0f;
+        int flag_errors = 0;
+        for (int i = 0; i < vehicles; i++) {
+            speed_error = std::max(speed_error, std::abs(batch.speed[i] - reference.speed[i]));
+            acceleration_error = std::max(acceleration_error, std::abs(batch.acceleration[i] - reference.acceleration[i]));
+            risk_error = std::max(risk_error, std::abs(batch.risk[i] - reference.risk[i]));
+            flag_errors += batch.flags[i] != reference.flags[i];
+        }
+        std::cout << std::left << std::setw(9) << motion::kernel_name(kernel) << std::right
+                  << total_us * 1e3 / (static_cast<double>(vehicles) * repetitions) << " ns/veículo, diferença máxima: "
+                  << "velocidade " << speed_error << ", aceleração " << acceleration_error << ", risco " << risk_error
+                  << ", " << flag_errors << " filtros diferentes\n";
+    }
+}
+
+// Mesmo formato de ETL::Position
+struct BenchPosition {
+    uint32_t lane;
+    uint32_t distance;
+    uint32_t cycle;
+};
+
+/// Regra com interface virtual, para comparar com a avaliação expandida do `RuleSet`.
+struct VirtualRule {
+    virtual ~VirtualRule() = default;
+    virtual bool applies(const rules::VehicleSample<RingBuffer<BenchPosition>>& vehicle) const = 0;
+    virtual float weight() const = 0;
+};
+
+template<typename Rule>
+struct VirtualAdapter : VirtualRule {
+    Rule rule;
+    bool applies(const rules::VehicleSample<RingBuffer<BenchPosition>>& vehicle) const override {
+        return rule(vehicle);
+    }
+    float weight() const override {
+        return Rule::weight;
+    }
+};
+
+/// Custo por veículo da avaliação das regras de alerta no laço do Transform: as flags fixas do
+/// kernel (comportamento antigo), os conjuntos compilados de rules.hpp e o conjunto completo com
+/// uma chamada virtual por regra.
+void bench_rules(int vehicles, int repetitions) {
+    const uint32_t depth = 10;
+    std::mt19937 rng(19);
+    std::vector<RingBuffer<BenchPosition>> positions(vehicles);
+    std::vector<float> speed(vehicles), risk(vehicles), speed_limit(vehicles), ttc(vehicles);
+    std::vector<uint8_t> motion_flags(vehicles);
+    for (int i = 0; i < vehicles; i++) {
+        positions[i].reset(depth);
+        speed_limit[i] = 3 + rng() % 4;
+        uint32_t lane = rng() % 4, distance = 0;
+        uint32_t count = 2 + rng() % (2 * depth);
+        for (uint32_t c = 0; c < count; c++) {
+            // Alguns veículos trocam de faixa com frequência
+            if (rng() % 8 == 0)
+                lane = rng() % 4;
+            distance += rng() % 9;
+            positions[i].push({lane, distance, c});
+        }
+        const BenchPosition& last = positions[i].back();
+        speed[i] = static_cast<float>(last.distance - positions[i].back(1).distance);
+        risk[i] = std::uniform_real_distribution<float>(0.0f, 1.0f)(rng);
+        motion_flags[i] = motion::flags_of(speed[i], risk[i], speed_limit[i]);
+        // Um quarto dos veículos se aproxima de alguém
+        ttc[i] = rng() % 4 == 0 ? std::uniform_real_distribution<float>(0.0f, 5.0f)(rng) : spatial::no_collision;
+    }
+    auto sample = [&](int i) {
+        return rules::VehicleSample<RingBuffer<BenchPosition>>{speed[i], 0.0f, risk[i], speed_limit[i],
+                                                               motion_flags[i], 1.0f, ttc[i], positions[i]};
+    };
+
+    std::vector<uint8_t> flags(vehicles);
+    std::vector<float> scores(vehicles);
+    auto measure = [&](const char* name, auto&& evaluate) {
+        int counts[rules::max_filters] = {};
+        double total_us = 0.0;
+        // A primeira repetição só aquece os caches e não é medida
+        for (int r = -1; r < repetitions; r++) {
+            auto start = Clock::now();
+            for (int i = 0; i < vehicles; i++) {
+                float weight = 0.0f;
+                flags[i] = evaluate(i, weight);
+                scores[i] = weight + std::max(risk[i], 0.0f);
+            }
+            if (r >= 0)
+                total_us += elapsed_us(start);
+        }
+        for (int i = 0; i < vehicles; i++) {
+            for (int f = 0; f < rules::max_filters; f++)
+                counts[f] += flags[i] >> f & 1;
+        }
+        std::cout << std::left << std::setw(22) << name << std::right << std::setw(8)
+                  << total_us * 1e3 / (static_cast<double>(vehicles) * repetitions) << " ns/veículo, filtros:";
+        for (int f = 0; f < rules::max_filters && counts[f]; f++)
+            std::cout << ' ' << counts[f];
+        std::cout << '\n';
+    };
+
+    measure("fixo", [&](int i, float& weight) {
+        uint8_t result = motion_flags[i];
+        weight = 2.0f * bool(result & motion::risk_flag) + bool(result & motion::speeding_flag);
+        return result;
+    });
+    std::vector<uint8_t> fixed = flags;
+    rules::DefaultRules default_rules;
+    measure("padrao", [&](int i, float& weight) { return default_rules(sample(i), weight); });
+    int mismatches = 0;
+    for (int i = 0; i < vehicles; i++)
+        mismatches += flags[i] != fixed[i];
+    std::cout << "diferenças entre padrao e fixo: " << mismatches << '\n';
+
+    rules::CompleteRules complete_rules;
+    measure("completo", [&](int i, float& weight) { return complete_rules(sample(i), weight); });
+    std::vector<std::unique_ptr<VirtualRule>> virtual_rules;
+    virtual_rules.push_back(std::make_unique<VirtualAdapter<rules::CollisionRisk>>());
+    virtual_rules.push_back(std::make_unique<VirtualAdapter<rules::AboveSpeedLimit>>());
+    virtual_rules.push_back(std::make_unique<VirtualAdapter<rules::ImminentCollision>>());
+    virtual_rules.push_back(std::make_unique<VirtualAdapter<rules::SustainedSpeeding>>());
+    virtual_rules.push_back(std::make_unique<VirtualAdapter<rules::FrequentLaneChanges>>());
+    measure("completo (virtual)", [&](int i, float& weight) {
+        uint8_t result = 1 << rules::all_filter;
+        auto vehicle = sample(i);
+        for (size_t r = 0; r < virtual_rules.size(); r++) {
+            if (virtual_rules[r]->applies(vehicle)) {
+                result |= 1 << (r + 1);
+                weight += virtual_rules[r]->weight();
+            }
+        }
+        return result;
+    });
+}
+
+/// Índice espacial (spatial_index.hpp) de uma rodovia com `vehicles` veículos andando por
+/// `cycles` ciclos: tempo por veículo da atualização incremental, de uma reconstrução com
+/// std::sort e do cálculo das distâncias e tempos até a colisão, conferidos por força bruta.
+/// Retorna falso se alguma distância divergir.
+bool bench_spatial(int vehicles, int cycles, uint32_t lanes) {
+    std::mt19937 rng(23);
+    // Cerca de 10 unidades de distância por veículo em cada faixa
+    uint32_t size = std::max<uint32_t>(1, vehicles / (2 * lanes) * 10);
+    std::vector<uint32_t> lane, distance;
+    std::vector<float> speed;
+    std::vector<uint32_t> active;
+    auto spawn = [&](uint32_t at) {
+        active.push_back(lane.size());
+        lane.push_back(rng() % (2 * lanes));
+        distance.push_back(at);
+        speed.push_back(1 + rng() % 8);
+    };
+    for (int i = 0; i < vehicles; i++)
+        spawn(rng() % size);
+
+    spatial::LaneIndex index;
+    std::vector<uint32_t> slots;
+    auto key_of = [&](uint32_t id) { return spatial::key(lane[id], distance[id]); };
+    auto speed_of = [&](uint32_t id) { return speed[id]; };
+    std::vector<spatial::Neighbours> result;
+    std::vector<spatial::LaneIndex::Entry> rebuilt;
+    double update_us = 0.0, rebuild_us = 0.0, neighbours_us = 0.0;
+    uint64_t moves = 0, total = 0, resorted = 0;
+    for (int c = 0; c <= cycles; c++) {
+        if (c > 0) {
+            // Os veículos andam, mudam um pouco de velocidade e às vezes de faixa; os que passam do
+            // fim da rodovia saem e outros entram no começo
+            for (uint32_t id : active) {
+                speed[id] = std::clamp(speed[id] + static_cast<float>(static_cast<int>(rng() % 3) - 1), 1.0f, 8.0f);
+                distance[id] += static_cast<uint32_t>(speed[id]);
+                if (rng() % 20 == 0) {
+                    uint32_t side = lane[id] % lanes;
+                    side = rng() % 2 ? std::min(side + 1, lanes - 1) : (side ? side - 1 : 0);
+                    lane[id] = lane[id] / lanes * lanes + side;
+                }
+            }
+            size_t before = active.size();
+            active.erase(std::remove_if(active.begin(), active.end(), [&](uint32_t id) {
+                return distance[id] >= size;
+            }), active.end());
+            for (size_t k = active.size(); k < before; k++)
+                spawn(rng() % 8);
+        }
+        slots.resize(lane.size(), 0);
+        if (result.size() < lane.size())
+            result.resize(lane.size());
+
+        auto start = Clock::now();
+        index.update(active.data(), active.size(), key_of, speed_of, slots);
+        double us = elapsed_us(start);
+        start = Clock::now();
+        index.neighbours(lanes, [&result](uint32_t id, const spatial::Neighbours& neighbours) {
+            result[id] = neighbours;
+        });
+        double neighbours_time = elapsed_us(start);
+
+        rebuilt.resize(active.size());
+        start = Clock::now();
+        for (size_t k = 0; k < active.size(); k++)
+            rebuilt[k] = {key_of(active[k]), active[k], speed[active[k]]};
+        std::sort(rebuilt.begin(), rebuilt.end(), [](const auto& a, const auto& b) { return a.key < b.key; });
+        double rebuild_time = elapsed_us(start);
+        // O primeiro ciclo monta o índice do zero e não entra nas médias
+        if (c > 0) {
+            update_us += us;
+            neighbours_us += neighbours_time;
+            rebuild_us += rebuild_time;
+            moves += index.moves();
+            resorted += index.resorted();
+            total += active.size();
+        }
+    }
+
+    // Confere a distância ao veículo da frente de alguns veículos contra todos os da mesma faixa.
+    // Com vários veículos na mesma posição, o índice pode dar 0 a qualquer um deles
+    int checked = 0, mismatches = 0;
+    for (int k = 0; k < 1000 && k < active.size(); k++) {
+        uint32_t id = active[rng() % active.size()];
+        float expected = spatial::no_collision;
+        for (uint32_t other : active) {
+            if (other != id && lane[other] == lane[id] && distance[other] >= distance[id])
+                expected = std::min(expected, static_cast<float>(distance[other] - distance[id]));
+        }
+        float gap = result[id].gap;
+        mismatches += gap != expected && !(expected == 0.0f && gap >= 0.0f);
+        checked++;
+    }
+
+    std::cout << "incremental:    " << update_us * 1e3 / total << " ns/veículo, "
+              << static_cast<double>(moves) / total << " deslocamentos/veículo, " << resorted << " ciclos com std::sort\n";
+    std::cout << "std::sort:      " << rebuild_us * 1e3 / total << " ns/veículo\n";
+    std::cout << "vizinhos:       " << neighbours_us * 1e3 / total << " ns/veículo\n";
+    std::cout << "conferidos:     " << checked << ", " << mismatches << " diferenças\n";
+    return mismatches == 0;
+}
+
+/// Agregados de tráfego (aggregates.hpp) de uma rodovia com `vehicles` veículos por ciclo:
+/// custo por veículo dos buckets, custo de cada ciclo nas janelas e de uma consulta, comparados
+/// com recalcular as janelas a partir das velocidades guardadas, e erro do p95.
+void bench_traffic(int vehicles, int cycles) {
+    const uint32_t lanes = 8, size = 100000;
+    std::mt19937 rng(29);
+    std::gamma_distribution<float> speeds(4.0f, 1.5f);
+    traffic::HighwayWindows engine;
+    engine.reset(lanes, size);
+    traffic::CycleBucket bucket;
+    // Velocidades dos últimos `max_window` ciclos, para o cálculo do zero
+    std::vector<std::vector<float>> history(traffic::max_window);
+    std::vector<float> cycle_speeds(vehicles);
+    std::vector<uint32_t> cycle_lanes(vehicles), cycle_distances(vehicles);
+
+    double add_us = 0.0, push_us = 0.0, query_us = 0.0, rescan_us = 0.0;
+    double max_mean_error = 0.0, max_p95_error = 0.0;
+    for (int c = 0; c < cycles; c++) {
+        for (int i = 0; i < vehicles; i++) {
+            cycle_speeds[i] = speeds(rng);
+            cycle_lanes[i] = rng() % lanes;
+            cycle_distances[i] = rng() % size;
+        }
+        auto start = Clock::now();
+        bucket.reset(lanes, size);
+        for (int i = 0; i < vehicles; i++)
+            bucket.add(cycle_lanes[i], cycle_distances[i], cycle_speeds[i]);
+        add_us += elapsed_us(start);
+
+        start = Clock::now();
+        engine.push(bucket);
+        push_us += elapsed_us(start);
+
+        start = Clock::now();
+        traffic::TrafficStats stats[traffic::num_windows];
+        for (int w = 0; w < traffic::num_windows; w++)
+            stats[w] = engine.stats(w);
+        query_us += elapsed_us(start);
+
+        history[c % traffic::max_window] = cycle_speeds;
+        start = Clock::now();
+        for (int w = 0; w < traffic::num_windows; w++) {
+            std::vector<float> window;
+            for (int k = 0; k < traffic::windows[w] && k <= c; k++) {
+                const std::vector<float>& past = history[(c - k) % traffic::max_window];
+                window.insert(window.end(), past.begin(), past.end());
+            }
+            double sum = 0.0;
+            for (float speed : window)
+                sum += speed;
+            size_t rank = static_cast<size_t>(std::ceil(0.95 * window.size())) - 1;
+            std::nth_element(window.begin(), window.begin() + rank, window.end());
+            double mean = sum / window.size(), p95 = window[rank];
+            max_mean_error = std::max(max_mean_error, std::abs(stats[w].mean_speed - mean) / mean);
+            max_p95_error = std::max(max_p95_error, std::abs(stats[w].p95_speed - p95) / p95);
+        }
+        rescan_us += elapsed_us(start);
+    }
+    std::cout << "buckets:        " << add_us * 1e3 / (static_cast<double>(vehicles) * cycles) << " ns/veículo\n";
+    std::cout << "janelas:        " << push_us / cycles << " us/ciclo\n";
+    std::cout << "consulta:       " << query_us / cycles << " us (3 janelas)\n";
+    std::cout << "recálculo:      " << rescan_us / cycles << " us (3 janelas)\n";
+    std::cout << "erro relativo máximo: média " << max_mean_error << ", p95 " << max_p95_error << '\n';
+}
+
+/// Compara a navegação antiga do dashboard, que percorria as listas de cada worker conferindo as
+/// flags dos veículos, com as listas por filtro de navigation.hpp, e o heap dos maiores riscos
+/// montado no Transform com ordenar os riscos do lote. Retorna falso se os resultados divergirem.
+bool bench_navigation(int vehicles, int queries) {
+    const int workers = 8, chunk = 1024;
+    // Filtro com cerca de 2% dos veículos, como o de risco de colisão
+    const int filter = 1;
+    std::mt19937 rng(31);
+    std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+    std::vector<uint8_t> flags(vehicles);
+    std::vector<float> risks(vehicles);
+    for (int id = 0; id < vehicles; id++) {
+        flags[id] = 1 | (uniform(rng) < 0.02f) << filter;
+        risks[id] = std::pow(uniform(rng), 4.0f);
+    }
+    auto worker_of = [](int id) {
+        return id / chunk % workers;
+    };
+
+    // Montagem das listas no Transform
+    std::vector<std::vector<uint32_t>> processed(workers);
+    int counts[2] = {};
+    auto start = Clock::now();
+    for (int id = 0; id < vehicles; id++) {
+        processed[worker_of(id)].push_back(id);
+        counts[0]++;
+        counts[1] += flags[id] >> filter & 1;
+    }
+    double old_build_us = elapsed_us(start);
+    if (counts[1] == 0) {
+        std::cout << "nenhum veículo no filtro\n";
+        return true;
+    }
+
+    std::vector<std::vector<uint32_t>> filtered[2];
+    filtered[0].resize(workers);
+    filtered[1].resize(workers);
+    std::vector<navigation::TopK> tops(workers);
+    start = Clock::now();
+    for (int id = 0; id < vehicles; id++) {
+        int w = worker_of(id);
+        for (int f = 0; f < 2; f++) {
+            if (flags[id] >> f & 1)
+                filtered[f][w].push_back(id);
+        }
+        tops[w].offer(risks[id], id);
+    }
+    navigation::SegmentedIndex<> index[2];
+    for (int f = 0; f < 2; f++) {
+        for (int w = 0; w < workers; w++)
+            std::swap(index[f].part(w), filtered[f][w]);
+        index[f].update();
+    }
+    double new_build_us = elapsed_us(start);
+
+    // Avança pelo filtro, voltando ao início no fim, como as setas do dashboard
+    uint64_t old_sum = 0, new_sum = 0;
+    start = Clock::now();
+    int i = 0, j = -1;
+    for (int q = 0; q < queries; q++) {
+        bool found = false;
+        while (!found) {
+            if (++j >= processed[i].size()) {
+                j = -1;
+                i = (i + 1) % workers;
+                continue;
+            }
+            found = flags[processed[i][j]] >> filter & 1;
+        }
+        old_sum += processed[i][j];
+    }
+    double old_next_ns = elapsed_us(start) * 1e3 / queries;
+    start = Clock::now();
+    for (int q = 0, position = 0; q < queries; q++, position = (position + 1) % counts[1])
+        new_sum += index[filter][position];
+    double new_next_ns = elapsed_us(start) * 1e3 / queries;
+    int mismatches = old_sum != new_sum;
+
+    // Saltos para posições aleatórias, que antes exigiam percorrer as listas desde o início
+    std::vector<int> positions(queries);
+    for (int& position : positions)
+        position = rng() % counts[1];
+    std::vector<uint32_t> old_ids(queries), new_ids(queries);
+    int old_jumps = std::min(queries, 1000);
+    start = Clock::now();
+    for (int q = 0; q < old_jumps; q++) {
+        int remaining = positions[q];
+        for (int w = 0; w < workers && remaining >= 0; w++) {
+            for (uint32_t id : processed[w]) {
+                if ((flags[id] >> filter & 1) && remaining-- == 0) {
+                    old_ids[q] = id;
+                    break;
+                }
+            }
+        }
+    }
+    double old_jump_ns = elapsed_us(start) * 1e3 / old_jumps;
+    start = Clock::now();
+    for (int q = 0; q < queries; q++)
+        new_ids[q] = index[filter][positions[q]];
+    double new_jump_ns = elapsed_us(start) * 1e3 / queries;
+    for (int q = 0; q < old_jumps; q++)
+        mismatches += old_ids[q] != new_ids[q];
+
+    // Maiores riscos: junção dos heaps dos workers contra ordenar os riscos de todos os veículos
+    start = Clock::now();
+    navigation::TopK top;
+    for (const navigation::TopK& worker_top : tops)
+        top.merge(worker_top);
+    std::vector<navigation::Ranked> riskiest = top.sorted();
+    double heap_us = elapsed_us(start);
+    start = Clock::now();
+    std::vector<navigation::Ranked> all(vehicles);
+    for (int id = 0; id < vehicles; id++)
+        all[id] = {risks[id], static_cast<uint32_t>(id)};
+    std::partial_sort(all.begin(), all.begin() + navigation::top_k, all.end(),
+        [](const navigation::Ranked& a, const navigation::Ranked& b) {
+            return a.score > b.score || (a.score == b.score && a.id < b.id);
+        });
+    double sort_us = elapsed_us(start);
+    for (size_t k = 0; k < riskiest.size(); k++)
+        mismatches += riskiest[k].id != all[k].id;
+
+    std::cout << "filtro com " << counts[1] << " de " << counts[0] << " veículos\n";
+    std::cout << "listas no Transform: antigo " << old_build_us * 1e3 / vehicles << " ns/veículo, índices "
+              << new_build_us * 1e3 / vehicles << " ns/veículo (com o heap)\n";
+    std::cout << "próximo:             antigo " << old_next_ns << " ns, índice " << new_next_ns << " ns\n";
+    std::cout << "ir para a posição:   antigo " << old_jump_ns << " ns, índice " << new_jump_ns << " ns\n";
+    std::cout << "maiores riscos:      heaps " << heap_us << " us/lote, ordenação " << sort_us << " us/lote\n";
+    std::cout << "divergências: " << mismatches << '\n';
+    return mismatches == 0;
+}
+
+/// Lote de teste do modo `snapshot`: todos os valores são o número do lote, então um leitor que
+/// vê valores diferentes leu um lote pela metade.
+struct BenchBatch {
+    uint32_t batch = 0;
+    std::vector<uint32_t> values;
+};
+
+/// Compara a publicação dos lotes para o dashboard com um mutex segurado durante o desenho
+/// (comportamento antigo) e com as versões imutáveis de snapshot.hpp. Um leitor percorre parte
+/// do lote, como o desenho do terminal, sem parar; mede-se quanto o ETL espera para publicar cada
+/// lote, as leituras por segundo e as leituras inconsistentes. Retorna falso se alguma leitura
+/// for inconsistente.
+bool bench_snapshot(int vehicles, int batches) {
+    bool ok = true;
+    const int read_size = 20000;
+    auto fill = [vehicles](BenchBatch& batch, uint32_t number) {
+        batch.batch = number;
+        batch.values.assign(vehicles, number);
+    };
+    auto check = [](const BenchBatch& batch, uint64_t& reads, uint64_t& inconsistent) {
+        size_t size = std::min<size_t>(batch.values.size(), read_size);
+        bool consistent = true;
+        for (size_t k = 0; k < size; k++)
+            consistent &= batch.values[k] == batch.batch;
+        inconsistent += !consistent;
+        reads++;
+    };
+    auto report = [batches](const char* name, std::vector<double>& waits, double seconds, uint64_t reads,
+                            uint64_t inconsistent) {
+        std::sort(waits.begin(), waits.end());
+        auto percentile = [&waits](double p) {
+            return waits[std::min(waits.size() - 1, static_cast<size_t>(waits.size() * p))];
+        };
+        std::cout << name << ": espera para publicar p50 " << percentile(0.5) << " us, p99 " << percentile(0.99)
+                  << " us, máximo " << waits.back() << " us; " << batches / seconds << " lotes/s, "
+                  << reads / seconds << " leituras/s, " << inconsistent << " inconsistentes\n";
+    };
+
+    {
+        std::mutex mutex;
+        BenchBatch shared, next;
+        std::atomic<bool> done{false};
+        uint64_t reads = 0, inconsistent = 0;
+        std::thread reader([&] {
+            while (!done.load(std::memory_order_relaxed)) {
+                std::lock_guard<std::mutex> lock(mutex);
+                check(shared, reads, inconsistent);
+            }
+        });
+        std::vector<double> waits;
+        auto start = Clock::now();
+        for (int b = 1; b <= batches; b++) {
+            fill(next, b);
+            auto wait_start = Clock::now();
+            std::lock_guard<std::mutex> lock(mutex);
+            waits.push_back(elapsed_us(wait_start));
+            std::swap(shared, next);
+        }
+        double seconds = elapsed_us(start) / 1e6;
+        done = true;
+        reader.join();
+        report("mutex", waits, seconds, reads, inconsistent);
+        ok &= inconsistent == 0;
+    }
+
+    {
+        snapshot::Publisher<BenchBatch> publisher;
+        std::atomic<bool> done{false};
+        uint64_t reads = 0, inconsistent = 0;
+        std::thread reader([&] {
+            while (!done.load(std::memory_order_relaxed)) {
+                auto current = publisher.read();
+                if (current)
+                    check(*current, reads, inconsistent);
+            }
+        });
+        std::vector<double> waits;
+        auto start = Clock::now();
+        for (int b = 1; b <= batches; b++) {
+            std::unique_ptr<BenchBatch> next = publisher.reuse();
+            if (!next)
+                next = std::make_unique<BenchBatch>();
+            fill(*next, b);
+            auto wait_start = Clock::now();
+            publisher.publish(std::move(next));
+            waits.push_back(elapsed_us(wait_start));
+        }
+        double seconds = elapsed_us(start) / 1e6;
+        done = true;
+        reader.join();
+        report("épocas", waits, seconds, reads, inconsistent);
+        ok &= inconsistent == 0;
+    }
+    return ok;
+}
+
+/// Satura o serviço externo: o cliente tem mais requisições simultâneas que a fila do serviço, então
+/// parte das consultas é recusada e passa pelas novas tentativas com espera crescente. Verifica que
+/// toda placa termina respondida ou descartada depois de `max_attempts` tentativas. Retorna falso
+/// se alguma ficar pendente.
+bool bench_enrichment(int num_plates, int max_in_flight, int service_queue) {
+    SlowService service(service_queue, 200000);
+    std::atomic<uint64_t> answered{0};
+    EnrichmentClient client(service, max_in_flight, 4, num_plates, num_plates,
+                            [&answered](std::vector<EnrichmentClient::Result>& results) {
+                                answered += results.size();
+                            });
+    auto start = Clock::now();
+    for (int p = 0; p < num_plates; p++) {
+        char symbols[8];
+        std::snprintf(symbols, sizeof(symbols), "ENR%04d", p % 10000);
+        OwnerInfo cached;
+        client.submit(p, Plate(symbols), 1, static_cast<float>(p % 7), cached);
+    }
+    // As tentativas esperam no máximo alguns segundos cada, então tudo termina bem antes do prazo
+    auto deadline = Clock::now() + std::chrono::seconds(60);
+    while (answered + client.dropped() < static_cast<uint64_t>(num_plates) && Clock::now() < deadline)
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    double seconds = elapsed_us(start) / 1e6;
+    EnrichmentClient::Metrics metrics = client.metrics(0);
+    std::cout << "respondidas " << answered << ", descartadas " << client.dropped() << ", novas tentativas "
+              << client.retried() << ", pendentes " << num_plates - answered - client.dropped() << " em "
+              << seconds << " s; latência média " << metrics.mean_latency() << " s\n";
+    return answered + client.dropped() == static_cast<uint64_t>(num_plates);
+}
+
+/// Verifica que todo veículo de um lote publicado é encontrado pela placa, como nas consultas e na
+/// busca do dashboard (registro e `BatchSnapshot::find`), enquanto o lote seguinte é montado com
+/// outra parte dos veículos. Retorna o número de veículos não encontrados.
+uint64_t check_snapshot_lookup(int vehicles, int batches) {
+    const int workers = 8, chunk = 1024, read_size = 20000;
+    VehicleRegistry registry(vehicles);
+    std::vector<Plate> plates(vehicles);
+    for (int v = 0; v < vehicles; v++) {
+        char symbols[8];
+        std::snprintf(symbols, sizeof(symbols), "%c%c%c%04d", 'A' + v / 260000 % 26, 'A' + v / 10000 % 26,
+                      'A' + v / 676 % 26, v % 10000);
+        plates[v] = Plate(symbols);
+    }
+    // Ids em uma ordem diferente da dos veículos, como os atribuídos na chegada
+    std::vector<uint32_t> ids(vehicles);
+    for (int v = 0; v < vehicles; v++)
+        ids[v] = registry.find_or_insert(plates[v].code(), [](uint32_t) {}).first;
+
+    snapshot::Publisher<BatchSnapshot> publisher;
+    std::atomic<bool> done{false};
+    uint64_t reads = 0, checked = 0, missing = 0;
+    std::thread reader([&] {
+        while (!done.load(std::memory_order_relaxed)) {
+            auto current = publisher.read();
+            if (!current)
+                continue;
+            size_t size = std::min<size_t>(current->vehicles.size(), read_size);
+            for (size_t n = 0; n < size; n++) {
+                const VehicleView& view = current->vehicles[n];
+                const VehicleView* found = current->find(registry.find(view.plate.code()));
+                missing += !found || found->plate != view.plate;
+            }
+            checked += size;
+            reads++;
+        }
+    });
+
+    std::mt19937 rng(5);
+    std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+    for (int b = 1; b <= batches; b++) {
+        std::unique_ptr<BatchSnapshot> next = publisher.reuse();
+        if (!next)
+            next = std::make_unique<BatchSnapshot>();
+        next->batch = b;
+        // Cada lote computa cerca de 60% dos veículos, divididos entre os workers em blocos
+        for (int w = 0; w < workers; w++)
+            next->vehicles.part(w).clear();
+        for (int v = 0; v < vehicles; v++) {
+            if (uniform(rng) < 0.6f) {
+                VehicleView view{};
+                view.id = ids[v];
+                view.plate = plates[v];
+                next->vehicles.part(v / chunk % workers).push_back(view);
+            }
+        }
+        next->vehicles.update();
+        if (next->slots.size() < registry.id_limit())
+            next->slots.resize(registry.id_limit());
+        for (int w = 0; w < workers; w++)
+            next->index_part(w);
+        publisher.publish(std::move(next));
+    }
+    done = true;
+    reader.join();
+    std::cout << "busca por placa no lote publicado: " << reads << " leituras, " << checked
+              << " veículos verificados, " << missing << " não encontrados\n";
+    return missing;
+}
+
+int main(int argc, char** argv) {
+    std::string mode = argc > 1 ? argv[1] : "pool";
+    // Falso se alguma das verificações de um modo divergir, para que o benchmark falhe
+    bool ok = true;
+
+    if (mode == "pool") {
+        int workers = argc > 2 ? std::atoi(argv[2]) : 4;
+        int num_batches = argc > 3 ? std::atoi(argv[3]) : 1000;
+        int vehicles = argc > 4 ? std::atoi(argv[4]) : 2000;
+        bench_pool(workers, num_batches, vehicles);
+    } else if (mode == "ingest") {
+        int num_cycles = argc > 2 ? std::atoi(argv[2]) : 1000;
+        int vehicles = argc > 3 ? std::atoi(argv[3]) : 100;
+        std::cout << "ciclos por conexão=" << num_cycles << " veículos=" << vehicles << '\n';
+        for (int connections : {1, 10, 100})
+            bench_ingest(connections, num_cycles, vehicles);
+    } else if (mode == "delta") {
+        int num_cycles = argc > 2 ? std::atoi(argv[2]) : 1000;
+        int vehicles = argc > 3 ? std::atoi(argv[3]) : 10000;
+        std::cout << "ciclos=" << num_cycles << " veículos=" << vehicles << '\n';
+        ok = bench_delta(num_cycles, vehicles);
+    } else if (mode == "alloc") {
+        int num_cycles = argc > 2 ? std::atoi(argv[2]) : 1000;
+        int vehicles = argc > 3 ? std::atoi(argv[3]) : 1000;
+        int batch_size = argc > 4 ? std::atoi(argv[4]) : 10;
+        std::cout << "ciclos=" << num_cycles << " veículos=" << vehicles << " ciclos por arena=" << batch_size << '\n';
+        ok = bench_alloc(num_cycles, vehicles, batch_size);
+    } else if (mode == "transport") {
+        int num_cycles = argc > 2 ? std::atoi(argv[2]) : 10000;
+        int vehicles = argc > 3 ? std::atoi(argv[3]) : 1000;
+        double rate = argc > 4 ? std::atof(argv[4]) : 0.0;
+        std::cout << "ciclos=" << num_cycles << " veículos=" << vehicles << " ciclos/s="
+                  << (rate > 0 ? std::to_string(rate) : "máximo") << '\n';
+        std::vector<std::string> transports{"grpc", "shm"};
+        if (argc > 5)
+            transports = {argv[5]};
+        for (const std::string& transport : transports)
+            ok &= bench_transport(transport, num_cycles, vehicles, rate);
+    } else if (mode == "files") {
+        int num_cycles = argc > 2 ? std::atoi(argv[2]) : 1000;
+        int vehicles = argc > 3 ? std::atoi(argv[3]) : 10000;
+        int workers = argc > 4 ? std::atoi(argv[4]) : std::thread::hardware_concurrency();
+        std::cout << "ciclos=" << num_cycles << " veículos=" << vehicles << " workers=" << workers << '\n';
+        ok = bench_files(num_cycles, vehicles, workers);
+    } else if (mode == "numbers") {
+        int fields = argc > 2 ? std::atoi(argv[2]) : 100000;
+        int fuzz_iterations = argc > 3 ? std::atoi(argv[3]) : 1000000;
+        std::cout << "campos=" << fields << '\n';
+        ok = bench_numbers(fields, fuzz_iterations);
+    } else if (mode == "plates") {
+        size_t count = argc > 2 ? std::atoll(argv[2]) : 10000000;
+        std::cout << "placas=" << count << '\n';
+        bench_plates(count);
+    } else if (mode == "transform") {
+        int vehicles = argc > 2 ? std::atoi(argv[2]) : 100000;
+        int repetitions = argc > 3 ? std::atoi(argv[3]) : 100;
+        std::cout << "veículos=" << vehicles << " repetições=" << repetitions << '\n';
+        bench_transform(vehicles, repetitions);
+    } else if (mode == "rules") {
+        int vehicles = argc > 2 ? std::atoi(argv[2]) : 100000;
+        int repetitions = argc > 3 ? std::atoi(argv[3]) : 100;
+        std::cout << "veículos=" << vehicles << " repetições=" << repetitions << '\n';
+        bench_rules(vehicles, repetitions);
+    } else if (mode == "spatial") {
+        int vehicles = argc > 2 ? std::atoi(argv[2]) : 100000;
+        int cycles = argc > 3 ? std::atoi(argv[3]) : 100;
+        int lanes = argc > 4 ? std::atoi(argv[4]) : 4;
+        std::cout << "veículos=" << vehicles << " ciclos=" << cycles << " faixas por direção=" << lanes << '\n';
+        ok = bench_spatial(vehicles, cycles, lanes);
+    } else if (mode == "traffic") {
+        int vehicles = argc > 2 ? std::atoi(argv[2]) : 100000;
+        int cycles = argc > 3 ? std::atoi(argv[3]) : 200;
+        std::cout << "veículos=" << vehicles << " ciclos=" << cycles << '\n';
+        bench_traffic(vehicles, cycles);
+    } else if (mode == "navigation") {
+        int vehicles = argc > 2 ? std::atoi(argv[2]) : 1000000;
+        int queries = argc > 3 ? std::atoi(argv[3]) : 100000;
+        std::cout << "veículos=" << vehicles << " consultas=" << queries << '\n';
+        ok = bench_navigation(vehicles, queries);
+    } else if (mode == "snapshot") {
+        int vehicles = argc > 2 ? std::atoi(argv[2]) : 1000000;
+        int batches = argc > 3 ? std::atoi(argv[3]) : 2000;
+        std::cout << "veículos=" << vehicles << " lotes=" << batches << '\n';
+        ok = bench_snapshot(vehicles, batches);
+        ok &= check_snapshot_lookup(vehicles, std::min(batches, 200)) == 0;
+    } else if (mode == "enrichment") {
+        int num_plates = argc > 2 ? std::atoi(argv[2]) : 2000;
+        int max_in_flight = argc > 3 ? std::atoi(argv[3]) : 8;
+        int service_queue = argc > 4 ? std::atoi(argv[4]) : 2;
+        std::cout << "placas=" << num_plates << " requisições=" << max_in_flight << " fila do serviço="
+                  << service_queue << '\n';
+        ok = bench_enrichment(num_plates, max_in_flight, service_queue);
+    } else {
+        std::cerr << "Modos disponíveis: pool, ingest, delta, alloc, transport, files, numbers, plates, transform, rules, spatial, traffic, navigation, snapshot, enrichment\n";
+        return 1;
+    }
+    return ok ? 0 : 1;
+}
@@ -1,42 +1,127 @@
-// npm install express express-handlebars nodemon
+// npm install
 // node app.js
+//
+// Assina os lotes do ETL por gRPC (QueryService.Subscribe em proto/simulation.proto) e repassa as
+// mudanças aos navegadores por Server-Sent Events. O estado fica aqui, indexado pela placa: cada
+// navegador recebe tudo uma vez ao conectar e depois só as mudanças de cada lote.
 
+const path = require('path');
 const express = require('express');
-const app = express();
 const { engine } = require('express-handlebars');
+const grpc = require('@grpc/grpc-js');
+const protoLoader = require('@grpc/proto-loader');
+
+const etlAddress = process.env.ETL_ADDRESS || 'localhost:50051';
+// Filtro assinado (0 para todos os veículos) e número máximo de veículos acompanhados
+const filter = Number(process.env.FILTER || 0);
+const limit = Number(process.env.LIMIT || 1000);
+// Espera antes de assinar de novo quando a chamada termina
+const retryMilliseconds = 1000;
+
+const definition = protoLoader.loadSync(path.join(__dirname, '../proto/simulation.proto'), {
+    keepCase: true,
+    longs: Number,
+    defaults: true,
+});
+const simulation = grpc.loadPackageDefinition(definition).simulation;
+const client = new simulation.QueryService(etlAddress, grpc.credentials.createInsecure());
+
+// Último estado conhecido, atualizado a cada mensagem da assinatura
+const state = {
+    batch: 0,
+    filters: [],
+    latencies: [],
+    droppedCycles: 0,
+    vehicles: new Map(),
+};
+// Respostas abertas de /events
+const browsers = new Set();
+
+function counters() {
+    return {
+        batch: state.batch,
+        filters: state.filters,
+        latencies: state.latencies,
+        droppedCycles: state.droppedCycles,
+    };
+}
+
+function send(response, event, data) {
+    response.write(`event: ${event}\ndata: ${JSON.stringify(data)}\n\n`);
+}
+
+function sendAll(response) {
+    send(response, 'reset', { ...counters(), vehicles: [...state.vehicles.values()] });
+}
+
+function subscribe() {
+    const call = client.Subscribe({ filter, limit });
+    call.on('data', (update) => {
+        if (update.reset)
+            state.vehicles.clear();
+        for (const plate of update.removed)
+            state.vehicles.delete(plate);
+        for (const vehicle of update.changed)
+            state.vehicles.set(vehicle.plate, vehicle);
+        state.batch = update.batch;
+        state.filters = update.filters;
+        state.latencies = update.latencies;
+        state.droppedCycles = update.dropped_cycles;
+
+        for (const response of browsers) {
+            if (update.reset)
+                sendAll(response);
+            else
+                send(response, 'update', { ...counters(), changed: update.changed, removed: update.removed });
+        }
+    });
+    call.on('error', (error) => {
+        console.error(`Assinatura encerrada: ${error.details || error.message}`);
+    });
+    call.on('end', () => {
+        setTimeout(subscribe, retryMilliseconds);
+    });
+}
+
+const app = express();
 app.use(express.static('public'));
 
 app.engine('handlebars', engine());
 app.set('view engine', 'handlebars');
 app.set('views', './views');
 
-// Dado falso.
-let data = [{
-    plate: 'ABC-123',
-    gps: '123.456',
-    speed: '123',
-    acceleration: '123',
-    risk: '123',
-    name: 'John Doe',
-    model: 'Tesla',
-    year: '2021',
-},];
-
 app.get('/', (req, res) => {
-    res.render('home', {layout: false, data: data});
+    res.render('home', { layout: false });
 });
 
-app.get('/getData', (req, res) => {
-   res.json(data);
+app.get('/events', (req, res) => {
+    res.writeHead(200, {
+        'Content-Type': 'text/event-stream',
+        'Cache-Control': 'no-cache',
+        Connection: 'keep-alive',
+    });
+    sendAll(res);
+    browsers.add(res);
+    req.on('close', () => browsers.delete(res));
 });
 
-app.post('/updateData', (req, res) => {
-   data = req.body;
-   res.json({ message: 'Data updated' });
+// Página dos veículos de um filtro no último lote, ou o veículo de uma placa, direto do ETL
+app.get('/query', (req, res) => {
+    const query = {
+        filter: Number(req.query.filter || 0),
+        offset: Number(req.query.offset || 0),
+        limit: Number(req.query.limit || 0),
+        plate: req.query.plate || '',
+    };
+    client.QueryVehicles(query, (error, page) => {
+        if (error)
+            res.status(error.code === grpc.status.INVALID_ARGUMENT ? 400 : 502).json({ error: error.details });
+        else
+            res.json(page);
+    });
 });
 
+subscribe();
 app.listen(3000, () => {
-   console.log('Server listening on port 3000');
+    console.log('Server listening on port 3000');
 });
-
-// JS ainda precisa funcionar legal, estava pensando nesse Tabulator.
@@ -1,23 +1,45 @@
 import {Tabulator} from 'https://cdnjs.cloudflare.com/ajax/libs/tabulator/5.4.4/js/tabulator_esm.min.js';
-import axios from 'https://cdn.skypack.dev/axios';
 
-const allCarsDataset = async () => {
-    const response = await axios.get('/getData');
-    return response.data;
-}
-
-const createTable = async () => new Tabulator("#main-table", {
-    height:205, // set height of table (in CSS or here), this enables the Virtual DOM and improves render speed dramatically (can be any valid css height value)
-    data: allCarsDataset, //assign data to table
+// Os veículos são indexados pela placa, então cada lote só altera as linhas que mudaram
+const table = new Tabulator("#main-table", {
+    height:405, // set height of table (in CSS or here), this enables the Virtual DOM and improves render speed dramatically (can be any valid css height value)
+    index:"plate",
     layout:"fitColumns", //fit columns to width of table (optional)
     columns:[ //Define Table Columns
         {title:"Plate", field:"plate", width:150},
-        {title:"GPS", field:"gps", align:"left"},
+        {title:"Highway", field:"highway", align:"left"},
+        {title:"Lane", field:"lane", align:"left"},
+        {title:"Distance", field:"distance", align:"left"},
         {title:"Speed", field:"speed", align:"left"},
         {title:"Acceleration", field:"acceleration", align:"left"},
         {title:"Risk", field:"risk", align:"left"},
-        {title:"Name", field:"name", align:"left"},
+        {title:"Name", field:"owner", align:"left"},
         {title:"Model", field:"model", align:"left"},
         {title:"Year", field:"year", align:"left"},
     ],
 });
+
+const showCounters = (data) => {
+    const filters = data.filters.map((filter) => `${filter.name}: ${filter.batch_count}, ${filter.registered}`);
+    const latencies = data.latencies.map((highway) => `${highway.name}: ${highway.seconds.toFixed(6)} s`);
+    document.querySelector("#batch").textContent = `Lote ${data.batch}, ${data.droppedCycles} ciclos descartados`;
+    document.querySelector("#filters").textContent = filters.join(" | ");
+    document.querySelector("#latencies").textContent = latencies.join(" | ");
+}
+
+const events = new EventSource("/events");
+
+events.addEventListener("reset", (event) => {
+    const data = JSON.parse(event.data);
+    showCounters(data);
+    table.replaceData(data.vehicles);
+});
+
+events.addEventListener("update", (event) => {
+    const data = JSON.parse(event.data);
+    showCounters(data);
+    for (const plate of data.removed)
+        table.deleteRow(plate);
+    if (data.changed.length > 0)
+        table.updateOrAddData(data.changed);
+});
@@ -105,6 +105,32 @@ parser.add_argument(
     help="Duration (in milliseconds) of each cycle",
     default=1,
 )
+parser.add_argument(
+    "-o",
+    "--output",
+    type=str,
+    help="Folder where each cycle is written as a file for the ETL, instead of using the API",
+    default=None,
+)
+
+parser.add_argument(
+    "-a",
+    "--api",
+    type=str,
+    choices=["unary", "batch", "stream", "delta", "shm"],
+    help="RPC used to report cycles: one call per cycle, batches of cycles, a single stream, "
+    "a single stream of delta-encoded cycles or a shared-memory ring (same host only)",
+    default="unary",
+)
+
+parser.add_argument(
+    "-b",
+    "--batch-size",
+    type=int,
+    help="Number of cycles in each call when using the batch API",
+    default=10,
+)
+
 parser.add_argument(
     '-p',
     '--print',
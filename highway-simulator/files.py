@@ -0,0 +1,58 @@
+import os
+from time import process_time, time
+from models import Highway
+
+
+class FileReporter:
+    """
+    Escreve cada ciclo em um arquivo `<ciclo>.txt` na pasta, que o ETL observa e remove depois
+    de ler. O formato é o descrito em ETL/cycle_file.hpp. Cada arquivo é escrito com outra
+    extensão e renomeado no fim, para que o ETL nunca leia um ciclo pela metade.
+    Tem a mesma interface de rpc.Reporter.
+    """
+
+    def __init__(self, folder: str):
+        self.folder = folder
+        os.makedirs(folder, exist_ok=True)
+        self.messages = 0
+        self.vehicles = 0
+        self.bytes = 0
+        self.cpu_time = 0.0
+        self.start = time()
+
+    def report(self, cycle: int, highway: Highway):
+        start = process_time()
+        # A direção é 0 para os veículos que chegam e 1 para os que saem, como em rpc.build_cycle
+        lines = [
+            f"{highway.name}\n",
+            f"{highway.lanes} {highway.size} {highway.speed_limit} {cycle} {time()}\n",
+        ]
+        for direction, vehicles in enumerate([
+            highway.incoming_vehicles,
+            highway.outgoing_vehicles,
+        ]):
+            for vehicle in vehicles:
+                lines.append(f"{vehicle.id} {direction} {vehicle.pos.lane} {vehicle.pos.dist}\n")
+                self.vehicles += 1
+        content = "".join(lines)
+
+        path = os.path.join(self.folder, f"{cycle}.txt")
+        with open(path + ".tmp", "w") as file:
+            file.write(content)
+        os.replace(path + ".tmp", path)
+        self.messages += 1
+        self.bytes += len(content)
+        self.cpu_time += process_time() - start
+
+    def close(self):
+        pass
+
+    def summary(self) -> str:
+        elapsed = time() - self.start
+        per_vehicle = self.cpu_time / self.vehicles * 1e6 if self.vehicles else 0.0
+        return (
+            f"API: files\t"
+            f"Messages/s: {self.messages / elapsed:.1f}\t"
+            f"MB/s: {self.bytes / elapsed / 1e6:.2f}\t"
+            f"CPU per vehicle: {per_vehicle:.2f} us"
+        )
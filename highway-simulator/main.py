@@ -1,7 +1,9 @@
 from args import args
 from models import Highway
 from simulation import Simulation, SimulationParams
+import files
 import rpc
+import shm
 
 if __name__ == "__main__":
     highway = Highway(
@@ -23,13 +25,27 @@ if __name__ == "__main__":
         cycle_duration=args.duration,
     )
 
-    rpc_stub = rpc.connect()
+    reporter = None
+    if args.output:
+        reporter = files.FileReporter(args.output)
+    elif args.api == "shm":
+        # O anel não depende do servidor estar no ar: o ETL o encontra quando iniciar
+        reporter = shm.ShmReporter(highway)
+    else:
+        rpc_stub = rpc.connect()
+        if rpc_stub:
+            reporter = rpc.Reporter(rpc_stub, highway, args.api, args.batch_size)
 
     simulation = Simulation(
         highway,
         params,
         silent=not args.print,
-        rpc_stub=rpc_stub
+        reporter=reporter
     )
 
-    simulation.run()
+    try:
+        simulation.run()
+    except KeyboardInterrupt:
+        if reporter:
+            reporter.close()
+            print(reporter.summary())
@@ -1,8 +1,9 @@
 import grpc
 import proto.simulation_pb2 as pb2
 import proto.simulation_pb2_grpc as pb2_grpc
-from typing import List, Tuple
-from time import time
+from queue import Queue
+from threading import Thread
+from time import process_time, time
 from models import Highway
 import socket
 
@@ -19,12 +20,8 @@ def connect() -> pb2_grpc.SimulationServiceStub:
     return stub
 
 
-def report_cycle(
-    sub: pb2_grpc.SimulationServiceStub,
-    cycle: int,
-    highway: Highway,
-):
-
+def build_cycle(cycle: int, highway: Highway, highway_id: int = 0) -> pb2.SimulationCycle:
+    # A direção é 0 para os veículos que chegam e 1 para os que saem
     pb2_vehicles = [
         pb2.RawVehicle(
             plate=vehicle.id,
@@ -32,24 +29,177 @@ def report_cycle(
             lane=vehicle.pos.lane,
             distance=vehicle.pos.dist,
         )
-        for direction, vehicle in enumerate([
-            *highway.incoming_vehicles,
-            *highway.outgoing_vehicles,
+        for direction, vehicles in enumerate([
+            highway.incoming_vehicles,
+            highway.outgoing_vehicles,
         ])
+        for vehicle in vehicles
     ]
 
-    pb2_highway = pb2.Highway(
+    pb2_simulation_cycle = pb2.SimulationCycle(
+        cycle=cycle,
+        timestamp=time(),
+        vehicles=pb2_vehicles,
+    )
+
+    # Com a rodovia registrada, basta o id; sem ela, os dados vão em todo ciclo
+    if highway_id:
+        pb2_simulation_cycle.highway_id = highway_id
+    else:
+        pb2_simulation_cycle.highway.CopyFrom(build_highway(highway))
+
+    return pb2_simulation_cycle
+
+
+def build_highway(highway: Highway) -> pb2.Highway:
+    return pb2.Highway(
         name=highway.name,
         lanes=highway.lanes,
         size=highway.size,
         speed_limit=highway.speed_limit,
     )
 
-    pb2_simulation_cycle = pb2.SimulationCycle(
-        cycle=cycle,
-        timestamp=time(),
-        highway=pb2_highway,
-        vehicles=pb2_vehicles,
-    )
 
-    sub.ReportCycle(pb2_simulation_cycle)
+def report_cycle(
+    sub: pb2_grpc.SimulationServiceStub,
+    cycle: int,
+    highway: Highway,
+):
+    sub.ReportCycle(build_cycle(cycle, highway))
+
+
+class DeltaEncoder:
+    """
+    Dicionário de placas de uma chamada de StreamDeltas. Cada placa recebe um número na primeira
+    vez que aparece, e depois só são enviados os veículos que mudaram de passo ou de faixa. Os
+    números dos veículos que saem são reutilizados pelos que entram nos ciclos seguintes, na mesma
+    ordem que no DeltaDecoder do ETL.
+    """
+
+    def __init__(self, highway_id: int):
+        self.highway_id = highway_id
+        # placa -> [referência, faixa, distância, passo]
+        self.dictionary = {}
+        self.next_ref = 0
+        # números liberados, na ordem de `exited`; o último é o primeiro reutilizado
+        self.free_refs = []
+
+    def encode(self, cycle: pb2.SimulationCycle) -> pb2.DeltaCycle:
+        delta = pb2.DeltaCycle(
+            cycle=cycle.cycle,
+            timestamp=cycle.timestamp,
+            highway_id=self.highway_id,
+        )
+        seen = set()
+        for vehicle in cycle.vehicles:
+            seen.add(vehicle.plate)
+            entry = self.dictionary.get(vehicle.plate)
+            if entry is None:
+                if self.free_refs:
+                    ref = self.free_refs.pop()
+                else:
+                    ref = self.next_ref
+                    self.next_ref += 1
+                self.dictionary[vehicle.plate] = [ref, vehicle.lane, vehicle.distance, 0]
+                delta.entered.append(vehicle)
+                continue
+            step = vehicle.distance - entry[2]
+            if step != entry[3]:
+                delta.step_refs.append(entry[0])
+                delta.steps.append(step)
+                entry[3] = step
+            if vehicle.lane != entry[1]:
+                delta.lane_refs.append(entry[0])
+                delta.lanes.append(vehicle.lane)
+                entry[1] = vehicle.lane
+            entry[2] = vehicle.distance
+
+        for plate in [plate for plate in self.dictionary if plate not in seen]:
+            ref = self.dictionary.pop(plate)[0]
+            delta.exited.append(ref)
+            self.free_refs.append(ref)
+        return delta
+
+
+class Reporter:
+    """
+    Envia os ciclos ao ETL usando uma das APIs do serviço:
+    - unary: uma chamada de ReportCycle por ciclo, com a rodovia completa;
+    - batch: registra a rodovia e envia `batch_size` ciclos por chamada de ReportCycles;
+    - stream: registra a rodovia e envia todos os ciclos em uma única chamada de StreamCycles;
+    - delta: como stream, mas com ciclos em formato delta em uma chamada de StreamDeltas.
+    Também conta as mensagens enviadas e o tempo de CPU gasto para comparar as APIs.
+    """
+
+    def __init__(
+        self,
+        stub: pb2_grpc.SimulationServiceStub,
+        highway: Highway,
+        api: str = "unary",
+        batch_size: int = 10,
+    ):
+        self.stub = stub
+        self.api = api
+        self.batch_size = batch_size
+        self.highway_id = 0
+        self.batch = []
+        self.messages = 0
+        self.vehicles = 0
+        self.cpu_time = 0.0
+        self.start = time()
+
+        if api != "unary":
+            self.highway_id = stub.RegisterHighway(build_highway(highway)).id
+        if api == "delta":
+            self.encoder = DeltaEncoder(self.highway_id)
+        if api in ("stream", "delta"):
+            # O gRPC consome o iterador em outra thread; None encerra a chamada
+            self.queue = Queue()
+            self.stream = Thread(
+                target=stub.StreamDeltas if api == "delta" else stub.StreamCycles,
+                args=(iter(self.queue.get, None),),
+                daemon=True,
+            )
+            self.stream.start()
+
+    def report(self, cycle: int, highway: Highway):
+        start = process_time()
+        message = build_cycle(cycle, highway, self.highway_id)
+        self.vehicles += len(message.vehicles)
+
+        if self.api == "delta":
+            self.queue.put(self.encoder.encode(message))
+            self.messages += 1
+        elif self.api == "stream":
+            self.queue.put(message)
+            self.messages += 1
+        elif self.api == "batch":
+            self.batch.append(message)
+            if len(self.batch) >= self.batch_size:
+                self.flush()
+        else:
+            self.stub.ReportCycle(message)
+            self.messages += 1
+        self.cpu_time += process_time() - start
+
+    def flush(self):
+        if self.batch:
+            self.stub.ReportCycles(pb2.CycleBatch(cycles=self.batch))
+            self.batch = []
+            self.messages += 1
+
+    def close(self):
+        if self.api == "batch":
+            self.flush()
+        elif self.api in ("stream", "delta"):
+            self.queue.put(None)
+            self.stream.join()
+
+    def summary(self) -> str:
+        elapsed = time() - self.start
+        per_vehicle = self.cpu_time / self.vehicles * 1e6 if self.vehicles else 0.0
+        return (
+            f"API: {self.api}\t"
+            f"Messages/s: {self.messages / elapsed:.1f}\t"
+            f"CPU per vehicle: {per_vehicle:.2f} us"
+        )
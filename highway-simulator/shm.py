@@ -0,0 +1,124 @@
+import ctypes
+import os
+from time import process_time, time
+from models import Highway
+
+
+class ShmVehicle(ctypes.Structure):
+    # Mesmo formato de `ShmVehicle` em ETL/shm_ring.hpp
+    _fields_ = [
+        ("plate", ctypes.c_char * 8),
+        ("distance", ctypes.c_uint32),
+        ("lane", ctypes.c_uint16),
+        ("direction", ctypes.c_uint8),
+        ("padding", ctypes.c_uint8),
+    ]
+
+
+def load_library() -> ctypes.CDLL:
+    """
+    Carrega a biblioteca compilada junto do servidor (libshm_producer.so, na raiz do projeto),
+    ou a indicada pela variável de ambiente SHM_PRODUCER_LIB.
+    """
+    default = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "libshm_producer.so")
+    library = ctypes.CDLL(os.environ.get("SHM_PRODUCER_LIB", default))
+
+    library.shm_producer_open.restype = ctypes.c_void_p
+    library.shm_producer_open.argtypes = [
+        ctypes.c_char_p,
+        ctypes.c_char_p,
+        ctypes.c_uint32,
+        ctypes.c_uint32,
+        ctypes.c_uint32,
+        ctypes.c_uint32,
+        ctypes.c_uint32,
+    ]
+    library.shm_producer_push.restype = ctypes.c_int
+    library.shm_producer_push.argtypes = [
+        ctypes.c_void_p,
+        ctypes.c_uint32,
+        ctypes.c_double,
+        ctypes.POINTER(ShmVehicle),
+        ctypes.c_uint32,
+        ctypes.c_double,
+    ]
+    library.shm_producer_close.restype = None
+    library.shm_producer_close.argtypes = [ctypes.c_void_p]
+    library.shm_producer_error.restype = ctypes.c_char_p
+    return library
+
+
+class ShmReporter:
+    """
+    Envia os ciclos ao ETL por um anel de memória compartilhada, quando o simulador roda na mesma
+    máquina. Tem a mesma interface de rpc.Reporter. O ETL encontra o anel sozinho, então não é
+    preciso que ele já esteja rodando quando o simulador começa.
+    """
+
+    def __init__(self, highway: Highway, num_slots: int = 64, timeout: float = 1.0):
+        self.library = load_library()
+        self.timeout = timeout
+        # Cada veículo ocupa uma posição de uma faixa em uma das duas direções, e `lanes` conta as
+        # faixas de uma direção só, então o ciclo nunca tem mais que isso
+        max_vehicles = 2 * highway.lanes * highway.size
+        self.producer = self.library.shm_producer_open(
+            None,
+            highway.name.encode(),
+            highway.lanes,
+            highway.size,
+            highway.speed_limit,
+            num_slots,
+            max_vehicles,
+        )
+        if not self.producer:
+            raise RuntimeError(self.library.shm_producer_error().decode())
+        self.buffer = (ShmVehicle * max_vehicles)()
+        self.messages = 0
+        self.dropped = 0
+        self.vehicles = 0
+        self.cpu_time = 0.0
+        self.start = time()
+
+    def report(self, cycle: int, highway: Highway):
+        start = process_time()
+        # A direção é 0 para os veículos que chegam e 1 para os que saem, como em rpc.build_cycle
+        count = 0
+        for direction, vehicles in enumerate([
+            highway.incoming_vehicles,
+            highway.outgoing_vehicles,
+        ]):
+            for vehicle in vehicles:
+                record = self.buffer[count]
+                record.plate = vehicle.id.encode()
+                record.distance = vehicle.pos.dist
+                record.lane = vehicle.pos.lane
+                record.direction = direction
+                count += 1
+
+        result = self.library.shm_producer_push(
+            self.producer, cycle, time(), self.buffer, count, self.timeout
+        )
+        if result < 0:
+            raise RuntimeError(self.library.shm_producer_error().decode())
+        if result == 0:
+            # O ETL não leu o anel a tempo
+            self.dropped += 1
+        else:
+            self.messages += 1
+            self.vehicles += count
+        self.cpu_time += process_time() - start
+
+    def close(self):
+        if self.producer:
+            self.library.shm_producer_close(self.producer)
+            self.producer = None
+
+    def summary(self) -> str:
+        elapsed = time() - self.start
+        per_vehicle = self.cpu_time / self.vehicles * 1e6 if self.vehicles else 0.0
+        return (
+            f"API: shm\t"
+            f"Messages/s: {self.messages / elapsed:.1f}\t"
+            f"Dropped: {self.dropped}\t"
+            f"CPU per vehicle: {per_vehicle:.2f} us"
+        )
@@ -31,20 +31,20 @@ class Simulation:
     cycle: int
     num_files: int = 5
     silent: bool = True
-    rpc_stub = None
+    reporter: Optional[rpc.Reporter] = None
 
     def __init__(
         self,
         highway: Highway,
         params: SimulationParams,
         silent: bool = True,
-        rpc_stub=None,
+        reporter: Optional[rpc.Reporter] = None,
     ):
         self.highway = highway
         self.params = params
         self.cycle = 0
         self.silent = silent
-        self.rpc_stub = rpc_stub
+        self.reporter = reporter
 
     def run(self):
         while True:
@@ -245,9 +245,5 @@ class Simulation:
         print(f"Collisions:\t{collisions_count:04d}")
 
     def __report_cycle(self):
-        if self.rpc_stub:
-            rpc.report_cycle(
-                self.rpc_stub,
-                self.cycle,
-                self.highway,
-            )
+        if self.reporter:
+            self.reporter.report(self.cycle, self.highway)
@@ -9,8 +9,10 @@ using std::cout;
 using std::endl;
 
 int main(int argc, char** argv) {
-    // Argumentos: número de threads (mínimo 3) e tamanho da fila do serviço externo
+    // Argumentos: número de threads (mínimo 4) e tamanho da fila do serviço externo
     ETL etl(6, 10);
+    // Regras de alerta e filtros do dashboard (conjunto padrão se o arquivo não existir)
+    etl.load_rules("rules.conf");
     std::vector<std::string> folders;
     // O comportamento padrão é verificar apenas a pasta data/
     if (argc == 1)
@@ -20,5 +22,12 @@ int main(int argc, char** argv) {
         folders.push_back(argv[i]);
         folders.back() += "/";
     }
-    etl.run(folders);
+    // Os ciclos também podem chegar pelo gRPC enquanto as pastas são observadas
+    etl.watch_folders(folders);
+    etl.run();
+
+    // Custo do dashboard, medido à parte da latência do ETL
+    ETL::RenderStats render = etl.render_stats();
+    cout << "Dashboard: " << render.frames << " quadros para " << render.requests << " pedidos, "
+         << render.mean_seconds * 1e3 << " ms por quadro (máximo " << render.max_seconds * 1e3 << " ms)" << endl;
 }
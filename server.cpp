@@ -14,6 +14,12 @@ int main(int argc, char** argv) {
     std::ofstream file("results.csv");
     // Parâmetros: número de threads (mínimo 5) e tamanho da fila do serviço externo
     ETL etl(10, 5);
+    // Sem o dashboard, para que as medições não incluam o terminal
+    etl.set_headless();
+    // Regras de alerta e filtros do dashboard (conjunto padrão se o arquivo não existir)
+    etl.load_rules("rules.conf");
+    // Simuladores na mesma máquina podem enviar os ciclos por memória compartilhada
+    etl.enable_shm_transport();
     std::thread etl_thread(&ETL::run, &etl, 0.0);
 
     for (int i = 0; i < num_runs; i++) {
@@ -22,6 +28,7 @@ int main(int argc, char** argv) {
     }
     file.close();
 
-    // Nunca vai acontecer, não conseguimos parar o servidor sem usar ctrl + c
+    // Encerra o servidor e espera os lotes já recebidos
+    etl.stop();
     etl_thread.join();
 }
@@ -0,0 +1,47 @@
+#include <exception>
+#include <string>
+
+#include "ETL/shm_ring.hpp"
+
+// Interface em C da biblioteca compartilhada usada pelos simuladores (em Python, via ctypes)
+// para enviar ciclos ao ETL por memória compartilhada, sem passar pelo gRPC.
+
+namespace {
+thread_local std::string last_error;
+}
+
+extern "C" {
+
+/// Cria o anel de uma rodovia. Retorna nulo em caso de erro, descrito por `shm_producer_error`.
+/// Com `name` nulo ou vazio, o nome é gerado com o prefixo padrão, que o ETL procura.
+void* shm_producer_open(const char* name, const char* highway, uint32_t lanes, uint32_t size,
+                        uint32_t speed_limit, uint32_t num_slots, uint32_t max_vehicles) {
+    try {
+        return new ShmRingWriter(name ? name : "", highway, lanes, size, speed_limit, num_slots, max_vehicles);
+    } catch (const std::exception& e) {
+        last_error = e.what();
+        return nullptr;
+    }
+}
+
+/// Envia um ciclo, esperando até `timeout` segundos se o anel estiver cheio. Retorna 1 se o
+/// ciclo foi enviado, 0 se o tempo acabou e -1 se ele tem mais veículos do que cabem no anel.
+int shm_producer_push(void* producer, uint32_t cycle, double timestamp, const ShmVehicle* vehicles,
+                      uint32_t num_vehicles, double timeout) {
+    try {
+        return static_cast<ShmRingWriter*>(producer)->push(cycle, timestamp, vehicles, num_vehicles, timeout);
+    } catch (const std::exception& e) {
+        last_error = e.what();
+        return -1;
+    }
+}
+
+/// Encerra o anel e libera o produtor, esperando brevemente o ETL ler os últimos ciclos.
+void shm_producer_close(void* producer) {
+    delete static_cast<ShmRingWriter*>(producer);
+}
+
+const char* shm_producer_error() {
+    return last_error.c_str();
+}
+}